@@ -0,0 +1,148 @@
+/*
+   AfcModelStore
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Save the converged AFC model (the feedback-path estimate plus the whiten and band-limit filters)
+            to the SD card and restore it at power-up, so that the feedback canceller starts out converged
+            instead of starting from zero.  The snapshot is only restored if it was taken with the same afl,
+            hdel, chunk size, and sample rate as are now running, and if its CRC and values check out.
+
+            The Tympan gets no warning before its power is cut, so the model is saved periodically (see
+            serviceAutoSave()) in addition to whenever it is saved by command.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _AfcModelStore_h
+#define _AfcModelStore_h
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include "SdShared.h"
+#include "AudioEffectBTNRH.h"
+#include "GhaPreset.h"   //for gha_preset_crc32()
+
+#define AFC_MODEL_MAGIC    0x4D434641UL  // "AFCM", little-endian
+#define AFC_MODEL_VERSION  1
+#define AFC_MODEL_MAX_ABS  4.0f          // any coefficient bigger than this is taken to be a diverged model
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    int32_t afl, wfl, pfl, hdel, cs;
+    float srate;
+    float efbp[AFC_MAX_AFL];   // estimated feedback path
+    float wfrp[AFC_MAX_WFL];   // whiten filter
+    float ffrp[AFC_MAX_PFL];   // band-limit filter
+    uint32_t crc;              // CRC-32 of the bytes before this field.  Must be last.
+} AfcModelSnapshot;
+
+class AfcModelStore {
+  public:
+    AfcModelStore(SdFs &_sd, const char *_fname = "AFCMODEL.BIN") : sd(_sd), fname(_fname) {};
+
+    int saveModel(AudioEffectBTNRH_F32 &alg);     //snapshot the running model and write it to the SD card
+    int restoreModel(AudioEffectBTNRH_F32 &alg);  //read the model from the SD card and, if it fits, load it into the algorithm
+    bool serviceAutoSave(unsigned long curTime_millis, unsigned long updatePeriod_millis, AudioEffectBTNRH_F32 &alg, bool allowed = true);
+    const char *getErrorString(int err);
+
+    enum ERR {OK=0, ERR_SD=-1, ERR_READ=-2, ERR_FORMAT=-3, ERR_CRC=-4, ERR_MISMATCH=-5, ERR_VALUES=-6, ERR_AFC_OFF=-7};
+
+  protected:
+    SdFs &sd;  //the volume shared with the SD writer (see SdShared.h)
+    const char *fname;
+    bool beginSD(void) { return beginSharedSD(sd); }
+    AfcModelSnapshot snap;  //kept here, rather than on the stack, because it is about 1 kB
+    static bool copyIfPresent(float *dst, const float *src, int n, int n_max);
+};
+
+//copyIfPresent: copy n values and zero the rest (up to n_max).  Does nothing if the CHAPRO buffer doesn't exist.
+bool AfcModelStore::copyIfPresent(float *dst, const float *src, int n, int n_max) {
+  if ((dst == NULL) || (src == NULL)) return false;
+  for (int i=0; i<n_max; i++) dst[i] = (i < n) ? src[i] : 0.0f;
+  return true;
+}
+
+int AfcModelStore::saveModel(AudioEffectBTNRH_F32 &alg) {
+  if (!alg.getAfcEnabled()) return ERR_AFC_OFF;  //the model isn't being adapted, so there's nothing worth saving
+
+  //take the snapshot with the audio interrupts held off, so that the coefficients all come from the same block
+  memset(&snap, 0, sizeof(snap));
+  snap.magic = AFC_MODEL_MAGIC;
+  snap.version = AFC_MODEL_VERSION;
+  AudioNoInterrupts();
+  snap.afl = alg.get_cha_ivar(_afl);
+  snap.wfl = alg.get_cha_ivar(_wfl);
+  snap.pfl = alg.get_cha_ivar(_pfl);
+  snap.hdel = alg.get_cha_ivar(_hdel);
+  copyIfPresent(snap.efbp, (float *)alg.cp[_efbp], snap.afl, AFC_MAX_AFL);
+  copyIfPresent(snap.wfrp, (float *)alg.cp[_wfrp], snap.wfl, AFC_MAX_WFL);
+  copyIfPresent(snap.ffrp, (float *)alg.cp[_ffrp], snap.pfl, AFC_MAX_PFL);
+  AudioInterrupts();
+  snap.cs = chunk;               //see test_gha.h
+  snap.srate = (float)srate;     //see test_gha.h
+  snap.crc = gha_preset_crc32(&snap, offsetof(AfcModelSnapshot, crc));
+
+  if (!beginSD()) return ERR_SD;
+  FsFile file = sd.open(fname, O_RDWR | O_CREAT | O_TRUNC);
+  if (!file) return ERR_SD;
+  bool ok = (file.write(&snap, sizeof(snap)) == sizeof(snap));
+  file.close();
+  return ok ? OK : ERR_SD;
+}
+
+int AfcModelStore::restoreModel(AudioEffectBTNRH_F32 &alg) {
+  if (!beginSD()) return ERR_SD;
+  FsFile file = sd.open(fname, O_RDONLY);
+  if (!file) return ERR_READ;
+  bool ok = (file.read(&snap, sizeof(snap)) == (int)sizeof(snap));
+  file.close();
+  if (!ok) return ERR_READ;
+
+  //sanity check the snapshot against itself and against what is running
+  if ((snap.magic != AFC_MODEL_MAGIC) || (snap.version != AFC_MODEL_VERSION)) return ERR_FORMAT;
+  if (snap.crc != gha_preset_crc32(&snap, offsetof(AfcModelSnapshot, crc))) return ERR_CRC;
+  if ((snap.afl != alg.get_cha_ivar(_afl)) || (snap.hdel != alg.get_cha_ivar(_hdel)) || (snap.cs != chunk) || (snap.srate != (float)srate)) return ERR_MISMATCH;
+  if ((snap.wfl < 0) || (snap.wfl > AFC_MAX_WFL) || (snap.pfl < 0) || (snap.pfl > AFC_MAX_PFL)) return ERR_VALUES;
+  for (int i=0; i<AFC_MAX_AFL; i++) if (!(fabsf(snap.efbp[i]) < AFC_MODEL_MAX_ABS)) return ERR_VALUES;  //also catches NaN
+  for (int i=0; i<AFC_MAX_WFL; i++) if (!(fabsf(snap.wfrp[i]) < AFC_MODEL_MAX_ABS)) return ERR_VALUES;
+  for (int i=0; i<AFC_MAX_PFL; i++) if (!(fabsf(snap.ffrp[i]) < AFC_MODEL_MAX_ABS)) return ERR_VALUES;
+
+  //load it between audio blocks.  The whiten and band-limit filters are only loaded if their lengths match.
+  AudioNoInterrupts();
+  copyIfPresent((float *)alg.cp[_efbp], snap.efbp, snap.afl, AFC_MAX_AFL);
+  if (snap.wfl == alg.get_cha_ivar(_wfl)) copyIfPresent((float *)alg.cp[_wfrp], snap.wfrp, snap.wfl, AFC_MAX_WFL);
+  if (snap.pfl == alg.get_cha_ivar(_pfl)) copyIfPresent((float *)alg.cp[_ffrp], snap.ffrp, snap.pfl, AFC_MAX_PFL);
+  AudioInterrupts();
+  return OK;
+}
+
+//serviceAutoSave: call from loop().  Saves the model every updatePeriod_millis, unless "allowed" is false (such as
+//  while the SD card is busy recording audio).
+bool AfcModelStore::serviceAutoSave(unsigned long curTime_millis, unsigned long updatePeriod_millis, AudioEffectBTNRH_F32 &alg, bool allowed) {
+  static unsigned long lastUpdate_millis = 0;
+  if (curTime_millis < lastUpdate_millis) lastUpdate_millis = 0; //handle wrap-around of the clock
+  if ((curTime_millis - lastUpdate_millis) < updatePeriod_millis) return false;
+  lastUpdate_millis = curTime_millis;
+  if (!allowed) return false;
+  return (saveModel(alg) == OK);
+}
+
+const char* AfcModelStore::getErrorString(int err) {
+  switch (err) {
+    case OK: return "OK";
+    case ERR_SD: return "could not access the SD card";
+    case ERR_READ: return "no saved model";
+    case ERR_FORMAT: return "unknown file format";
+    case ERR_CRC: return "bad CRC";
+    case ERR_MISMATCH: return "saved with a different afl, hdel, chunk size, or sample rate";
+    case ERR_VALUES: return "values out of range";
+    case ERR_AFC_OFF: return "AFC is disabled";
+  }
+  return "unknown error";
+}
+
+#endif
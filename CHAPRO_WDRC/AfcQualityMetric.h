@@ -0,0 +1,183 @@
+/*
+   AfcQualityMetric
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Track the AFC's misalignment (how far its feedback-path estimate, _efbp, is from the real feedback
+            path) over a run of any length in constant memory.  CHAPRO's own quality metric (afc.sqm) saves one
+            value per chunk for the whole run, so its buffer grows with the length of the run (see prepare() in
+            test_gha.h).  Here, instead:
+
+               - the misalignment is measured every "decim" chunks (a point),
+               - the latest AFC_QM_RING_LEN points are kept in a ring buffer (for the final value, or a live view),
+               - the whole run is kept as a trace of at most AFC_QM_HIST_LEN points, which is halved (neighbouring
+                 points averaged) whenever it fills up, so that it always spans the whole run, and
+               - optionally, every point is handed to a flush function as the ring fills, for writing to a file.
+
+            The reference path is CHAPRO's simulated feedback path (_sfbp, when afc.fbl > 0), or any measured
+            path given to afc_qm_update(), aligned the same way as _efbp (ie, after the hardware delay, hdel).
+
+            There is no allocation and no Arduino dependency, so the same code can be used on the Tympan and in
+            the host programs.  Call afc_qm_update() after each call to process_chunk(), on the same thread.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _AfcQualityMetric_h
+#define _AfcQualityMetric_h
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <chapro.h>
+
+#define AFC_QM_RING_LEN  512   // latest points kept (a power of 2)
+#define AFC_QM_HIST_LEN  512   // most points in the whole-run trace (even)
+
+typedef void (*AfcQmFlushFn)(void *arg, const float *qm, int n);
+
+typedef struct
+{
+    int decim;                      // chunks per point
+    int i_chunk;                    // chunks since the last point
+    uint32_t n_points;              // points so far
+    float ring[AFC_QM_RING_LEN];    // the latest points; point i is at ring[i % AFC_QM_RING_LEN]
+    float hist[AFC_QM_HIST_LEN];    // the whole-run trace
+    int n_hist;                     // points in hist
+    uint32_t hist_step;             // points per hist entry (doubles whenever hist fills up)
+    double hist_acc;                // the points being averaged into the next hist entry...
+    uint32_t hist_n_acc;            // ...and how many of them there are
+    AfcQmFlushFn flush;             // optional: where to send the points as the ring fills up
+    void *flush_arg;
+    uint32_t n_flushed;             // points sent to flush
+} AfcQualityMetric;
+
+/***********************************************************/
+
+// start a new run.  decim is the number of chunks per point.  flush may be NULL.
+
+static void
+afc_qm_init(AfcQualityMetric *m, int decim, AfcQmFlushFn flush, void *flush_arg)
+{
+    memset(m, 0, sizeof(AfcQualityMetric));
+    m->decim = (decim < 1) ? 1 : decim;
+    m->hist_step = 1;
+    m->flush = flush;
+    m->flush_arg = flush_arg;
+}
+
+// misalignment of the estimate efbp (afl taps) from the reference path ref (nref taps), as a power ratio:
+// the energy of their difference over the energy of ref.  Negative if there is no reference.
+
+static float
+afc_qm_misalignment(const float *efbp, int afl, const float *ref, int nref)
+{
+    double dif = 0, tot = 0, d;
+    int i, n = (afl > nref) ? afl : nref;
+
+    if ((ref == NULL) || (nref < 1)) return -1.0f;
+    for (i = 0; i < n; i++) {
+        d = ((i < nref) ? ref[i] : 0.0) - (((i < afl) && efbp) ? efbp[i] : 0.0);
+        dif += d * d;
+        if (i < nref) tot += (double)ref[i] * ref[i];
+    }
+    return (tot > 0) ? (float)(dif / tot) : -1.0f;
+}
+
+// the misalignment of a prepared context right now, against ref or, if ref is NULL, the simulated feedback path
+
+static float
+afc_qm_misalignment_cp(CHA_PTR cp, const float *ref, int nref)
+{
+    if ((cp[_ivar] == NULL) || (cp[_efbp] == NULL)) return -1.0f;
+    if (ref == NULL) {
+        ref = (const float *)cp[_sfbp];
+        nref = CHA_IVAR[_fbl];
+    }
+    return afc_qm_misalignment((const float *)cp[_efbp], CHA_IVAR[_afl], ref, nref);
+}
+
+static void
+afc_qm_send(AfcQualityMetric *m, uint32_t n_upto)
+{
+    uint32_t i0, n;
+
+    while ((m->flush != NULL) && (m->n_flushed < n_upto)) {
+        i0 = m->n_flushed % AFC_QM_RING_LEN;
+        n = n_upto - m->n_flushed;
+        if (i0 + n > AFC_QM_RING_LEN) n = AFC_QM_RING_LEN - i0;  // up to the end of the ring, then the rest
+        m->flush(m->flush_arg, m->ring + i0, (int)n);
+        m->n_flushed += n;
+    }
+}
+
+static void
+afc_qm_add_point(AfcQualityMetric *m, float q)
+{
+    int i;
+
+    m->ring[m->n_points % AFC_QM_RING_LEN] = q;
+    m->n_points++;
+    if (m->n_points - m->n_flushed >= AFC_QM_RING_LEN / 2) afc_qm_send(m, m->n_points);
+
+    m->hist_acc += q;
+    if (++m->hist_n_acc < m->hist_step) return;
+    if (m->n_hist == AFC_QM_HIST_LEN) {  // full, so halve it
+        for (i = 0; i < AFC_QM_HIST_LEN / 2; i++) m->hist[i] = 0.5f * (m->hist[2 * i] + m->hist[2 * i + 1]);
+        m->n_hist = AFC_QM_HIST_LEN / 2;
+        m->hist_step *= 2;
+        if (m->hist_n_acc < m->hist_step) return;  // keep accumulating for the new, longer step
+    }
+    m->hist[m->n_hist++] = (float)(m->hist_acc / m->hist_n_acc);
+    m->hist_acc = 0;
+    m->hist_n_acc = 0;
+}
+
+// call after each chunk.  ref is the reference path (NULL for CHAPRO's simulated feedback path).
+// Returns 1 if a point was added, 0 if not, or -1 if there is no reference path to measure against.
+
+static int
+afc_qm_update(AfcQualityMetric *m, CHA_PTR cp, const float *ref, int nref)
+{
+    float q;
+
+    if (++m->i_chunk < m->decim) return 0;
+    m->i_chunk = 0;
+    q = afc_qm_misalignment_cp(cp, ref, nref);
+    if (q < 0) return -1;
+    afc_qm_add_point(m, q);
+    return 1;
+}
+
+// send any points that haven't been sent to flush yet (call at the end of the run)
+
+static void
+afc_qm_flush(AfcQualityMetric *m)
+{
+    afc_qm_send(m, m->n_points);
+}
+
+// the mean of the last n points, in dB (NAN if there are none).  Only the points still in the ring are used.
+
+static double
+afc_qm_recent_db(const AfcQualityMetric *m, int n)
+{
+    double sum = 0;
+    int i;
+
+    if (n > (int)m->n_points) n = (int)m->n_points;
+    if (n > AFC_QM_RING_LEN) n = AFC_QM_RING_LEN;
+    if (n < 1) return NAN;
+    for (i = 1; i <= n; i++) sum += m->ring[(m->n_points - i) % AFC_QM_RING_LEN];
+    return (sum > 0) ? 10 * log10(sum / n) : NAN;
+}
+
+// the whole-run trace: entry i (0 <= i < n_hist) covers points [i * hist_step, (i + 1) * hist_step)
+
+static double
+afc_qm_hist_db(const AfcQualityMetric *m, int i)
+{
+    return (m->hist[i] > 0) ? 10 * log10(m->hist[i]) : -INFINITY;
+}
+
+#endif
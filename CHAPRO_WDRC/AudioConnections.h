@@ -6,7 +6,7 @@ EarpieceMixer_F32_UI    earpieceMixer(audio_settings); //mixes earpiece mics, al
 AudioEffectBTNRH_F32    BTNRH_alg1(audio_settings);    //see tab "AudioEffectBTNRH.h"
 AudioEffectGain_F32     gain1(audio_settings);         //added gain block to easily increase or lower the gain
 AudioOutputI2SQuad_F32  audio_out(audio_settings);
-AudioSDWriter_F32_UI    audioSDWriter(audio_settings); //this is 2-channels of audio by default, but can be changed to 4 in setup()
+AudioSDWriter_F32_UI    audioSDWriter(&sd, audio_settings); //this is 2-channels of audio by default, but can be changed to 4 in setup().  Shares the SD card (see SdShared.h)
 
 
 //connect the inputs to the earpiece mixer
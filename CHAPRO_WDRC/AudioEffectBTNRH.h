@@ -20,6 +20,17 @@
 // Algorithm-specific include files
 #include <chapro.h>
 #include "test_gha.h"            ////////////////////////////////////////// Update this for your CHAPRO Algorithm!!!!
+#include "TaskScheduler.h"       //for taskShouldYield()
+#include "FixedFormat.h"         //for FixedBuf and bleSendMessage()
+
+// Production builds can replace process_chunk() with a chain whose chunk size is fixed at compile time (see
+// GhaChain.h).  It is only used when the running context has the same chunk size, so anything else still runs
+// through process_chunk().
+//#define USE_GHA_CHAIN
+#ifdef USE_GHA_CHAIN
+#include "GhaChain.h"
+typedef GhaChain<GHA_CHUNK, AfcOn> GhaProductionChain;
+#endif
 
 
 class AudioEffectBTNRH_F32 : public AudioStream_F32
@@ -33,7 +44,8 @@ class AudioEffectBTNRH_F32 : public AudioStream_F32
     //worrying about the left and right overwriting each other's settings or states.
     //
     //CHAPRO-relevant data members...each instance of this algorithm gets its own copy of these data structures
-    void *cp[NPTR] = {0};        // NPTR is set in chapro.h???
+    void *cp_bank[2][NPTR] = {{0}};  // two CHAPRO contexts, so that a new prescription can be prepared while the other one runs.  NPTR is set in chapro.h???
+    void **cp = cp_bank[0];          // the context that is currently running
     I_O io;                
     int local_prepared = 0;
     CHA_AFC local_afc;     ////////////////////////////////////////// Add or remove based on *your* CHAPRO Algorithm!!!!
@@ -50,15 +62,44 @@ class AudioEffectBTNRH_F32 : public AudioStream_F32
     void print_dsl_params(void);
     void print_agc_params(void);
     void print_afc_params(void);
+    void print_filterbank_table(void) { ::print_filterbank_table(&local_dsl, &local_agc); } //see test_gha.h.  Paste into GHA_FilterbankTable.h
     bool servicePrintingFeedbackModel(unsigned long curTime_millis, unsigned long updatePeriod_millis);
     bool servicePrintingFeedbackModel_toApp(unsigned long curTime_millis, unsigned long updatePeriod_millis, BLE_UI &ble);
+    bool isPrintingFeedbackModel_toApp(void) { return modelToApp_next_ind >= 0; }  //part way through sending the model?
     
-    //methods to reset some AFC state arrays?  [is this complete?  I think that it's missing stuff?]
-    void reset_feedback_model(void) {
-      int n_coeff = get_cha_ivar(_afl);
-      float *efbp = (float *)cp[_efbp];
-      for (int i=0; i<n_coeff;i++) efbp[i]=0.0f;
-    }
+    //reset the AFC.  This only sets a flag, so it returns immediately.  The audio thread then resets all of the
+    //adapted AFC state (feedback model, whiten and band-limit filters and their histories, and signal history) at
+    //the next block boundary.  The filters go back to their designs, as prepared.
+    void reset_feedback_model(void) { flag_resetFeedbackModel = true; }
+
+    //change the AFC filter lengths (_afl, _wfl, or _pfl) while running.  The new length is applied by the audio
+    //thread at the start of the next block.  Lengths are limited to the AFC_MAX_XXX values set in test_gha.h.
+    int setAfcFilterLength(int ind, int new_len);
+    int getAfcFilterLength(int ind);
+
+    //Glitch-free change of prescription ("program").  startProgramChange() takes a copy of the new prescription.  Then,
+    //serviceProgramChange() (call it from loop()) prepares the spare CHAPRO context one step at a time.  Once it is
+    //ready, the audio thread swaps to it at a block boundary, carrying over the AFC model and crossfading from the
+    //old context.  Finally, serviceProgramChange() frees the old context.  The audio thread never prepares or frees.
+    enum PROGRAM_CHANGE_STAGE {PC_IDLE=0, PC_FILTERBANK, PC_COMPRESSOR, PC_FEEDBACK, PC_SWAP, PC_CROSSFADE, PC_CLEANUP};
+    bool startProgramChange(const CHA_DSL *dsl, const CHA_WDRC *agc, const CHA_AFC *afc);
+    bool reloadPrescription(void);   //re-configure from GHA_Constants.h and then change to it (see changePrescription())
+    int serviceProgramChange(void);  //call from loop()
+    void getActivePrescription(CHA_DSL *dsl, CHA_WDRC *agc, CHA_AFC *afc);  //includes any AFC changes made while running
+    bool isProgramChangeActive(void) { return program_change_stage != PC_IDLE; }
+    int crossfade_samples = 240;     //length of the crossfade between programs (240 samples is 10 msec at 24 kHz)
+    unsigned long lastProgramChange_millis = 0;  //how long the most recent program change took, start to finish
+
+    //Change only the AGC settings (tkgain, cr, tk, bolt, attack, release, and the broadband limiter) in place, without
+    //re-preparing the filterbank or the AFC, so that the AFC stays converged and no crossfade is needed.  Only works
+    //if the filterbank is unchanged.  Call from loop().  Returns the number of values that were changed, or a
+    //negative number if the change can't be done this way.
+    int updateAgcPrescription(const CHA_DSL *dsl, const CHA_WDRC *agc);
+
+    //Change to a new prescription by the quickest route that works: in place, if only the AGC settings and the
+    //run-time AFC settings (mu, rho, eps, alf, filter lengths) changed, or else via startProgramChange().
+    enum PRESCRIPTION_CHANGE {CHANGE_BUSY=-1, CHANGE_STARTED=0, CHANGE_IN_PLACE=1};
+    int changePrescription(const CHA_DSL *dsl, const CHA_WDRC *agc, const CHA_AFC *afc);
 
     //enable different parts of the algorithm
     bool setEnabled(bool val = true) { return enabled = val; }  //overall enabled or not
@@ -68,6 +109,7 @@ class AudioEffectBTNRH_F32 : public AudioStream_F32
 
     //setup methods
     bool setup_complete = false;
+    volatile unsigned long firstBlock_micros = 0;  //when the first audio block was processed (micros since power-up)
     void setup(void)  { 
 
       //copy local copies out to the global instances prior to setup?  NO.  Assume that the global functions (configure() and prepare()) will define the globals
@@ -79,6 +121,7 @@ class AudioEffectBTNRH_F32 : public AudioStream_F32
       //run the configure() and prepare() functions in the global space
       configure(&io);               //in test_gha.h
       prepare(&io, cp);             //in test_gha.h
+      save_afc_design(cp, &afc_design_bank[active_bank]);  //for reset_feedback(), see test_gha.h
 
       //copy global instances back to local instances for safe-keeping (not really needed for monural operation, but some day this will be important for binaural
       memcpy(&local_afc, &afc_global, sizeof(CHA_AFC));  //////////////////// Add or remove items based on *your* CHAPRO Algorithm!!!! 
@@ -97,15 +140,31 @@ class AudioEffectBTNRH_F32 : public AudioStream_F32
       float *x = audio_block->data;  //This is used input audio.  And, the output is written back in here, too
       int cs = audio_block->length;  //How many audio samples to process?
       
+      //if a new program has been prepared, switch to it (before the local copies are pushed to the globals)
+      if (program_change_stage == PC_SWAP) swapToNextProgram();
       
       //copy local copies to global instances before calling functions in the global scope
       memcpy(&afc_global, &local_afc, sizeof(CHA_AFC));  //////////////////// Add or remove items based on *your* CHAPRO Algorithm!!!! 
       memcpy(&dsl_global, &local_dsl, sizeof(CHA_DSL));  //////////////////// Add or remove items based on *your* CHAPRO Algorithm!!!! 
       memcpy(&agc_global, &local_agc, sizeof(CHA_WDRC)); //////////////////// Add or remove items based on *your* CHAPRO Algorithm!!!! 
       prepared = local_prepared; //////////////////// Add or remove items based on *your* CHAPRO Algorithm!!!!  
+
+      //apply any changes that were requested from outside of the audio thread (ie, from loop())
+      if (flag_newAfcFilterLengths) {
+        set_afc_lengths(cp, pending_afc_len[0], pending_afc_len[1], pending_afc_len[2]);  //see test_gha.h
+        flag_newAfcFilterLengths = false;
+      }
+      if (flag_resetFeedbackModel) {
+        reset_feedback(cp, &afc_design_bank[active_bank]);  //see test_gha.h
+        flag_resetFeedbackModel = false;
+      }
        
       //hopefully, this one line is all that needs to change to reflect what CHAPRO code you want to use
-      process_chunk(cp, x, x, cs); //see test_gha.h  (or whatever test_xxxx.h is #included at the top)
+      if (program_change_stage == PC_CROSSFADE) {
+        processWithCrossfade(x, cs);  //runs both the old and new programs, fading from the old to the new
+      } else {
+        process_context(cp, x, cs); //see test_gha.h  (or whatever test_xxxx.h is #included at the top)
+      }
 
       //copy global instances back to local copies after completing the functions that are in the global scope
       memcpy(&local_afc, &afc_global, sizeof(CHA_AFC));  //////////////////// Add or remove items based on *your* CHAPRO Algorithm!!!! 
@@ -130,6 +189,7 @@ class AudioEffectBTNRH_F32 : public AudioStream_F32
         audio_block_f32_t *audio_block;
         audio_block = AudioStream_F32::receiveWritable_f32();
         if (!audio_block) return;
+        if (firstBlock_micros == 0) firstBlock_micros = micros();  //for timing the boot
 
         //do your work
         applyMyAlgorithm(audio_block); //this is the method defined earlier that you can touch as you see fit
@@ -145,42 +205,74 @@ class AudioEffectBTNRH_F32 : public AudioStream_F32
     audio_block_f32_t *inputQueueArray_f32[1]; //memory pointer for the input to this module
     bool enabled = false;
 
+    //pending AFC filter lengths (afl, wfl, pfl) waiting for the audio thread to apply them
+    volatile int pending_afc_len[3] = {0, 0, 0};
+    volatile bool flag_newAfcFilterLengths = false;
+
+    //set by reset_feedback_model(), cleared by the audio thread once the AFC has been reset
+    volatile bool flag_resetFeedbackModel = false;
+
+    //state for the program change.  The spare context is always cp_bank[1-active_bank].
+    volatile int program_change_stage = PC_IDLE;
+    int active_bank = 0;
+    AFC_DESIGN afc_design_bank[2];  //each context's whiten and band-limit filters as designed, for reset_feedback()
+    CHA_AFC next_afc;       //prescription being prepared in the spare context
+    CHA_DSL next_dsl;
+    CHA_WDRC next_agc;
+    void **cp_fading = NULL; //old context that is being faded out
+    int crossfade_count = 0;
+    unsigned long programChangeStart_millis = 0;
+    int modelToApp_next_ind = -1;  //next coefficient to send to the App (-1 if not sending)
+    static const int max_block_samples = 128;
+    float crossfade_buff[max_block_samples];
+    void swapToNextProgram(void);
+    void processWithCrossfade(float *x, int cs);
+    void process_context(void **cp_use, float *x, int cs) {
+#ifdef USE_GHA_CHAIN
+      if (prepared && ((cs % GHA_CHUNK) == 0) && GhaProductionChain::matches(cp_use)) {
+        GhaProductionChain::process_block(cp_use, x, x, cs);
+        return;
+      }
+#endif
+      process_chunk(cp_use, x, x, cs); //see test_gha.h
+    }
+
 }; //end class definition for AudioEffectBTNRH
 
-//methods to print AFC parameters
+//methods to print AFC parameters.  Printed a piece at a time so that nothing is allocated (see FixedFormat.h)
 void AudioEffectBTNRH_F32::print_dsl_params(void) {
-  Serial.println("local_dsl: attack = " + String(local_dsl.attack));
-  Serial.println("local_dsl: release = "+ String(local_dsl.release));
-  Serial.println("local_dsl: maxdB = " + String(local_dsl.maxdB));
-  Serial.println("local_dsl: ear = " + String(local_dsl.ear));
-  Serial.println("local_dsl: nchannel = " + String(local_dsl.nchannel));
+  Serial.print("local_dsl: attack = "); Serial.println(local_dsl.attack);
+  Serial.print("local_dsl: release = "); Serial.println(local_dsl.release);
+  Serial.print("local_dsl: maxdB = "); Serial.println(local_dsl.maxdB);
+  Serial.print("local_dsl: ear = "); Serial.println(local_dsl.ear);
+  Serial.print("local_dsl: nchannel = "); Serial.println(local_dsl.nchannel);
   int nchannel = local_dsl.nchannel;
-  Serial.print("local_dsl: cross_freq = "); for (int i=0; i<nchannel;i++) { Serial.print(String(local_dsl.cross_freq[i]) + ", "); } Serial.println();
-  Serial.print("local_dsl: tkgain = "); for (int i=0; i<nchannel;i++) { Serial.print(String(local_dsl.tkgain[i]) + ", "); } Serial.println();
-  Serial.print("local_dsl: cr = "); for (int i=0; i<nchannel;i++) { Serial.print(String(local_dsl.cr[i]) + ", "); } Serial.println();
-  Serial.print("local_dsl: tk = "); for (int i=0; i<nchannel;i++) { Serial.print(String(local_dsl.tk[i]) + ", "); } Serial.println();
-  Serial.print("local_dsl: bolt = "); for (int i=0; i<nchannel;i++) { Serial.print(String(local_dsl.bolt[i]) + ", "); } Serial.println();    
+  Serial.print("local_dsl: cross_freq = "); for (int i=0; i<nchannel;i++) { Serial.print(local_dsl.cross_freq[i]); Serial.print(", "); } Serial.println();
+  Serial.print("local_dsl: tkgain = "); for (int i=0; i<nchannel;i++) { Serial.print(local_dsl.tkgain[i]); Serial.print(", "); } Serial.println();
+  Serial.print("local_dsl: cr = "); for (int i=0; i<nchannel;i++) { Serial.print(local_dsl.cr[i]); Serial.print(", "); } Serial.println();
+  Serial.print("local_dsl: tk = "); for (int i=0; i<nchannel;i++) { Serial.print(local_dsl.tk[i]); Serial.print(", "); } Serial.println();
+  Serial.print("local_dsl: bolt = "); for (int i=0; i<nchannel;i++) { Serial.print(local_dsl.bolt[i]); Serial.print(", "); } Serial.println();    
 }
 void AudioEffectBTNRH_F32::print_agc_params(void) {
-  Serial.println("AGC: alfa = " + String(get_cha_dvar(_alfa),6));
-  Serial.println("AGC: beta = " + String(get_cha_dvar(_beta),6));
-  Serial.println("AGC: maxdB = " + String(get_cha_dvar(_mxdb)));
-  Serial.println("AGC: tkgn = " + String(get_cha_dvar(_tkgn)));
-  Serial.println("AGC: tk = " + String(get_cha_dvar(_tk)));
-  Serial.println("AGC: cr = " + String(get_cha_dvar(_cr)));
-  Serial.println("AGC: bolt = " + String(get_cha_dvar(_bolt)));
+  Serial.print("AGC: alfa = "); Serial.println(get_cha_dvar(_alfa),6);
+  Serial.print("AGC: beta = "); Serial.println(get_cha_dvar(_beta),6);
+  Serial.print("AGC: maxdB = "); Serial.println(get_cha_dvar(_mxdb));
+  Serial.print("AGC: tkgn = "); Serial.println(get_cha_dvar(_tkgn));
+  Serial.print("AGC: tk = "); Serial.println(get_cha_dvar(_tk));
+  Serial.print("AGC: cr = "); Serial.println(get_cha_dvar(_cr));
+  Serial.print("AGC: bolt = "); Serial.println(get_cha_dvar(_bolt));
 }
 void AudioEffectBTNRH_F32::print_afc_params(void) {
-  Serial.println("AFC: afl = " + String(get_cha_ivar(_afl)));
-  Serial.println("AFC: wfl= " + String(get_cha_ivar(_wfl)));
-  Serial.println("AFC: pfl = " + String(get_cha_ivar(_pfl)));
-  Serial.println("AFC: fbl = " + String(get_cha_ivar(_fbl)));
-  Serial.println("AFC: hdel = " + String(get_cha_ivar(_hdel)));
-  Serial.println("AFC: mu = " + String(get_cha_dvar(_mu),8));
-  Serial.println("AFC: rho = " + String(get_cha_dvar(_rho),8));
-  Serial.println("AFC: eps = " + String(get_cha_dvar(_eps),8));
-  Serial.println("AFC: alf = " + String(get_cha_dvar(_alf),8));
-  Serial.println("AFC: fbm = " + String(get_cha_dvar(_fbm),8));      
+  Serial.print("AFC: afl = "); Serial.println(get_cha_ivar(_afl));
+  Serial.print("AFC: wfl= "); Serial.println(get_cha_ivar(_wfl));
+  Serial.print("AFC: pfl = "); Serial.println(get_cha_ivar(_pfl));
+  Serial.print("AFC: fbl = "); Serial.println(get_cha_ivar(_fbl));
+  Serial.print("AFC: hdel = "); Serial.println(get_cha_ivar(_hdel));
+  Serial.print("AFC: mu = "); Serial.println(get_cha_dvar(_mu),8);
+  Serial.print("AFC: rho = "); Serial.println(get_cha_dvar(_rho),8);
+  Serial.print("AFC: eps = "); Serial.println(get_cha_dvar(_eps),8);
+  Serial.print("AFC: alf = "); Serial.println(get_cha_dvar(_alf),8);
+  Serial.print("AFC: fbm = "); Serial.println(get_cha_dvar(_fbm),8);      
 }
 
 //setAfcEnabled: enable or disable the AFC portion of the BTNRH algorithm.
@@ -208,6 +300,213 @@ bool AudioEffectBTNRH_F32::setAfcEnabled(bool _enable) {
   return getAfcEnabled();
 }
 
+//setAfcFilterLength: request a new length for the AFC's adaptive filter (_afl), whiten filter (_wfl),
+//  or band-limit filter (_pfl).  The AFC buffers were allocated at their maximum size in prepare(), so
+//  nothing is re-allocated.  The change is applied by the audio thread at the next block boundary, where
+//  the existing coefficients are kept (up to the new length) so that the model doesn't have to re-converge.
+int AudioEffectBTNRH_F32::setAfcFilterLength(int ind, int new_len) {
+  int max_len, slot;
+  switch (ind) {
+    case _afl: max_len = AFC_MAX_AFL; slot = 0; break;
+    case _wfl: max_len = AFC_MAX_WFL; slot = 1; break;
+    case _pfl: max_len = AFC_MAX_PFL; slot = 2; break;
+    default: return -1; //not one of the AFC filter lengths
+  }
+  new_len = max(0, min(max_len, new_len));
+
+  //start from the lengths already requested (or in use) so that other pending requests aren't lost
+  if (!flag_newAfcFilterLengths) {
+    pending_afc_len[0] = get_cha_ivar(_afl);
+    pending_afc_len[1] = get_cha_ivar(_wfl);
+    pending_afc_len[2] = get_cha_ivar(_pfl);
+  }
+  pending_afc_len[slot] = new_len;
+  flag_newAfcFilterLengths = true;  //set this last...the audio thread will pick it up at the next block
+  return new_len;
+}
+
+//getAfcFilterLength: returns the requested length, if one is pending, otherwise returns the length in use
+int AudioEffectBTNRH_F32::getAfcFilterLength(int ind) {
+  if (flag_newAfcFilterLengths) {
+    if (ind == _afl) return pending_afc_len[0];
+    if (ind == _wfl) return pending_afc_len[1];
+    if (ind == _pfl) return pending_afc_len[2];
+  }
+  return get_cha_ivar(ind);
+}
+
+//startProgramChange: take a copy of the new prescription and start preparing it in the spare CHAPRO context.
+//  Returns false if a program change is already underway.
+bool AudioEffectBTNRH_F32::startProgramChange(const CHA_DSL *dsl, const CHA_WDRC *agc, const CHA_AFC *afc) {
+  if (program_change_stage != PC_IDLE) return false;  //only one at a time
+  memcpy(&next_dsl, dsl, sizeof(CHA_DSL));
+  memcpy(&next_agc, agc, sizeof(CHA_WDRC));
+  memcpy(&next_afc, afc, sizeof(CHA_AFC));
+  programChangeStart_millis = millis();
+  program_change_stage = PC_FILTERBANK;  //serviceProgramChange() takes it from here
+  return true;
+}
+
+//reloadPrescription: re-run the configuration from GHA_Constants.h and hot-swap to it
+bool AudioEffectBTNRH_F32::reloadPrescription(void) {
+  CHA_DSL dsl = {0};
+  CHA_WDRC agc = {0};
+  CHA_AFC afc;
+  memcpy(&afc, &local_afc, sizeof(CHA_AFC)); //start from the AFC settings in use...configure_compressor() only sets some of them
+  configure_compressor(&dsl, &agc, &afc);    //in test_gha.h
+  configure_feedback(&afc);                  //in test_gha.h
+  return changePrescription(&dsl, &agc, &afc) != CHANGE_BUSY;
+}
+
+//updateAgcPrescription: prepare the filterbank and the AGC from the new prescription in a scratch context, then
+//  patch its prescription-dependent values into the running context between audio blocks (see patch_context() in test_gha.h)
+int AudioEffectBTNRH_F32::updateAgcPrescription(const CHA_DSL *dsl, const CHA_WDRC *agc) {
+  if (program_change_stage != PC_IDLE) return -2;  //the running context is about to be replaced anyway
+  unsigned long start_micros = micros();
+  CHA_DSL dsl_old, dsl_new;
+  CHA_WDRC agc_old, agc_new;
+  memcpy(&dsl_old, &local_dsl, sizeof(CHA_DSL));
+  memcpy(&agc_old, &local_agc, sizeof(CHA_WDRC));
+  memcpy(&dsl_new, dsl, sizeof(CHA_DSL));
+  memcpy(&agc_new, agc, sizeof(CHA_WDRC));
+  if (!prescription_is_agc_only_change(&dsl_old, &agc_old, &dsl_new, &agc_new)) return -1; //in test_gha.h
+
+  void *cp_new[NPTR] = {0};
+  if (prepare_filterbank(cp_new, &dsl_new, &agc_new) < 0) return -3;  //the design comes from the cache, so this is quick
+  prepare_compressor(cp_new, &dsl_new, &agc_new);
+
+  AudioNoInterrupts();  //so that the audio thread sees all of the change or none of it
+  int n_changed = patch_context(cp, cp_new);  //in test_gha.h
+  if (n_changed >= 0) {
+    memcpy(&local_dsl, &dsl_new, sizeof(CHA_DSL));
+    memcpy(&local_agc, &agc_new, sizeof(CHA_WDRC));
+  }
+  AudioInterrupts();
+
+  cha_cleanup(cp_new);
+  if (n_changed < 0) return -3;
+  Serial.print("AudioEffectBTNRH: updateAgcPrescription: changed "); Serial.print(n_changed);
+  Serial.print(" values in place ("); Serial.print(micros() - start_micros); Serial.println(" usec).");
+  return n_changed;
+}
+
+int AudioEffectBTNRH_F32::changePrescription(const CHA_DSL *dsl, const CHA_WDRC *agc, const CHA_AFC *afc) {
+  if (program_change_stage != PC_IDLE) return CHANGE_BUSY;
+
+  //all of the AFC settings, other than the ones that can be changed while running, must be unchanged
+  bool afc_same = (afc->fbg == local_afc.fbg) && (afc->fbl == local_afc.fbl) && (afc->hdel == local_afc.hdel) &&
+                  (afc->pup == local_afc.pup) && (afc->sqm == local_afc.sqm) && (afc->afl <= AFC_MAX_AFL) &&
+                  (afc->wfl <= AFC_MAX_WFL) && (afc->pfl <= AFC_MAX_PFL);
+  if (afc_same && (updateAgcPrescription(dsl, agc) >= 0)) {
+    set_cha_dvar(_mu, afc->mu);
+    set_cha_dvar(_rho, afc->rho);
+    set_cha_dvar(_eps, afc->eps);
+    set_cha_dvar(_alf, afc->alf);
+    setAfcFilterLength(_afl, afc->afl);
+    setAfcFilterLength(_wfl, afc->wfl);
+    setAfcFilterLength(_pfl, afc->pfl);
+    return CHANGE_IN_PLACE;
+  }
+  return startProgramChange(dsl, agc, afc) ? CHANGE_STARTED : CHANGE_BUSY;
+}
+
+//getActivePrescription: copy out the prescription that is running.  The AFC parameters can be changed while
+//  running (see SerialManager), so the values in use are read back from the CHAPRO context.
+void AudioEffectBTNRH_F32::getActivePrescription(CHA_DSL *dsl, CHA_WDRC *agc, CHA_AFC *afc) {
+  memcpy(dsl, &local_dsl, sizeof(CHA_DSL));
+  memcpy(agc, &local_agc, sizeof(CHA_WDRC));
+  memcpy(afc, &local_afc, sizeof(CHA_AFC));
+  afc->mu = get_cha_dvar(_mu);
+  afc->rho = get_cha_dvar(_rho);
+  afc->eps = get_cha_dvar(_eps);
+  afc->alf = get_cha_dvar(_alf);
+  afc->afl = getAfcFilterLength(_afl);
+  afc->wfl = getAfcFilterLength(_wfl);
+  afc->pfl = getAfcFilterLength(_pfl);
+}
+
+//serviceProgramChange: call from loop().  Each call does one step of preparing the spare context, so that loop()
+//  never stalls for the whole prepare.  Returns the stage that the program change is now in.
+int AudioEffectBTNRH_F32::serviceProgramChange(void) {
+  void **cp_spare = cp_bank[1-active_bank];
+  switch (program_change_stage) {
+    case PC_FILTERBANK:
+      if (cp_spare[_size] != NULL) { cha_cleanup(cp_spare); memset(cp_spare, 0, NPTR*sizeof(void *)); } //should already be empty
+      if (prepare_filterbank(cp_spare, &next_dsl, &next_agc) < 0) { //in test_gha.h
+        //too big to prepare, so keep running the current program
+        Serial.println("AudioEffectBTNRH: serviceProgramChange: the new program can't be prepared.  Keeping the current one.");
+        program_change_stage = PC_IDLE;
+        break;
+      }
+      program_change_stage = PC_COMPRESSOR;
+      break;
+    case PC_COMPRESSOR:
+      prepare_compressor(cp_spare, &next_dsl, &next_agc); //in test_gha.h
+      program_change_stage = PC_FEEDBACK;
+      break;
+    case PC_FEEDBACK:
+      prepare_feedback(cp_spare, &next_afc);  //in test_gha.h
+      save_afc_design(cp_spare, &afc_design_bank[1-active_bank]);
+      program_change_stage = PC_SWAP;         //the audio thread will swap to it at its next block
+      break;
+    case PC_CLEANUP:
+      //the audio thread is done with the old context (which is now the spare), so free its memory
+      cha_cleanup(cp_spare);
+      memset(cp_spare, 0, NPTR*sizeof(void *));
+      cp_fading = NULL;
+      lastProgramChange_millis = millis() - programChangeStart_millis;
+      Serial.print("AudioEffectBTNRH: serviceProgramChange: new program is active ("); Serial.print(lastProgramChange_millis); Serial.println(" msec).");
+      program_change_stage = PC_IDLE;
+      break;
+    default:
+      //nothing to do (either idle or waiting on the audio thread)
+      break;
+  }
+  return program_change_stage;
+}
+
+//swapToNextProgram: called by the audio thread, between blocks, once the spare context has been prepared
+void AudioEffectBTNRH_F32::swapToNextProgram(void) {
+  int next_bank = 1-active_bank;
+  void **cp_next = cp_bank[next_bank];
+  int *next_ivar = (int *)cp_next[_ivar];
+
+  //carry over the AFC model so that the new program doesn't start with its feedback canceller un-converged
+  copy_feedback(cp_next, cp);  //see test_gha.h.  The model always (as much as fits), the signal history only if it fits
+  set_afc_lengths(cp_next, next_afc.afl, next_afc.wfl, next_afc.pfl);   //see test_gha.h
+  if (next_ivar[_mxl] > 0) baselineVal_mxl = next_ivar[_mxl];
+  if (!getAfcEnabled()) next_ivar[_mxl] = 0;  //keep the AFC disabled, if it had been disabled
+
+  //make the new program the active one
+  memcpy(&local_afc, &next_afc, sizeof(CHA_AFC));
+  memcpy(&local_dsl, &next_dsl, sizeof(CHA_DSL));
+  memcpy(&local_agc, &next_agc, sizeof(CHA_WDRC));
+  cp_fading = cp;
+  cp = cp_next;
+  active_bank = next_bank;
+  crossfade_count = 0;
+  program_change_stage = (crossfade_samples > 0) ? PC_CROSSFADE : PC_CLEANUP;
+}
+
+//processWithCrossfade: called by the audio thread.  Process the block with both the old and new programs and
+//  linearly fade from the old to the new.  Once the fade is complete, loop() is told to free the old context.
+void AudioEffectBTNRH_F32::processWithCrossfade(float *x, int cs) {
+  if (cs <= max_block_samples) {
+    memcpy(crossfade_buff, x, cs*sizeof(float));
+    process_context(cp_fading, crossfade_buff, cs); //old program
+    process_context(cp, x, cs);                     //new program
+    for (int i=0; i<cs; i++) {
+      float w = min(1.0f, (float)(crossfade_count + i + 1) / (float)crossfade_samples);
+      x[i] = w*x[i] + (1.0f-w)*crossfade_buff[i];
+    }
+    crossfade_count += cs;
+  } else {
+    process_context(cp, x, cs);  //block is too big for our buffer, so just switch
+    crossfade_count = crossfade_samples;
+  }
+  if (crossfade_count >= crossfade_samples) program_change_stage = PC_CLEANUP; //loop() will free the old context
+}
+
 bool AudioEffectBTNRH_F32::servicePrintingFeedbackModel(unsigned long curTime_millis, unsigned long updatePeriod_millis) {
   static unsigned long lastUpdate_millis = 0;
   bool ret_val = false;
@@ -220,7 +519,7 @@ bool AudioEffectBTNRH_F32::servicePrintingFeedbackModel(unsigned long curTime_mi
       //Serial.println("servicePrintingFeedbackModel: printing feedback model for AFC...");
       float scale_fac = 100.0;  //choose whatever to make the plot prettier
       int n_decimals = 3;
-      Serial.println("Model_" + String((int)(scale_fac + 0.5)) + ":");
+      Serial.print("Model_"); Serial.print((int)(scale_fac + 0.5)); Serial.println(":");
 
       Serial.println(scale_fac,n_decimals);
       Serial.println(-scale_fac,n_decimals);
@@ -237,35 +536,44 @@ bool AudioEffectBTNRH_F32::servicePrintingFeedbackModel(unsigned long curTime_mi
   return ret_val;
 }
 
+//servicePrintingFeedbackModel_toApp: BLE is slow, so the model is sent a piece at a time.  If taskShouldYield()
+//  says that loop() has other work to do, this returns part way through and picks up where it left off on the next
+//  call.  The model is copied when the transmission starts, so that all of the pieces come from the same model.
 bool AudioEffectBTNRH_F32::servicePrintingFeedbackModel_toApp(unsigned long curTime_millis, unsigned long updatePeriod_millis, BLE_UI &ble) {
   static unsigned long lastUpdate_millis = 0;
+  static float model[AFC_MAX_AFL];
+  static int n_model = 0;
   bool ret_val = false;
+  float scale_fac = 1.0;  //choose whatever to make the plot prettier
+  int n_decimals = 3;
+  FixedBuf<32> line;  //one value per message, formatted on the stack (see FixedFormat.h)
   
-  //has enough time passed to update everything?
-  if (curTime_millis < lastUpdate_millis) lastUpdate_millis = 0; //handle wrap-around of the clock
-  if ((curTime_millis - lastUpdate_millis) >= updatePeriod_millis) { //is it time to update the user interface?
-    int n_coeff = get_cha_ivar(_afl);
-    if (n_coeff > 0) {
-      Serial.println("servicePrintingFeedbackModel: printing feedback model for AFC...");
-      float scale_fac = 1.0;  //choose whatever to make the plot prettier
-      int n_decimals = 3;
-      String line_prefix = String("P");
+  //if we're not in the middle of sending, has enough time passed to start again?
+  if (modelToApp_next_ind < 0) {
+    if (curTime_millis < lastUpdate_millis) lastUpdate_millis = 0; //handle wrap-around of the clock
+    if ((curTime_millis - lastUpdate_millis) < updatePeriod_millis) return false;
+    n_model = min(get_cha_ivar(_afl), AFC_MAX_AFL);
+    if (n_model <= 0) { lastUpdate_millis = millis(); return false; }
+    Serial.println("servicePrintingFeedbackModel: printing feedback model for AFC...");
+    memcpy(model, cp[_efbp], n_model*sizeof(float));  //get a snapshot of the model that we're going to send
+
+    //build up the string with all the data
+    line.clear(); line.print('P'); line.print(scale_fac,n_decimals); line.print('\n'); bleSendMessage(&ble, line.c_str());
+    line.clear(); line.print('P'); line.print(-scale_fac,n_decimals); line.print('\n'); bleSendMessage(&ble, line.c_str());
+    modelToApp_next_ind = 0;
+    ret_val = true;
+  }
 
-      //build up the string with all the data
-      ble.sendMessage(line_prefix + String(scale_fac,n_decimals) + String('\n'));
-      ble.sendMessage(line_prefix + String(-scale_fac,n_decimals) + String('\n'));
-      //ble.sendMessage(line_prefix + String(0.0,n_decimals) + String('\n'));      
-      float *efbp = (float *)(cp[_efbp]); //get a simpler name for the array that we're going to print
-      for (int i=0; i<n_coeff; i++) { 
-        ble.sendMessage(line_prefix + String(scale_fac*efbp[i],n_decimals) + String('\n')); //print x decimal places
-      }
-      //Serial1.flush();
-      //Serial.println("servicePrintingFeedbackModel_toApp: finished.");
-      ret_val = true;
-    }
-    //lastUpdate_millis = curTime_millis; //we will use this value the next time around.
-    lastUpdate_millis = millis(); //change the timing so that there are XXXX msec *between* the end of one transmission and the start of the next
+  //send as much as we're allowed to
+  while (modelToApp_next_ind < n_model) { 
+    line.clear(); line.print('P'); line.print(scale_fac*model[modelToApp_next_ind],n_decimals); line.print('\n'); //print x decimal places
+    bleSendMessage(&ble, line.c_str());
+    modelToApp_next_ind++;
+    ret_val = true;
+    if (taskShouldYield()) return ret_val;  //see TaskScheduler.h.  We'll continue from here next time
   }
+  modelToApp_next_ind = -1;  //done
+  lastUpdate_millis = millis(); //change the timing so that there are XXXX msec *between* the end of one transmission and the start of the next
   return ret_val;
 }
 
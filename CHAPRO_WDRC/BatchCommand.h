@@ -0,0 +1,182 @@
+/*
+   BatchCommand
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Set many parameters to absolute values in one message, instead of sending single-character commands
+            over and over (eg, "m" five times to double mu five times).  The message is a binary frame over USB
+            serial, or the same frame as hex text over BLE (see BinaryFrame.h):
+
+               type 'S': payload = any number of 6-byte records, back-to-back:
+                         param (1 byte) | index (1 byte) | value (float, 4 bytes, little-endian)
+
+            where "index" is the band for the per-band prescription fields and is ignored otherwise.  See
+            BATCH_PARAM below for the parameters.
+
+            The whole batch is checked before anything is applied, so a bad record (or a busy algorithm) changes
+            nothing.  The prescription fields are gathered into one prescription change (applied in place, as only
+            the gains and AGC settings change), which is started first, as it is the only step that can be refused.
+            Then the gain and the AFC values are set (with one AFC re-initialization for the whole batch).
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _BatchCommand_h
+#define _BatchCommand_h
+
+#include <Arduino.h>
+#include "AudioEffectBTNRH.h"
+
+extern float setDigitalGain_dB(float);     //in the main *.ino file
+
+#define BATCH_COMMAND_OK          0
+#define BATCH_COMMAND_BAD_LENGTH -1
+#define BATCH_COMMAND_BAD_PARAM  -2
+#define BATCH_COMMAND_BAD_VALUE  -3
+#define BATCH_COMMAND_BUSY       -4
+
+const int batchRecordBytes = 6;
+
+//the allowed values.  The gains go as low as the mute ('z') and no higher than the AGC could ever use.
+#define BATCH_MIN_GAIN_DB  -200.0f   //overall gain and compression-start gains (dB)
+#define BATCH_MAX_GAIN_DB   100.0f
+#define BATCH_MIN_LEVEL_DB    0.0f   //kneepoints and output limits (dB SPL)
+#define BATCH_MAX_LEVEL_DB  120.0f
+
+enum BATCH_PARAM {
+  BATCH_GAIN_DB = 1,     //overall digital gain (dB)
+  BATCH_AFC_ENABLE,      //0 or 1
+  BATCH_AFC_MU,          //0.0 to 1.0
+  BATCH_AFC_RHO,         //0.0 to 1.0
+  BATCH_AFC_EPS,         //0.0 to 1.0
+  BATCH_AFC_ALF,         //0.0 to 1.0
+  BATCH_AFC_AFL,         //filter lengths (applied at the next audio block, as with the "a"/"w"/"l" commands)
+  BATCH_AFC_WFL,
+  BATCH_AFC_PFL,
+  BATCH_BAND_TKGAIN = 16, //per-band prescription fields (index = band)
+  BATCH_BAND_CR,
+  BATCH_BAND_TK,
+  BATCH_BAND_BOLT,
+  BATCH_WDRC_TKGAIN = 24, //broadband output limiter (index ignored)
+  BATCH_WDRC_CR,
+  BATCH_WDRC_TK,
+  BATCH_WDRC_BOLT
+};
+
+typedef struct {
+  uint8_t param;
+  uint8_t index;
+  float value;
+} BatchRecord;
+
+static inline BatchRecord getBatchRecord(const uint8_t *payload, int i) {
+  BatchRecord rec;
+  const uint8_t *p = payload + i * batchRecordBytes;
+  rec.param = p[0];
+  rec.index = p[1];
+  memcpy(&rec.value, p + 2, sizeof(float));  //copy out, as the payload isn't aligned
+  return rec;
+}
+
+static inline int batchInRange(float val, float min_val, float max_val) {
+  return ((val >= min_val) && (val <= max_val)) ? BATCH_COMMAND_OK : BATCH_COMMAND_BAD_VALUE;
+}
+
+//checkBatchRecord: is the record something that we can apply?
+static int checkBatchRecord(const BatchRecord &rec, int nchannel) {
+  if (isnan(rec.value) || isinf(rec.value)) return BATCH_COMMAND_BAD_VALUE;
+  switch (rec.param) {
+    case BATCH_AFC_ENABLE:
+      return BATCH_COMMAND_OK;
+    case BATCH_GAIN_DB: case BATCH_WDRC_TKGAIN:
+      return batchInRange(rec.value, BATCH_MIN_GAIN_DB, BATCH_MAX_GAIN_DB);
+    case BATCH_WDRC_TK: case BATCH_WDRC_BOLT:
+      return batchInRange(rec.value, BATCH_MIN_LEVEL_DB, BATCH_MAX_LEVEL_DB);
+    case BATCH_AFC_AFL: return batchInRange(rec.value, 0.0f, AFC_MAX_AFL);  //as setAfcFilterLength() allows
+    case BATCH_AFC_WFL: return batchInRange(rec.value, 0.0f, AFC_MAX_WFL);
+    case BATCH_AFC_PFL: return batchInRange(rec.value, 0.0f, AFC_MAX_PFL);
+    case BATCH_AFC_MU: case BATCH_AFC_RHO: case BATCH_AFC_EPS: case BATCH_AFC_ALF:
+      return batchInRange(rec.value, 0.0f, 1.0f);  //as the serial commands allow
+    case BATCH_WDRC_CR:
+      return (rec.value > 0.0f) ? BATCH_COMMAND_OK : BATCH_COMMAND_BAD_VALUE;
+    case BATCH_BAND_TKGAIN: case BATCH_BAND_CR: case BATCH_BAND_TK: case BATCH_BAND_BOLT:
+      if (rec.index >= nchannel) return BATCH_COMMAND_BAD_PARAM;
+      if (rec.param == BATCH_BAND_TKGAIN) return batchInRange(rec.value, BATCH_MIN_GAIN_DB, BATCH_MAX_GAIN_DB);
+      if (rec.param == BATCH_BAND_CR) return (rec.value > 0.0f) ? BATCH_COMMAND_OK : BATCH_COMMAND_BAD_VALUE;
+      return batchInRange(rec.value, BATCH_MIN_LEVEL_DB, BATCH_MAX_LEVEL_DB);
+  }
+  return BATCH_COMMAND_BAD_PARAM;
+}
+
+//applyBatchCommand: check and then apply all of the records.  Returns the number of records applied, or a
+//  BATCH_COMMAND error (<0).  If a record is at fault, *bad_record is its index.  *changed_prescription says
+//  whether any prescription field was in the batch.
+int applyBatchCommand(const uint8_t *payload, int n_bytes, AudioEffectBTNRH_F32 &alg, int *bad_record, bool *changed_prescription) {
+  CHA_DSL dsl; CHA_WDRC agc; CHA_AFC afc;
+  int n_records = n_bytes / batchRecordBytes;
+  bool afc_changed = false, prescription_changed = false;
+
+  *bad_record = -1;
+  *changed_prescription = false;
+  if ((n_bytes % batchRecordBytes) != 0) return BATCH_COMMAND_BAD_LENGTH;
+
+  //check everything first, so that a bad batch changes nothing
+  alg.getActivePrescription(&dsl, &agc, &afc);
+  for (int i=0; i < n_records; i++) {
+    BatchRecord rec = getBatchRecord(payload, i);
+    int err = checkBatchRecord(rec, dsl.nchannel);
+    if (err != BATCH_COMMAND_OK) { *bad_record = i; return err; }
+    if (rec.param >= BATCH_BAND_TKGAIN) prescription_changed = true;
+  }
+  if (prescription_changed && alg.isProgramChangeActive()) return BATCH_COMMAND_BUSY;
+
+  //gather the prescription fields, and the AFC values too, so that a new program would start with them
+  for (int i=0; i < n_records; i++) {
+    BatchRecord rec = getBatchRecord(payload, i);
+    int k = rec.index;
+    switch (rec.param) {
+      case BATCH_AFC_MU:      afc.mu = rec.value;  break;
+      case BATCH_AFC_RHO:     afc.rho = rec.value; break;
+      case BATCH_AFC_EPS:     afc.eps = rec.value; break;
+      case BATCH_AFC_ALF:     afc.alf = rec.value; break;
+      case BATCH_AFC_AFL:     afc.afl = (int)(rec.value + 0.5f); break;
+      case BATCH_AFC_WFL:     afc.wfl = (int)(rec.value + 0.5f); break;
+      case BATCH_AFC_PFL:     afc.pfl = (int)(rec.value + 0.5f); break;
+      case BATCH_BAND_TKGAIN: dsl.tkgain[k] = rec.value; break;
+      case BATCH_BAND_CR:     dsl.cr[k] = rec.value;     break;
+      case BATCH_BAND_TK:     dsl.tk[k] = rec.value;     break;
+      case BATCH_BAND_BOLT:   dsl.bolt[k] = rec.value;   break;
+      case BATCH_WDRC_TKGAIN: agc.tkgain = rec.value;    break;
+      case BATCH_WDRC_CR:     agc.cr = rec.value;        break;
+      case BATCH_WDRC_TK:     agc.tk = rec.value;        break;
+      case BATCH_WDRC_BOLT:   agc.bolt = rec.value;      break;
+    }
+  }
+
+  //the prescription fields all go in one change (see changePrescription()).  It goes first, as nothing has been
+  //applied yet if it is refused.
+  if (prescription_changed) {
+    if (alg.changePrescription(&dsl, &agc, &afc) == AudioEffectBTNRH_F32::CHANGE_BUSY) return BATCH_COMMAND_BUSY;
+    *changed_prescription = true;
+  }
+
+  //then the rest, which can't be refused
+  for (int i=0; i < n_records; i++) {
+    BatchRecord rec = getBatchRecord(payload, i);
+    switch (rec.param) {
+      case BATCH_GAIN_DB:    setDigitalGain_dB(rec.value); break;
+      case BATCH_AFC_ENABLE: alg.setAfcEnabled(rec.value != 0.0f); break;
+      case BATCH_AFC_MU:     alg.set_cha_dvar(_mu, rec.value);  afc_changed = true; break;
+      case BATCH_AFC_RHO:    alg.set_cha_dvar(_rho, rec.value); afc_changed = true; break;
+      case BATCH_AFC_EPS:    alg.set_cha_dvar(_eps, rec.value); afc_changed = true; break;
+      case BATCH_AFC_ALF:    alg.set_cha_dvar(_alf, rec.value); afc_changed = true; break;
+      case BATCH_AFC_AFL:    alg.setAfcFilterLength(_afl, (int)(rec.value + 0.5f)); break;
+      case BATCH_AFC_WFL:    alg.setAfcFilterLength(_wfl, (int)(rec.value + 0.5f)); break;
+      case BATCH_AFC_PFL:    alg.setAfcFilterLength(_pfl, (int)(rec.value + 0.5f)); break;
+    }
+  }
+  if (afc_changed) alg.set_cha_ivar(_in1, 0);  //command afc_process to re-initialize its parameters (once for the whole batch)
+  return n_records;
+}
+
+#endif
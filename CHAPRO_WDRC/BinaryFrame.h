@@ -0,0 +1,148 @@
+/*
+   BinaryFrame
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Framing for binary messages that share the USB serial and BLE links with SerialManager's
+            single-character commands.  A frame is:
+
+               0x01 | type (1 byte) | length (2 bytes, LSB first) | payload (length bytes) | CRC-32 (4 bytes, LSB first)
+
+            where the CRC-32 covers the type, length, and payload bytes.  0x01 is never a single-character
+            command, so the parser can sit in front of SerialManager and pass along every byte that is not
+            part of a frame.  A frame that stalls for more than TIMEOUT_MILLIS is dropped.
+
+            The raw form is for USB serial.  The BLE module (BC127) carries text lines, so any byte of a raw
+            frame that is NUL, CR, or LF (eg, the high length byte of any payload under 256 bytes, or a byte
+            of the CRC or of a float) wouldn't survive it.  Over BLE, send the same frame as text instead:
+
+               '<' | the frame after the 0x01, as hex digits (two per byte, high digit first) | '>'
+
+            eg, "<3F0000xxxxxxxx>" for a '?' frame, where xxxxxxxx is its CRC.  Use consumeHex() for that link.
+
+            Use one parser per link so that bytes from the two links are never mixed together.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _BinaryFrame_h
+#define _BinaryFrame_h
+
+#include <stdint.h>
+#include "GhaPreset.h"  //for gha_crc32_update()
+
+class BinaryFrameParser {
+  public:
+    static const uint8_t START_BYTE = 0x01;
+    static const int MAX_PAYLOAD = 2048;
+    static const unsigned long TIMEOUT_MILLIS = 1000;
+    static const char HEX_START = '<', HEX_END = '>';  //neither is a single-character command
+
+    //give the parser one received byte.  Returns true if the byte belonged to a frame (so don't pass it on)
+    bool consume(uint8_t c, unsigned long curTime_millis);
+
+    //the same, for a link that carries the frames as hex text (see above)
+    bool consumeHex(char c, unsigned long curTime_millis);
+
+    bool available(void) { return frame_ready; }  //is a complete, CRC-checked frame waiting?
+    void release(void) { frame_ready = false; }   //call once the waiting frame has been handled
+
+    //the most recent complete frame
+    uint8_t type = 0;
+    uint16_t length = 0;
+    uint8_t payload[MAX_PAYLOAD];
+
+    //statistics
+    unsigned long n_frames = 0, n_bad_crc = 0, n_too_long = 0, n_timeouts = 0, n_bad_hex = 0;
+
+  private:
+    enum STATE {IDLE=0, TYPE, LEN_LO, LEN_HI, PAYLOAD, CRC, DISCARD};
+    int state = IDLE;
+    bool frame_ready = false;
+    uint8_t header[3];           //type and length, kept for the CRC
+    int count = 0;               //payload or CRC bytes received so far (or bytes left to discard)
+    uint32_t rx_crc = 0;
+    unsigned long lastByte_millis = 0;
+    bool in_hex = false;         //between HEX_START and HEX_END
+    int hex_hi = -1;             //the first digit of a byte (or -1 if waiting for one)
+    static int hexValue(char c) {
+      if ((c >= '0') && (c <= '9')) return c - '0';
+      if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+      if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+      return -1;
+    }
+};
+
+inline bool BinaryFrameParser::consume(uint8_t c, unsigned long curTime_millis) {
+  //give up on a frame that has stalled
+  if ((state != IDLE) && ((curTime_millis - lastByte_millis) > TIMEOUT_MILLIS)) { state = IDLE; n_timeouts++; }
+  lastByte_millis = curTime_millis;
+
+  switch (state) {
+    case IDLE:
+      if (c != START_BYTE) return false;  //not ours...pass it on
+      state = TYPE;
+      break;
+    case TYPE:
+      header[0] = type = c;
+      state = LEN_LO;
+      break;
+    case LEN_LO:
+      header[1] = c;
+      state = LEN_HI;
+      break;
+    case LEN_HI:
+      header[2] = c;
+      length = (uint16_t)header[1] | ((uint16_t)header[2] << 8);
+      if (length > MAX_PAYLOAD) { count = length + 4; state = DISCARD; n_too_long++; break; } //swallow the rest of it
+      frame_ready = false;  //any un-handled frame is overwritten by this one
+      count = 0; rx_crc = 0;
+      state = (length > 0) ? PAYLOAD : CRC;
+      break;
+    case PAYLOAD:
+      payload[count++] = c;
+      if (count >= length) { count = 0; rx_crc = 0; state = CRC; }
+      break;
+    case CRC:
+      rx_crc |= ((uint32_t)c) << (8*count);
+      if (++count >= 4) {
+        uint32_t crc = gha_crc32_update(gha_crc32_update(0, header, 3), payload, length);
+        if (crc == rx_crc) { frame_ready = true; n_frames++; } else { n_bad_crc++; }
+        state = IDLE;
+      }
+      break;
+    case DISCARD:
+      if (--count <= 0) state = IDLE;
+      break;
+  }
+  return true;
+}
+
+//consumeHex: decode the text form and hand each byte to consume().  Anything outside of '<' ... '>' is passed on.
+inline bool BinaryFrameParser::consumeHex(char c, unsigned long curTime_millis) {
+  //give up on a frame that has stalled (so that the commands after it aren't swallowed)
+  if (in_hex && ((curTime_millis - lastByte_millis) > TIMEOUT_MILLIS)) { in_hex = false; state = IDLE; n_timeouts++; }
+  if (!in_hex) {
+    if (c != HEX_START) return false;  //not ours...pass it on
+    in_hex = true;
+    hex_hi = -1;
+    state = IDLE;
+    consume(START_BYTE, curTime_millis);
+    return true;
+  }
+  lastByte_millis = curTime_millis;
+  if (c == HEX_END) {
+    in_hex = false;
+    if ((state != IDLE) || (hex_hi >= 0)) { state = IDLE; n_bad_hex++; }  //ended part way through the frame
+    return true;
+  }
+  if ((c == '\r') || (c == '\n') || (c == ' ')) return true;  //the sender may split the text into lines
+  int v = hexValue(c);
+  if (v < 0) { in_hex = false; state = IDLE; n_bad_hex++; return true; }
+  if (hex_hi < 0) { hex_hi = v; return true; }
+  if (state != IDLE) consume((uint8_t)((hex_hi << 4) | v), curTime_millis);  //anything after the CRC is ignored
+  hex_hi = -1;
+  return true;
+}
+
+#endif
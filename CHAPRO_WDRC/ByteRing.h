@@ -0,0 +1,45 @@
+/*
+   ByteRing
+
+   Created: OpenAudio, October 2026
+
+   Purpose: A fixed-size ring buffer of bytes, with no allocation.  The BLE receive task (see the main *.ino file)
+            moves each message from the BLE module into one as soon as it arrives, and then the commands and the
+            binary frames (see BinaryFrame.h) are parsed from the ring a byte at a time, for as long as loop()
+            can spare, rather than all at once.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _ByteRing_h
+#define _ByteRing_h
+
+#include <stdint.h>
+
+template <int N>  //capacity, in bytes (a power of 2)
+class ByteRing {
+  public:
+    static_assert((N > 0) && ((N & (N - 1)) == 0), "ByteRing: N must be a power of 2");
+
+    int available(void) const { return (int)(head - tail); }  //bytes waiting to be read
+    int space(void) const { return N - available(); }         //bytes that can be written
+
+    //write up to n bytes.  Returns the number written (any that don't fit are dropped, and counted)
+    int write(const char *s, int n) {
+      int n_fit = (n < space()) ? n : space();
+      for (int i=0; i < n_fit; i++) buf[(head++) & (N - 1)] = (uint8_t)s[i];
+      n_dropped += (unsigned long)(n - n_fit);
+      return n_fit;
+    }
+
+    //the next byte, or -1 if there isn't one
+    int read(void) { return (head == tail) ? -1 : buf[(tail++) & (N - 1)]; }
+
+    unsigned long n_dropped = 0;
+
+  private:
+    uint8_t buf[N];
+    uint32_t head = 0, tail = 0;  //free-running counts of the bytes written and read
+};
+
+#endif
@@ -20,6 +20,7 @@
 //Include algorithm-specific files
 #include "test_gha.h"          //see the tab "test_gha.h"..........be sure to update the name if you change the filename!
 #include "AudioEffectBTNRH.h"  //see the tab "AudioEffectBTNRH.h"
+#include "ByteRing.h"          //for the BLE receive buffer
  
 // ///////////////////////////////////////// setup the audio processing classes and connections
 
@@ -32,12 +33,24 @@ AudioSettings_F32 audio_settings(sample_rate_Hz, audio_block_samples);
 Tympan myTympan(TympanRev::E, audio_settings);
 EarpieceShield   earpieceShield(TympanRev::E, AICShieldRev::A);  //Note that EarpieceShield is defined in the Tympan_Libarary in AICShield.h
 
+// The SD card, mounted once and shared by the SD writer and the classes below (see SdShared.h)
+SdFs sd;
+
 // Create the audio connections
 #include "AudioConnections.h"
 
 // Create classes for controlling the system
+#include      "PresetManager.h"
+#include      "AfcModelStore.h"
+#include      "FilterbankCacheStore.h"
+#include      "SdReplay.h"
 #include      "SerialManager.h"
 #include      "State.h"                            
+PresetManager presetManager(sd);                                   //saves and recalls prescriptions on the SD card
+AfcModelStore afcModelStore(sd);                                   //saves and restores the AFC model on the SD card (warm start)
+FilterbankCacheStore filterbankCacheStore(sd);                     //saves and loads the filterbank designs on the SD card
+SdReplay      sdReplay(sd);                                        //re-processes recordings from the SD card, faster than real time
+TaskScheduler taskScheduler;                                       //runs the services in loop(), each within a time budget
 BLE_UI        ble(&myTympan);                                      //create bluetooth BLE
 SerialManager serialManager(&ble);                                 //create the serial manager for real-time control (via USB or App)
 State         myState(&audio_settings, &myTympan, &serialManager); //keeping one's state is useful for the App's GUI
@@ -64,24 +77,103 @@ float setOutputGain_dB(float gain_dB) {
   return myState.output_gain_dB = myTympan.volume_dB(gain_dB);
 }
 
+// /////////////////////////  Staged boot
+//
+// setup() only brings up what is needed to hear processed audio: the filterbank cache (one small file, read first
+// so that the algorithm's prepare can skip the filterbank design), the algorithm, and the codecs.  Everything else
+// (USB messages, the AFC warm start, the SD writer, BLE) is done afterwards, one stage per pass through loop(), so
+// that none of it delays the audio.  The time spent in each stage is reported at the end.
+
+enum BOOT_STAGE {BOOT_FB_CACHE=0, BOOT_AUDIO, BOOT_AFC_RESTORE, BOOT_SD, BOOT_BLE_BEGIN, BOOT_BLE_SETUP, BOOT_BLE_SETTLE, BOOT_REPORT, BOOT_DONE};
+const char *boot_stage_names[] = {"filterbank cache", "audio", "AFC restore", "SD", "BLE begin", "BLE setup", "BLE settle", "report"};
+int boot_stage = BOOT_FB_CACHE;
+unsigned long boot_stage_usec[BOOT_DONE] = {0};
+unsigned long bootStageStart_micros = 0;
+int afc_restore_err = 0;
+int fb_cache_loaded = 0;
+
+void finishBootStage(void) {
+  unsigned long now_micros = micros();
+  boot_stage_usec[boot_stage] = now_micros - bootStageStart_micros;
+  bootStageStart_micros = now_micros;
+  boot_stage++;
+}
+
+void printBootTimes(void) {
+  //printed a piece at a time, so that no Strings are built (see FixedFormat.h)
+  Serial.print("Boot: time to first processed audio: "); Serial.print(BTNRH_alg1.firstBlock_micros/1000); Serial.println(" msec since power-up");
+  for (int i=0; i < BOOT_DONE; i++) {
+    Serial.print("Boot:   "); Serial.print(boot_stage_names[i]); Serial.print(": "); Serial.print(boot_stage_usec[i]/1000.0f,1); Serial.println(" msec");
+  }
+}
+
+//serviceBoot: call from loop().  Does one stage of the boot per call.  The BLE module needs time to settle
+//  before and after its setup, so those stages wait (without blocking) instead of calling delay().
+void serviceBoot(void) {
+  switch (boot_stage) {
+    case BOOT_AFC_RESTORE:
+      //warm-start the feedback canceller from the model that was saved last time (if it matches the current settings)
+      afc_restore_err = afcModelStore.restoreModel(BTNRH_alg1);
+      finishBootStage();
+      break;
+    case BOOT_SD:
+      //prepare the SD writer for the format that we want and any error statements
+      audioSDWriter.setSerial(&myTympan);
+      //audioSDWriter.setNumWriteChannels(4);     // Default is 2 channels.  Can record 4 channel, if asked
+      finishBootStage();
+      break;
+    case BOOT_BLE_BEGIN:
+      ble.setUseFasterBaudRateUponBegin(true); //speeds up baudrate to 115200.  ONLY WORKS FOR ANDROID.  If iOS, you must set to false.
+      finishBootStage();
+      break;
+    case BOOT_BLE_SETUP:
+      if ((micros() - bootStageStart_micros) < 500000UL) break;  //give the BLE module time to come up
+      ble.setupBLE(myTympan.getBTFirmwareRev()); //Assumes the default Bluetooth firmware. You can override!
+      serialManager.prepareLayout();             //so the App's layout is ready before the App can ask for it
+      finishBootStage();
+      break;
+    case BOOT_BLE_SETTLE:
+      if ((micros() - bootStageStart_micros) < 500000UL) break;  //give the BLE module time to settle
+      finishBootStage();
+      break;
+    case BOOT_REPORT:
+      //by now, the USB serial has had time to connect (if it is going to), so say hello
+      if (Serial) Serial.print(CrashReport);  //if it crashes and restarts, this will give some info
+      myTympan.println("CHAPRO for Tympan: Test GHA w/Earpieces w/App: setup():...");
+      myTympan.print("  Sample Rate (Hz): "); myTympan.println(audio_settings.sample_rate_Hz);
+      myTympan.print("  Audio Block Size (samples): "); myTympan.println(audio_settings.audio_block_samples);
+      Serial.print("setup: filterbank designs loaded from SD: "); Serial.print(max(0, fb_cache_loaded));
+      Serial.print(" (cache hits so far: "); Serial.print(fb_cache_hits); Serial.println(")");  //see test_gha.h
+      Serial.print("setup: restoring saved AFC model: "); Serial.println(afcModelStore.getErrorString(afc_restore_err));
+      Serial.print("Setup: SD configured for writing "); Serial.print(audioSDWriter.getNumWriteChannels()); Serial.println(" audio channels.");
+      finishBootStage();
+      printBootTimes();
+      Serial.println("Setup complete.");
+      serialManager.printHelp();
+      break;
+  }
+}
+
 // /////////////////////////  Start the Arduino-standard functions: setup() and loop()
 
 void setup() { //this runs once at startup  
+  bootStageStart_micros = micros();
   Serial1.begin(9600); //for talking to the Bluetooth unit (9600 is the right choice for for RevE)
-  while ((!Serial) && (millis() < 1000));  //stall for a bit to let the USB get up and running.
   //myTympan.beginBothSerial(); delay(500);
       
-  if (Serial) Serial.print(CrashReport);  //if it crashes and restarts, this will give some info
-  myTympan.println("CHAPRO for Tympan: Test GHA w/Earpieces w/App: setup():...");
-  myTympan.println("  Sample Rate (Hz): " + String(audio_settings.sample_rate_Hz));
-  myTympan.println("  Audio Block Size (samples): " + String(audio_settings.audio_block_samples));
+  //load the filterbank designs saved on the SD card, so that the prepare below (and later program changes) can
+  //skip the design.  It is one small file, and it is timed as its own boot stage.
+  fb_cache_loaded = filterbankCacheStore.load();
+  finishBootStage();
 
   // Audio connections require memory to work.
   AudioMemory_F32(50, audio_settings);
 
   // /////////////////////////////////////////////  do any setup of the algorithms
 
+  gha_verbose = 0;              //in test_gha.h.  Don't hold up the boot with progress messages
   BTNRH_alg1.setup();           //in AudioEffectBTNRH.h
+  gha_verbose = 1;
   BTNRH_alg1.setEnabled(true);  //see AudioEffectBTNRH.h.  This could be done later in setup()
  
   // //////////////////////////////////////////// End setup of the algorithms
@@ -121,50 +213,136 @@ void setup() { //this runs once at startup
   myTympan.setInputGain_dB(myState.earpieceMixer->inputGain_dB); // set MICPGA volume, 0-47.5dB in 0.5dB setps
   
   //set the default gain
-  Serial.println("setup(): setting overall gain to " + String(myState.digital_gain_dB));
+  Serial.print("setup(): setting overall gain to "); Serial.println(myState.digital_gain_dB);
   setDigitalGain_dB(myState.digital_gain_dB);
 
-  //prepare the SD writer for the format that we want and any error statements
-  audioSDWriter.setSerial(&myTympan);
-  //audioSDWriter.setNumWriteChannels(4);     // Default is 2 channels.  Can record 4 channel, if asked
-  Serial.println("Setup: SD configured for writing " + String(audioSDWriter.getNumWriteChannels()) + " audio channels.");
-  
-  //setup BLE
-  ble.setUseFasterBaudRateUponBegin(true); //speeds up baudrate to 115200.  ONLY WORKS FOR ANDROID.  If iOS, you must set to false.
-  delay(500); ble.setupBLE(myTympan.getBTFirmwareRev()); delay(500); //Assumes the default Bluetooth firmware. You can override!
-
-  //finish setup
-  Serial.println("Setup complete.");
-  serialManager.printHelp();
+  //the audio is now running.  The rest of the boot (BLE, SD, etc) is done from loop()...see serviceBoot()
+  setupTasks();
+  finishBootStage();
 }
 
-void loop() {  //this runs forever in a loop
+// /////////////////////////  The services that loop() runs, as tasks for the scheduler (see TaskScheduler.h)
+//
+// Each task returns true if it has more work to do right away.  Long jobs check taskShouldYield() and return
+// part way through, so that they don't hold up the others.
 
+bool task_boot(void) {
+  //finish booting, one stage at a time
+  if (boot_stage != BOOT_DONE) serviceBoot();
+  return false;
+}
+bool task_usbSerial(void) {
   //respond to Serial commands
-  while (Serial.available()) serialManager.respondToByte((char)Serial.read());   //USB...respondToByte is in SerialManagerBase...it then calls SerialManager.processCharacter(c)
-
-  //respond to BLE
-  if (ble.available() > 0) {
-    String msgFromBle; int msgLen = ble.recvBLE(&msgFromBle);
-    for (int i=0; i < msgLen; i++) serialManager.respondToByte(msgFromBle[i]);  //respondToByte is in SerialManagerBase...it then calls SerialManager.processCharacter(c)
+  while (Serial.available()) {
+    serialManager.receiveByte((char)Serial.read());   //USB...receiveByte() catches binary frames, else calls SerialManager.processCharacter(c)
+    if (taskShouldYield()) return true;
   }
-
+  return false;
+}
+ByteRing<1024> bleRxRing;  //BLE bytes waiting to be parsed
+const int BLE_MAX_MSG_BYTES = 256;  //longer than the BLE module's messages
+bool task_bleReceive(void) {
+  //respond to BLE (once it has been set up)
+  if (boot_stage <= BOOT_BLE_SETTLE) return false;
+  //move the next message into the ring, if there's room.  The library only hands messages over as a String, so the
+  //same one is used each time (its memory is reserved once) and it is emptied into the ring straight away.
+  static String msgFromBle;
+  static bool is_reserved = false;
+  if (!is_reserved) { msgFromBle.reserve(BLE_MAX_MSG_BYTES); is_reserved = true; }
+  if ((ble.available() > 0) && (bleRxRing.space() >= BLE_MAX_MSG_BYTES)) {
+    int msgLen = ble.recvBLE(&msgFromBle);
+    bleRxRing.write(msgFromBle.c_str(), msgLen);
+  }
+  //then parse from the ring, until the other tasks need a turn.  Frames arrive as hex text (see BinaryFrame.h)
+  int c;
+  while ((c = bleRxRing.read()) >= 0) {
+    serialManager.receiveByte((char)c, true);  //receiveByte() catches binary frames, else calls SerialManager.processCharacter(c)
+    if (taskShouldYield()) return true;
+  }
+  return false;
+}
+bool task_bleAdvertising(void) {
   //service the BLE advertising state
-  ble.updateAdvertising(millis(),5000); //check every 5000 msec to ensure it is advertising (if not connected)
-
+  if (boot_stage > BOOT_BLE_SETTLE) ble.updateAdvertising(millis(),5000); //check every 5000 msec to ensure it is advertising (if not connected)
+  return false;
+}
+bool task_layout(void) {
+  //send the App's layout, a piece at a time, after the App asks for it (see RemoteLayout.h)
+  return serialManager.serviceLayout();
+}
+bool task_guiSync(void) {
+  //send the App whichever buttons have changed since the last time (see GuiStateCache.h)
+  if (boot_stage <= BOOT_BLE_SETTLE) return false;
+  return serialManager.serviceGUI();
+}
+bool task_programChange(void) {
+  //service any change of prescription (prepares the new one a step at a time, the audio thread does the swap)
+  BTNRH_alg1.serviceProgramChange();
+  return false;
+}
+bool task_sdSave(void) {
+  //periodically save the AFC model so that it can be restored at the next power-up (but not while recording or replaying)
+  bool allowed = (audioSDWriter.getState() != AudioSDWriter::STATE::RECORDING) && !sdReplay.isBusy();
+  afcModelStore.serviceAutoSave(millis(), 60000, BTNRH_alg1, allowed);
+
+  //save any new filterbank design, so that the next boot doesn't have to make it (but not while recording)
+  filterbankCacheStore.serviceSave(allowed);
+  return false;
+}
+bool task_sdRecord(void) {
   //service the SD recording
   audioSDWriter.serviceSD_withWarnings(audio_in); //needs some info from i2s_in to provide some of the warnings
-
+  return false;
+}
+bool task_sdReplay(void) {
+  //re-process a recording from the SD card with the CPU that the audio leaves over (see SdReplay.h)
+  if (!sdReplay.isBusy()) return false;
+  bool more_work = sdReplay.serviceReplay();
+  if (!sdReplay.isBusy()) sdReplay.printResult(&Serial);  //it just finished
+  return more_work;
+}
+bool task_leds(void) {
   //service the LEDs...blink slow normally, blink fast if recording
   myTympan.serviceLEDs(millis(),audioSDWriter.getState() == AudioSDWriter::STATE::RECORDING); 
-
+  return false;
+}
+bool task_cpuReport(void) {
   //periodically print the CPU and Memory Usage
   if (myState.flag_printCPUandMemory) myState.printCPUandMemory(millis(), 3000); //print every 3000msec  (method is built into TympanStateBase.h, which myState inherits from)
   if (myState.flag_printCPUandMemory) myState.printCPUtoApp(millis(), 3000);     //send to App every 3000msec (method is built into TympanStateBase.h, which myState inherits from)
-
+  return false;
+}
+bool task_modelPrint(void) {
   //periodically print the AFC model coefficients
   if (myState.flag_printLeftFeedbackModel) BTNRH_alg1.servicePrintingFeedbackModel(millis(), 1000);
-  if (myState.flag_printLeftFeedbackModel_toApp) {
-   BTNRH_alg1.servicePrintingFeedbackModel_toApp(millis(), 1000, ble); //BLE transfer is slow, this this ends up spacing transmissions as starting a new one after 1000msec has passed since end of previous one
+  return false;
+}
+bool task_modelToApp(void) {
+  //BLE transfer is slow, this this ends up spacing transmissions as starting a new one after 1000msec has passed since end of previous one
+  if (myState.flag_printLeftFeedbackModel_toApp || BTNRH_alg1.isPrintingFeedbackModel_toApp()) {
+    BTNRH_alg1.servicePrintingFeedbackModel_toApp(millis(), 1000, ble); //sends a piece at a time
   }
+  return BTNRH_alg1.isPrintingFeedbackModel_toApp();
+}
+
+void setupTasks(void) {
+  //                    name            function             period (msec)  budget (usec)  urgent?
+  taskScheduler.addTask("boot",          task_boot,           0,    2000);
+  taskScheduler.addTask("USB serial",    task_usbSerial,      0,    1000);
+  taskScheduler.addTask("BLE receive",   task_bleReceive,     0,    2000);
+  taskScheduler.addTask("BLE advertise", task_bleAdvertising, 100,  2000);
+  taskScheduler.addTask("App layout",    task_layout,         20,   2000);
+  taskScheduler.addTask("GUI sync",      task_guiSync,        50,   2000);
+  taskScheduler.addTask("program change",task_programChange,  0,   20000);
+  taskScheduler.addTask("SD save",       task_sdSave,         500, 50000);
+  taskScheduler.addTask("SD record",     task_sdRecord,       0,    5000,  true);  //urgent, to avoid write overruns
+  taskScheduler.addTask("SD replay",     task_sdReplay,       0,   20000);
+  taskScheduler.addTask("LEDs",          task_leds,           20,    100);
+  taskScheduler.addTask("CPU report",    task_cpuReport,      100,  5000);
+  taskScheduler.addTask("model print",   task_modelPrint,     100,  5000);
+  taskScheduler.addTask("model to App",  task_modelToApp,     20,   2000);
+}
+
+void loop() {  //this runs forever in a loop
+  taskScheduler.run();  //runs each of the tasks above, when it is due
 }
@@ -0,0 +1,117 @@
+/*
+   FilterbankCacheStore
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Save the filterbank design cache (see fb_cache in test_gha.h) to the SD card and load it back at the
+            start of setup() (see the main *.ino file), before the algorithm is prepared, so that the boot and
+            later program changes (presets, uploads, replays) with a familiar fitting skip the filterbank design.
+            The load is merged into the cache, so any designs already in RAM are kept.  (To skip the design even
+            on the first boot, compile it in with GHA_FilterbankTable.h, see test_gha.h.)  The file is a small
+            header plus the cache entries, covered by a CRC.  Any file that doesn't match this build (different
+            cache layout, bad CRC) is ignored, and the designs are simply made again.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _FilterbankCacheStore_h
+#define _FilterbankCacheStore_h
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include "SdShared.h"
+#include "test_gha.h"    //for fb_cache
+#include "GhaPreset.h"   //for gha_crc32_update()
+
+#define FB_CACHE_FILE_MAGIC    0x43424646UL  // "FFBC", little-endian
+#define FB_CACHE_FILE_VERSION  1
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_bytes;  // sizeof(FB_DESIGN), as a check that the layout matches this build
+    int32_t n_entries;
+    uint32_t crc;          // CRC-32 of the header bytes before this field and of all of the entries
+} FbCacheFileHeader;
+
+class FilterbankCacheStore {
+  public:
+    FilterbankCacheStore(SdFs &_sd, const char *_fname = "FBCACHE.BIN") : sd(_sd), fname(_fname) {};
+
+    int load(void);  //merge the saved designs into the cache.  Returns the number of designs added (or <0 on error)
+    int save(void);  //write the whole cache.  Returns the number of designs saved (or <0 on error)
+    bool serviceSave(bool allowed = true);  //call from loop().  Saves whenever a new design has been added.
+
+  protected:
+    SdFs &sd;  //the volume shared with the SD writer (see SdShared.h)
+    const char *fname;
+    bool beginSD(void) { return beginSharedSD(sd); }
+    FB_DESIGN loaded[FB_CACHE_SIZE];  //kept here, rather than on the stack, because it is a few kB
+    static uint32_t computeCRC(const FbCacheFileHeader &hdr, int n) {
+      return gha_crc32_update(gha_crc32_update(0, &hdr, offsetof(FbCacheFileHeader, crc)), fb_cache, n * sizeof(FB_DESIGN));
+    }
+};
+
+//load: read the whole file and check it, then add each design that isn't already in the cache (while there's room)
+int FilterbankCacheStore::load(void) {
+  FbCacheFileHeader hdr;
+  if (!beginSD()) return -1;
+  FsFile file = sd.open(fname, O_RDONLY);
+  if (!file) return -1;
+  bool ok = (file.read(&hdr, sizeof(hdr)) == (int)sizeof(hdr));
+  ok = ok && (hdr.magic == FB_CACHE_FILE_MAGIC) && (hdr.version == FB_CACHE_FILE_VERSION) && (hdr.entry_bytes == sizeof(FB_DESIGN));
+  ok = ok && (hdr.n_entries >= 0) && (hdr.n_entries <= FB_CACHE_SIZE);
+  ok = ok && (file.read(loaded, hdr.n_entries * sizeof(FB_DESIGN)) == (int)(hdr.n_entries * sizeof(FB_DESIGN)));
+  file.close();
+  if (!ok) return -1;
+  uint32_t crc = gha_crc32_update(gha_crc32_update(0, &hdr, offsetof(FbCacheFileHeader, crc)), loaded, hdr.n_entries * sizeof(FB_DESIGN));
+  if (crc != hdr.crc) return -1;
+
+  //keep the designs that aren't already in the cache, as many as there is room for next to those in RAM
+  int n_ram = fb_cache_n, n_known = 0, n_added = 0;
+  for (int i=0; i < hdr.n_entries; i++) {
+    FB_DESIGN *e = &loaded[i];
+    if ((e->nc < 1) || (e->nc > FB_CACHE_MXCH) || (e->nz < 1) || (2 * e->nz * e->nc > FB_CACHE_MXZP)) continue;
+    bool known = false;
+    for (int j=0; j < n_ram; j++) known = known || fb_cache_key_matches(&fb_cache[j], e->cf, e->nc, e->nz, e->sr, e->td);
+    if (known) { n_known++; continue; }
+    if (n_ram + n_added < FB_CACHE_SIZE) loaded[n_added++] = *e;
+  }
+
+  //the saved designs are older than those made since boot, so they go first (the cache replaces the oldest first)
+  memmove(&fb_cache[n_added], &fb_cache[0], n_ram * sizeof(FB_DESIGN));
+  memcpy(&fb_cache[0], loaded, n_added * sizeof(FB_DESIGN));
+  fb_cache_n = n_ram + n_added;
+  if (n_added > 0) fb_cache_next = fb_cache_n % FB_CACHE_SIZE;
+  if (n_known >= n_ram) fb_cache_dirty = 0;  //everything in RAM was already on the card
+  return n_added;
+}
+
+int FilterbankCacheStore::save(void) {
+  FbCacheFileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = FB_CACHE_FILE_MAGIC;
+  hdr.version = FB_CACHE_FILE_VERSION;
+  hdr.entry_bytes = sizeof(FB_DESIGN);
+  hdr.n_entries = fb_cache_n;
+  hdr.crc = computeCRC(hdr, fb_cache_n);
+
+  if (!beginSD()) return -1;
+  FsFile file = sd.open(fname, O_RDWR | O_CREAT | O_TRUNC);
+  if (!file) return -1;
+  bool ok = (file.write(&hdr, sizeof(hdr)) == sizeof(hdr));
+  ok = ok && (file.write(fb_cache, fb_cache_n * sizeof(FB_DESIGN)) == fb_cache_n * sizeof(FB_DESIGN));
+  file.close();
+  if (!ok) return -1;
+  fb_cache_dirty = 0;
+  return fb_cache_n;
+}
+
+bool FilterbankCacheStore::serviceSave(bool allowed) {
+  if (!fb_cache_dirty || !allowed) return false;
+  if (save() < 0) fb_cache_dirty = 0;  //don't keep retrying a card that isn't there
+  return true;
+}
+
+#endif
@@ -0,0 +1,68 @@
+/*
+   FixedFormat
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Text formatting for the Serial and BLE output paths without using the heap.  Building messages
+            out of String temporaries ("AFC: mu = " + String(mu,8)) allocates and frees memory for every
+            piece, every time, which fragments the heap on a device that runs for days.  Instead:
+
+              * For Serial, print the pieces one after the other (Serial.print("AFC: mu = "); Serial.println(mu,8);)
+              * For BLE, which needs the whole message at once, print the pieces into a FixedBuf (a Print that
+                writes into a char array on the stack) and send it with bleSendMessage().
+
+            BLE::sendMessage() only takes a String, so bleSendMessage() copies the text into one String whose
+            memory is reserved the first time.  After that first message, nothing here touches the heap, as long
+            as the messages fit in what was reserved (see bleReserveMessage() for longer ones).
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _FixedFormat_h
+#define _FixedFormat_h
+
+#include <Arduino.h>
+#include <Tympan_Library.h>  //for BLE
+
+#define FIXED_FORMAT_MSG_LEN 128  //memory reserved for bleSendMessage().  A longer message is still sent whole, but the String grows (once) to fit it.
+
+//FixedBuf: a Print that writes into a fixed char array.  Text past the end of the array is dropped.
+template <int N>
+class FixedBuf : public Print {
+  public:
+    FixedBuf(void) { clear(); }
+    FixedBuf(const char *s) { clear(); print(s); }
+
+    size_t write(uint8_t c) {
+      if (len >= N-1) return 0;  //full (keep room for the terminating null)
+      buf[len++] = (char)c; buf[len] = '\0';
+      return 1;
+    }
+    using Print::write;
+
+    const char *c_str(void) const { return buf; }
+    int length(void) const { return len; }
+    void clear(void) { len = 0; buf[0] = '\0'; }
+
+  private:
+    char buf[N];
+    int len;
+};
+
+//bleReserveMessage: make room for messages of up to n characters (eg, the App's layout), ahead of time.  The
+//String keeps its memory, so call it once, at boot, rather than letting the first long message grow it.
+String fixedFormatMessage;
+void bleReserveMessage(int n) {
+  if (n < FIXED_FORMAT_MSG_LEN) n = FIXED_FORMAT_MSG_LEN;
+  fixedFormatMessage.reserve(n);  //does nothing if there is already room
+}
+
+//bleSendMessage: send a message over BLE, re-using the same String each time
+void bleSendMessage(BLE *ble, const char *msg) {
+  static bool is_reserved = false;
+  if (!is_reserved) { bleReserveMessage(FIXED_FORMAT_MSG_LEN); is_reserved = true; }
+  fixedFormatMessage = msg;  //copies into the reserved memory, so no allocation (if it fits)
+  ble->sendMessage(fixedFormatMessage);
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+   GhaChain
+
+   Created: OpenAudio, October 2026
+
+   Purpose: The chain of process_chunk() (see test_gha.h) with the chunk size and the AFC on/off fixed at compile
+            time, for production builds.
+
+               typedef GhaChain<8, AfcOn> MyChain;   //8-sample chunks, with AFC
+               if (MyChain::matches(cp)) MyChain::process_block(cp, x, x, n);
+
+            Only what this wrapper controls is fixed: the chunk loop has a constant trip count, every CHAPRO call
+            gets a constant chunk size, and with AfcOff the AFC calls are compiled out entirely (rather than run
+            with mxl = 0).  The number of channels and the filter order are not template parameters: the CHAPRO
+            kernels (libchapro) read them, and the filter lengths, from the context on every call, so they can't
+            be unrolled or statically sized from here without a copy of those kernels.  So, expect the gain to be
+            small (the AfcOff case, and a few calls' worth of overhead), and measure it with gha_bench.  matches()
+            checks (once per block) that the prepared context has the chunk size that the chain was compiled for.
+            Research builds keep using the runtime-generic process_chunk().
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _GhaChain_h
+#define _GhaChain_h
+
+#include <chapro.h>
+
+//AFC policies
+struct AfcOn  { static const bool enabled = true;  };
+struct AfcOff { static const bool enabled = false; };
+
+template <int CS, class AFC_POLICY>
+class GhaChain {
+  public:
+    static_assert(CS >= 1, "GhaChain: bad chunk size");
+
+    static const int chunk_size = CS;
+    static const bool afc_enabled = AFC_POLICY::enabled;
+
+    //was this CHAPRO context prepared for the chunk size that the chain was compiled for?
+    static bool matches(CHA_PTR cp) {
+      if ((cp == NULL) || (cp[_ivar] == NULL)) return false;
+      if (CHA_IVAR[_cs] != CS) return false;
+      if (AFC_POLICY::enabled && (cp[_efbp] == NULL)) return false;  //AFC was never prepared
+      return true;
+    }
+
+    //process exactly one chunk of CS samples.  Same chain as process_chunk() in test_gha.h.
+    static inline void process(CHA_PTR cp, float *x, float *y) {
+      float *z = CHA_CB;
+      if (AFC_POLICY::enabled) cha_afc_input(cp, x, x, CS);
+      cha_agc_input(cp, x, x, CS);
+      cha_iirfb_analyze(cp, x, z, CS);
+      cha_agc_channel(cp, z, z, CS);
+      cha_iirfb_synthesize(cp, z, y, CS);
+      cha_agc_output(cp, y, y, CS);
+      if (AFC_POLICY::enabled) cha_afc_output(cp, y, CS);
+    }
+
+    //process a block of n samples, which must be a multiple of CS
+    static inline void process_block(CHA_PTR cp, float *x, float *y, int n) {
+      for (int i = 0; i + CS <= n; i += CS) process(cp, x + i, y + i);
+    }
+
+    //process a block whose size is also known at compile time, so that the chunk loop can be unrolled
+    template <int N>
+    static inline void process_block(CHA_PTR cp, float *x, float *y) {
+      static_assert((N % CS) == 0, "GhaChain: block size must be a multiple of the chunk size");
+      for (int i = 0; i < N; i += CS) process(cp, x + i, y + i);
+    }
+};
+
+#endif
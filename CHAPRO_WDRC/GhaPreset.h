@@ -0,0 +1,237 @@
+/*
+   GhaPreset
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Versioned, checksummed binary format for storing GHA prescriptions (CHA_DSL, CHA_WDRC, and
+            CHA_AFC, plus nz and td) as named presets.  Many presets live in one file: a small header
+            followed by fixed-size records, so any preset can be read with a single seek and read.
+
+            The fields are stored one-by-one in fixed-width types (rather than dumping the CHAPRO structs)
+            so that the file does not depend on the layout of the CHAPRO structs or on the compiler.  Apart from
+            test_gha.h (for the sizes that prepare() can hold), this file has no Arduino dependencies, so that
+            host-side tools can read and write the same files.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _GhaPreset_h
+#define _GhaPreset_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <chapro.h>
+#include "test_gha.h"   //for prescription_check_sizes()
+
+#define GHA_PRESET_MAGIC     0x53504843UL  // "CHPS", little-endian
+#define GHA_PRESET_VERSION   1             // increment whenever GhaPresetRecord changes
+#define GHA_PRESET_NAME_LEN  16            // including the null terminator
+#define GHA_PRESET_MXCH      32            // max channels stored per preset
+
+// error codes returned by the functions below
+#define GHA_PRESET_OK          0
+#define GHA_PRESET_BAD_MAGIC  -1
+#define GHA_PRESET_BAD_VERSION -2
+#define GHA_PRESET_BAD_CRC    -3
+#define GHA_PRESET_BAD_VALUE  -4
+#define GHA_PRESET_BAD_INDEX  -5
+#define GHA_PRESET_IO_ERROR   -6
+#define GHA_PRESET_BUSY       -7  // (device) a program change is already underway
+
+typedef struct
+{
+    uint32_t magic;         // GHA_PRESET_MAGIC
+    uint16_t version;       // GHA_PRESET_VERSION
+    uint16_t record_bytes;  // sizeof(GhaPresetRecord), as a second check on the version
+    uint16_t n_presets;     // number of records that follow the header
+    uint16_t reserved;
+    uint32_t crc;           // CRC-32 of the header bytes before this field
+} GhaPresetFileHeader;
+
+typedef struct
+{
+    // CHA_DSL (per-band prescription)
+    double attack, release, maxdB;
+    double cross_freq[GHA_PRESET_MXCH];
+    double tkgain[GHA_PRESET_MXCH];
+    double cr[GHA_PRESET_MXCH];
+    double tk[GHA_PRESET_MXCH];
+    double bolt[GHA_PRESET_MXCH];
+    // CHA_WDRC (broadband limiter)
+    double agc_attack, agc_release, agc_fs, agc_maxdB;
+    double agc_tkgain, agc_tk, agc_cr, agc_bolt;
+    double td;              // filterbank delay (ms)
+    // CHA_AFC
+    double fbg, rho, eps, mu, alf;
+    int32_t ear, nchannel;
+    int32_t nz;             // filterbank order
+    int32_t afl, wfl, pfl, fbl, hdel, pup;
+    char name[GHA_PRESET_NAME_LEN];
+    uint32_t crc;           // CRC-32 of the record bytes before this field.  Must be last.
+} GhaPresetRecord;
+
+static_assert(sizeof(GhaPresetFileHeader) == 16, "GhaPresetFileHeader must not be padded");
+static_assert(offsetof(GhaPresetRecord, crc) + sizeof(uint32_t) == sizeof(GhaPresetRecord), "GhaPresetRecord must not be padded");
+
+/***********************************************************/
+
+// standard CRC-32 (as used by zip and png), computed bitwise to avoid a 1 kB table.  Start with crc = 0.
+// Like zlib's crc32(), the result can be passed back in to continue the CRC over more bytes.
+static uint32_t
+gha_crc32_update(uint32_t crc, const void *buf, size_t n)
+{
+    const uint8_t *b = (const uint8_t *)buf;
+    size_t i;
+    int k;
+
+    crc = ~crc;
+    for (i = 0; i < n; i++) {
+        crc ^= b[i];
+        for (k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static uint32_t
+gha_preset_crc32(const void *buf, size_t n)
+{
+    return gha_crc32_update(0, buf, n);
+}
+
+static size_t
+gha_preset_record_offset(int index)
+{
+    return sizeof(GhaPresetFileHeader) + (size_t)index * sizeof(GhaPresetRecord);
+}
+
+static void
+gha_preset_header_init(GhaPresetFileHeader *hdr, int n_presets)
+{
+    memset(hdr, 0, sizeof(GhaPresetFileHeader));
+    hdr->magic = GHA_PRESET_MAGIC;
+    hdr->version = GHA_PRESET_VERSION;
+    hdr->record_bytes = sizeof(GhaPresetRecord);
+    hdr->n_presets = (uint16_t)n_presets;
+    hdr->crc = gha_preset_crc32(hdr, offsetof(GhaPresetFileHeader, crc));
+}
+
+static int
+gha_preset_header_check(const GhaPresetFileHeader *hdr)
+{
+    if (hdr->magic != GHA_PRESET_MAGIC) return GHA_PRESET_BAD_MAGIC;
+    if ((hdr->version != GHA_PRESET_VERSION) || (hdr->record_bytes != sizeof(GhaPresetRecord))) return GHA_PRESET_BAD_VERSION;
+    if (hdr->crc != gha_preset_crc32(hdr, offsetof(GhaPresetFileHeader, crc))) return GHA_PRESET_BAD_CRC;
+    return GHA_PRESET_OK;
+}
+
+// fill a record from the CHAPRO structures and seal it with its CRC
+
+static int
+gha_preset_pack(GhaPresetRecord *rec, const char *name, const CHA_DSL *dsl, const CHA_WDRC *agc, const CHA_AFC *afc)
+{
+    int k, nc = dsl->nchannel;
+
+    if ((nc < 1) || (nc > GHA_PRESET_MXCH)) return GHA_PRESET_BAD_VALUE;
+    memset(rec, 0, sizeof(GhaPresetRecord));
+    strncpy(rec->name, name, GHA_PRESET_NAME_LEN - 1);
+    rec->attack = dsl->attack;
+    rec->release = dsl->release;
+    rec->maxdB = dsl->maxdB;
+    rec->ear = dsl->ear;
+    rec->nchannel = nc;
+    for (k = 0; k < nc; k++) {
+        rec->cross_freq[k] = dsl->cross_freq[k];
+        rec->tkgain[k] = dsl->tkgain[k];
+        rec->cr[k] = dsl->cr[k];
+        rec->tk[k] = dsl->tk[k];
+        rec->bolt[k] = dsl->bolt[k];
+    }
+    rec->agc_attack = agc->attack;
+    rec->agc_release = agc->release;
+    rec->agc_fs = agc->fs;
+    rec->agc_maxdB = agc->maxdB;
+    rec->agc_tkgain = agc->tkgain;
+    rec->agc_tk = agc->tk;
+    rec->agc_cr = agc->cr;
+    rec->agc_bolt = agc->bolt;
+    rec->nz = agc->nz;
+    rec->td = agc->td;
+    rec->fbg = afc->fbg;
+    rec->rho = afc->rho;
+    rec->eps = afc->eps;
+    rec->mu = afc->mu;
+    rec->alf = afc->alf;
+    rec->afl = afc->afl;
+    rec->wfl = afc->wfl;
+    rec->pfl = afc->pfl;
+    rec->fbl = afc->fbl;
+    rec->hdel = afc->hdel;
+    rec->pup = afc->pup;
+    rec->crc = gha_preset_crc32(rec, offsetof(GhaPresetRecord, crc));
+    return GHA_PRESET_OK;
+}
+
+// check a record's CRC and values and, if good, copy it into the CHAPRO structures.  The AFC fields
+// that are not stored in the preset (eg, the quality-metric settings) are left as they were in *afc.
+// A file on the SD card can be corrupt or hand-edited, so the sizes are held to what prepare() can hold
+// (see prescription_check_sizes() in test_gha.h), and nothing is changed if they don't fit.
+
+static int
+gha_preset_unpack(const GhaPresetRecord *rec, CHA_DSL *dsl, CHA_WDRC *agc, CHA_AFC *afc)
+{
+    CHA_DSL dsl_size;
+    CHA_WDRC agc_size;
+    CHA_AFC afc_size;
+    int k, nc = rec->nchannel;
+
+    if (rec->crc != gha_preset_crc32(rec, offsetof(GhaPresetRecord, crc))) return GHA_PRESET_BAD_CRC;
+    if ((nc < 1) || (nc > GHA_PRESET_MXCH) || (nc > DSL_MXCH) || !(rec->td > 0.0)) return GHA_PRESET_BAD_VALUE;
+    dsl_size.nchannel = nc;
+    agc_size.nz = rec->nz;
+    afc_size.afl = rec->afl;
+    afc_size.wfl = rec->wfl;
+    afc_size.pfl = rec->pfl;
+    afc_size.fbl = rec->fbl;
+    afc_size.hdel = rec->hdel;
+    if (prescription_check_sizes(&dsl_size, &agc_size, &afc_size) != NULL) return GHA_PRESET_BAD_VALUE;
+
+    memset(dsl, 0, sizeof(CHA_DSL));
+    dsl->attack = rec->attack;
+    dsl->release = rec->release;
+    dsl->maxdB = rec->maxdB;
+    dsl->ear = rec->ear;
+    dsl->nchannel = nc;
+    for (k = 0; k < nc; k++) {
+        dsl->cross_freq[k] = rec->cross_freq[k];
+        dsl->tkgain[k] = rec->tkgain[k];
+        dsl->cr[k] = rec->cr[k];
+        dsl->tk[k] = rec->tk[k];
+        dsl->bolt[k] = rec->bolt[k];
+    }
+    memset(agc, 0, sizeof(CHA_WDRC));
+    agc->attack = rec->agc_attack;
+    agc->release = rec->agc_release;
+    agc->fs = rec->agc_fs;
+    agc->maxdB = rec->agc_maxdB;
+    agc->tkgain = rec->agc_tkgain;
+    agc->tk = rec->agc_tk;
+    agc->cr = rec->agc_cr;
+    agc->bolt = rec->agc_bolt;
+    agc->nz = rec->nz;
+    agc->td = rec->td;
+    afc->fbg = rec->fbg;
+    afc->rho = rec->rho;
+    afc->eps = rec->eps;
+    afc->mu = rec->mu;
+    afc->alf = rec->alf;
+    afc->afl = rec->afl;
+    afc->wfl = rec->wfl;
+    afc->pfl = rec->pfl;
+    afc->fbl = rec->fbl;
+    afc->hdel = rec->hdel;
+    afc->pup = rec->pup;
+    return GHA_PRESET_OK;
+}
+
+#endif
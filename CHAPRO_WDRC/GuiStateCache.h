@@ -0,0 +1,113 @@
+/*
+   GuiStateCache
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Keep track of what the TympanRemote App's buttons are showing, so that only the buttons whose text
+            or state actually changed are sent over BLE.  The updateGUI_* methods only record the new values.
+            service(), called periodically from loop(), sends each changed button once, with its latest value,
+            so that a burst of changes (eg, pressing "+" ten times) costs one message per button instead of ten.
+
+            When the App (re)connects, it knows nothing, so call forgetSent() to have every button sent again.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _GuiStateCache_h
+#define _GuiStateCache_h
+
+#include <Arduino.h>
+#include "FixedFormat.h"   //for FixedBuf and bleSendMessage()
+#include "TaskScheduler.h" //for taskShouldYield()
+
+class GuiStateCache {
+  public:
+    static const int MAX_FIELDS = 24;
+    static const int MAX_TEXT_LEN = 24;  //longer button text is truncated
+
+    //record the new value of a button.  The id must be a string that lives forever (eg, a literal)
+    void setText(const char *id, const char *text);
+    void setText(const char *id, float val, int n_decimals);
+    void setState(const char *id, bool state);
+
+    void forgetSent(void);            //the App doesn't know anything, so send everything again
+    bool service(BLE *ble);           //send what changed.  Returns true if there is more to send (after yielding)
+    bool isPending(void) { return n_pending > 0; }
+
+    //statistics
+    unsigned long n_sent = 0, n_coalesced = 0;
+
+  private:
+    typedef struct {
+      const char *id;
+      bool is_state;                  //a button state ("STATE=BTN:") rather than button text ("TEXT=BTN:")
+      bool pending;                   //the App hasn't seen this value yet
+      char text[MAX_TEXT_LEN];        //the latest value
+      char sent[MAX_TEXT_LEN];        //the value last sent to the App
+      bool is_sent_valid;
+    } Field;
+    Field fields[MAX_FIELDS];
+    int n_fields = 0;
+    int n_pending = 0;
+
+    Field *getField(const char *id, bool is_state);
+    void setField(const char *id, bool is_state, const char *text);
+};
+
+GuiStateCache::Field *GuiStateCache::getField(const char *id, bool is_state) {
+  for (int i=0; i < n_fields; i++) {
+    if ((fields[i].is_state == is_state) && ((fields[i].id == id) || (strcmp(fields[i].id, id) == 0))) return &fields[i];
+  }
+  if (n_fields >= MAX_FIELDS) return NULL;
+  Field *f = &fields[n_fields++];
+  memset(f, 0, sizeof(Field));
+  f->id = id;
+  f->is_state = is_state;
+  return f;
+}
+
+void GuiStateCache::setField(const char *id, bool is_state, const char *text) {
+  Field *f = getField(id, is_state);
+  if (f == NULL) return;
+  strncpy(f->text, text, MAX_TEXT_LEN-1); f->text[MAX_TEXT_LEN-1] = '\0';
+  bool changed = !f->is_sent_valid || (strcmp(f->text, f->sent) != 0);
+  if (changed && !f->pending) { f->pending = true; n_pending++; }
+  else if (changed) { n_coalesced++; }                          //replaces a value that was never sent
+  else if (f->pending) { f->pending = false; n_pending--; }    //back to what the App is already showing
+}
+
+void GuiStateCache::setText(const char *id, const char *text) { setField(id, false, text); }
+void GuiStateCache::setState(const char *id, bool state) { setField(id, true, state ? "1" : "0"); }
+void GuiStateCache::setText(const char *id, float val, int n_decimals) {
+  FixedBuf<MAX_TEXT_LEN> text;
+  text.print(val, n_decimals);
+  setField(id, false, text.c_str());
+}
+
+void GuiStateCache::forgetSent(void) {
+  n_pending = 0;
+  for (int i=0; i < n_fields; i++) { fields[i].is_sent_valid = false; fields[i].pending = true; n_pending++; }
+}
+
+bool GuiStateCache::service(BLE *ble) {
+  if (n_pending == 0) return false;
+  FixedBuf<FIXED_FORMAT_MSG_LEN> msg;
+  for (int i=0; i < n_fields; i++) {
+    Field &f = fields[i];
+    if (!f.pending) continue;
+
+    //same messages as SerialManagerBase::setButtonText() and setButtonState()
+    msg.clear();
+    msg.print(f.is_state ? "STATE=BTN:" : "TEXT=BTN:"); msg.print(f.id); msg.print(':'); msg.print(f.text);
+    bleSendMessage(ble, msg.c_str());
+
+    strcpy(f.sent, f.text);
+    f.is_sent_valid = true;
+    f.pending = false; n_pending--;
+    n_sent++;
+    if ((n_pending > 0) && taskShouldYield()) return true;  //see TaskScheduler.h.  The rest go out next time
+  }
+  return false;
+}
+
+#endif
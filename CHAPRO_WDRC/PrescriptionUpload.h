@@ -0,0 +1,66 @@
+/*
+   PrescriptionUpload
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Accept a new prescription from the fitting software while running, instead of editing
+            GHA_Constants.h and re-flashing.  The prescription arrives as a binary frame over USB serial, or as
+            the same frame in hex text over BLE (the BLE module only carries text, see BinaryFrame.h):
+
+               type 'P': payload = CHA_DSL2 | CHA_WDRC2 | BTNRH_WDRC::CHA_AFC
+                         (the same structures as in GHA_Constants.h, packed back-to-back, little-endian,
+                         with the Teensy's struct layout).  The payload length must match exactly.
+               type '?': no payload.  Asks for the three struct sizes, so the sender can check its layout.
+
+            The structures go through the same translator as GHA_Constants.h (see translator.h), but at runtime.
+            If only the gains and other AGC settings changed, the result is applied in place.  Otherwise, it is
+            handed to the algorithm's program change so that it is prepared in the background and swapped in
+            without a dropout.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _PrescriptionUpload_h
+#define _PrescriptionUpload_h
+
+#include <Arduino.h>
+#include "translator.h"
+#include "AudioEffectBTNRH.h"
+
+#define PRESCRIPTION_UPLOAD_OK          0
+#define PRESCRIPTION_UPLOAD_BAD_LENGTH -1
+#define PRESCRIPTION_UPLOAD_BAD_VALUE  -2
+#define PRESCRIPTION_UPLOAD_BUSY       -3
+
+const int prescriptionUploadBytes = sizeof(BTNRH_WDRC::CHA_DSL2) + sizeof(BTNRH_WDRC::CHA_WDRC2) + sizeof(BTNRH_WDRC::CHA_AFC);
+
+//applyUploadedPrescription: translate the uploaded structures and start the hot-swap to them
+int applyUploadedPrescription(const uint8_t *payload, int n_bytes, AudioEffectBTNRH_F32 &alg) {
+  BTNRH_WDRC::CHA_DSL2 dsl_in;
+  BTNRH_WDRC::CHA_WDRC2 gha_in;
+  BTNRH_WDRC::CHA_AFC afc_in;
+  CHA_DSL dsl; CHA_WDRC agc; CHA_AFC afc;
+
+  if (n_bytes != prescriptionUploadBytes) return PRESCRIPTION_UPLOAD_BAD_LENGTH;
+  memcpy(&dsl_in, payload, sizeof(dsl_in));  payload += sizeof(dsl_in);  //copy out, as the payload isn't aligned
+  memcpy(&gha_in, payload, sizeof(gha_in));  payload += sizeof(gha_in);
+  memcpy(&afc_in, payload, sizeof(afc_in));
+
+  //reject anything that CHAPRO can't prepare.  The channel count is checked before translating, as it indexes the arrays.
+  if ((dsl_in.nchannel < 1) || (dsl_in.nchannel > DSL_MXCH)) return PRESCRIPTION_UPLOAD_BAD_VALUE;
+  if ((dsl_in.attack <= 0.0) || (dsl_in.release <= 0.0) || (gha_in.attack <= 0.0) || (gha_in.release <= 0.0)) return PRESCRIPTION_UPLOAD_BAD_VALUE;
+
+  //start from what is running (for nz, td, and the AFC settings that aren't in the upload), then translate
+  alg.getActivePrescription(&dsl, &agc, &afc);
+  convertStructures_DSL(dsl_in, dsl);   //see translator.h
+  convertStructures_WDRC(gha_in, agc);  //see translator.h
+  convertStructures_AFC(afc_in, afc);   //see translator.h
+
+  //...and what prepare() can't hold (the filterbank and the AFC lengths)
+  if (prescription_check_sizes(&dsl, &agc, &afc) != NULL) return PRESCRIPTION_UPLOAD_BAD_VALUE;  //see test_gha.h
+
+  if (alg.changePrescription(&dsl, &agc, &afc) == AudioEffectBTNRH_F32::CHANGE_BUSY) return PRESCRIPTION_UPLOAD_BUSY;
+  return PRESCRIPTION_UPLOAD_OK;
+}
+
+#endif
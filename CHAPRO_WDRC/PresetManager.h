@@ -0,0 +1,154 @@
+/*
+   PresetManager
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Save and recall GHA prescriptions as named presets, all held in one binary file on the SD card.
+            The file format is defined in GhaPreset.h.  A recalled preset is handed to the program change
+            in AudioEffectBTNRH_F32, so that it is swapped in without a dropout.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _PresetManager_h
+#define _PresetManager_h
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include "SdShared.h"
+#include "GhaPreset.h"
+#include "AudioEffectBTNRH.h"
+
+class PresetManager {
+  public:
+    PresetManager(SdFs &_sd, const char *_fname = "PRESETS.BIN") : sd(_sd), fname(_fname) {};  //_sd is shared (see SdShared.h)
+
+    int getNumPresets(void);                                      //returns zero if there is no (valid) preset file
+    int getPresetName(int index, char *name);                     //name must hold GHA_PRESET_NAME_LEN chars
+    int readPreset(int index, GhaPresetRecord *rec);              //read and check one preset
+    int loadPreset(int index, AudioEffectBTNRH_F32 &alg);         //read one preset and hot-swap the algorithm to it
+    int savePreset(const char *name, AudioEffectBTNRH_F32 &alg);  //save the running prescription, replacing any preset of the same name
+    void printPresets(Print *s);
+
+    int curPreset = -1;                 //index of the most-recently loaded (or saved) preset
+    unsigned long lastLoad_micros = 0;  //time to read, check, and hand-off the most-recently loaded preset
+
+  protected:
+    SdFs &sd;
+    const char *fname;
+    bool beginSD(void) { return beginSharedSD(sd); }
+    int readHeader(FsFile &file, GhaPresetFileHeader *hdr);
+};
+
+int PresetManager::readHeader(FsFile &file, GhaPresetFileHeader *hdr) {
+  file.seekSet(0);
+  if (file.read(hdr, sizeof(GhaPresetFileHeader)) != (int)sizeof(GhaPresetFileHeader)) return GHA_PRESET_IO_ERROR;
+  return gha_preset_header_check(hdr);
+}
+
+int PresetManager::getNumPresets(void) {
+  GhaPresetFileHeader hdr;
+  if (!beginSD()) return 0;
+  FsFile file = sd.open(fname, O_RDONLY);
+  if (!file) return 0;
+  int ret_val = readHeader(file, &hdr);
+  file.close();
+  return (ret_val == GHA_PRESET_OK) ? hdr.n_presets : 0;
+}
+
+int PresetManager::readPreset(int index, GhaPresetRecord *rec) {
+  GhaPresetFileHeader hdr;
+  if (!beginSD()) return GHA_PRESET_IO_ERROR;
+  FsFile file = sd.open(fname, O_RDONLY);
+  if (!file) return GHA_PRESET_IO_ERROR;
+
+  int ret_val = readHeader(file, &hdr);
+  if (ret_val == GHA_PRESET_OK) {
+    if ((index < 0) || (index >= hdr.n_presets)) {
+      ret_val = GHA_PRESET_BAD_INDEX;
+    } else {
+      file.seekSet(gha_preset_record_offset(index));
+      if (file.read(rec, sizeof(GhaPresetRecord)) != (int)sizeof(GhaPresetRecord)) ret_val = GHA_PRESET_IO_ERROR;
+    }
+  }
+  file.close();
+  return ret_val;
+}
+
+int PresetManager::getPresetName(int index, char *name) {
+  GhaPresetRecord rec;
+  int ret_val = readPreset(index, &rec);
+  if (ret_val == GHA_PRESET_OK) {
+    memcpy(name, rec.name, GHA_PRESET_NAME_LEN-1);  //the stored name may not be terminated
+    name[GHA_PRESET_NAME_LEN-1] = '\0';
+  }
+  return ret_val;
+}
+
+int PresetManager::loadPreset(int index, AudioEffectBTNRH_F32 &alg) {
+  unsigned long start_micros = micros();
+  GhaPresetRecord rec;
+  CHA_DSL dsl; CHA_WDRC agc; CHA_AFC afc;
+
+  int ret_val = readPreset(index, &rec);
+  if (ret_val != GHA_PRESET_OK) return ret_val;
+
+  alg.getActivePrescription(&dsl, &agc, &afc);            //start from what is running (for the fields not in the preset)
+  ret_val = gha_preset_unpack(&rec, &dsl, &agc, &afc);    //checks the CRC and the values
+  if (ret_val != GHA_PRESET_OK) return ret_val;
+  if (alg.changePrescription(&dsl, &agc, &afc) == AudioEffectBTNRH_F32::CHANGE_BUSY) return GHA_PRESET_BUSY;  //in place, or else prepared from loop()
+
+  curPreset = index;
+  lastLoad_micros = micros() - start_micros;
+  return GHA_PRESET_OK;
+}
+
+int PresetManager::savePreset(const char *name, AudioEffectBTNRH_F32 &alg) {
+  GhaPresetFileHeader hdr;
+  GhaPresetRecord rec;
+  CHA_DSL dsl; CHA_WDRC agc; CHA_AFC afc;
+  int n_presets = 0, index;
+
+  alg.getActivePrescription(&dsl, &agc, &afc);
+  if (gha_preset_pack(&rec, name, &dsl, &agc, &afc) != GHA_PRESET_OK) return GHA_PRESET_BAD_VALUE;
+
+  if (!beginSD()) return GHA_PRESET_IO_ERROR;
+  FsFile file = sd.open(fname, O_RDWR | O_CREAT);
+  if (!file) return GHA_PRESET_IO_ERROR;
+  if (file.size() > 0) {
+    int ret_val = readHeader(file, &hdr);
+    if (ret_val != GHA_PRESET_OK) { file.close(); return ret_val; }  //don't overwrite a file that we don't understand
+    n_presets = hdr.n_presets;
+  }
+
+  //replace the preset with the same name, if there is one.  Otherwise, append.
+  for (index = 0; index < n_presets; index++) {
+    char old_name[GHA_PRESET_NAME_LEN];
+    file.seekSet(gha_preset_record_offset(index) + offsetof(GhaPresetRecord, name));
+    if ((file.read(old_name, GHA_PRESET_NAME_LEN) == GHA_PRESET_NAME_LEN) && (strncmp(old_name, rec.name, GHA_PRESET_NAME_LEN) == 0)) break;
+  }
+  file.seekSet(gha_preset_record_offset(index));
+  bool ok = (file.write(&rec, sizeof(GhaPresetRecord)) == sizeof(GhaPresetRecord));
+  if (ok && (index == n_presets)) {
+    gha_preset_header_init(&hdr, n_presets+1);
+    file.seekSet(0);
+    ok = (file.write(&hdr, sizeof(GhaPresetFileHeader)) == sizeof(GhaPresetFileHeader));
+  }
+  file.close();
+  if (!ok) return GHA_PRESET_IO_ERROR;
+
+  curPreset = index;
+  return index;
+}
+
+void PresetManager::printPresets(Print *s) {
+  char name[GHA_PRESET_NAME_LEN];
+  int n_presets = getNumPresets();
+  s->print("PresetManager: "); s->print(n_presets); s->print(" presets in "); s->println(fname);
+  for (int i=0; i < n_presets; i++) {
+    s->print("   "); s->print(i); s->print((i == curPreset) ? "* " : ": ");
+    if (getPresetName(i, name) == GHA_PRESET_OK) { s->println(name); } else { s->println("*** BAD PRESET ***"); }
+  }
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+   RemoteLayout
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Hold the TympanRemote App's layout (the JSON text that describes the pages, cards, and buttons) and
+            send it when the App connects, without building it again each time.
+
+            The layout comes from one of two places:
+              * GHA_RemoteLayout.h, if it exists, which puts the layout in flash.  Make the file by sending the
+                'o' command and pasting the output into GHA_RemoteLayout.h.  Do it again whenever you change
+                SerialManager::createTympanRemoteLayout().
+              * Otherwise, it is made once at boot (from SerialManager's TympanRemoteFormatter) into a static
+                buffer, so it is not made again on the heap each time the App connects.  If it doesn't fit,
+                build() says so and the caller can build a smaller layout instead (see SerialManager).
+
+            The App needs the layout as one message (BLE::sendMessage() frames each message for the App, and
+            splits it into BLE packets itself), so service() sends it to BLE whole, on its first call, through
+            bleSendMessage() (see FixedFormat.h), whose String is made big enough for it once, by build().  The
+            copy to USB serial is sent a piece at a time, one piece per pass through loop().
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _RemoteLayout_h
+#define _RemoteLayout_h
+
+#include <Arduino.h>
+#include <Tympan_Library.h>
+#include "FixedFormat.h"   //for bleSendMessage()
+
+#if defined(__has_include)
+#if __has_include("GHA_RemoteLayout.h")
+#include "GHA_RemoteLayout.h"     //static const char remote_layout[] PROGMEM = "...";
+#define GHA_HAVE_REMOTE_LAYOUT
+#endif
+#endif
+
+#define REMOTE_LAYOUT_MAX_LEN 4096  //for the layout that is made at boot
+
+class RemoteLayout {
+  public:
+    static const int CHUNK_BYTES = 128;  //bytes to USB serial per call to service()
+
+    bool build(TympanRemoteFormatter &gui);  //call once (eg, at boot).  Uses GHA_RemoteLayout.h, if there is one.  False if too long
+    bool isReady(void) { return layout_len > 0; }
+    int length(void) { return layout_len; }
+    bool isCompiledIn(void) { return is_compiled_in; }
+
+    void startSending(void) { if (isReady()) send_pos = 0; }
+    bool isSending(void) { return send_pos >= 0; }
+    bool service(Print *serial, BLE *ble);   //call from loop().  Returns true if there is more to send
+
+    static void printAsCode(Print *s, TympanRemoteFormatter &gui);  //print GHA_RemoteLayout.h
+
+  private:
+    const char *layout = NULL;
+    int layout_len = 0;
+    bool is_compiled_in = false;
+    int send_pos = -1;     //next byte to send (-1 when not sending)
+};
+
+#ifndef GHA_HAVE_REMOTE_LAYOUT
+DMAMEM static char remote_layout_buf[REMOTE_LAYOUT_MAX_LEN];  //static, rather than on the heap
+#endif
+
+bool RemoteLayout::build(TympanRemoteFormatter &gui) {
+#ifdef GHA_HAVE_REMOTE_LAYOUT
+  layout = remote_layout;
+  layout_len = sizeof(remote_layout) - 1;
+  is_compiled_in = true;
+#else
+  String s = gui.asString();  //the only time that the layout is made on the heap
+  if ((int)s.length() >= REMOTE_LAYOUT_MAX_LEN) {
+    Serial.print("RemoteLayout: build: *** layout is too long ("); Serial.print((int)s.length());
+    Serial.println(" bytes).  Increase REMOTE_LAYOUT_MAX_LEN. ***");
+    return false;
+  }
+  memcpy(remote_layout_buf, s.c_str(), s.length() + 1);
+  layout = remote_layout_buf;
+  layout_len = s.length();
+  is_compiled_in = false;
+#endif
+  bleReserveMessage(layout_len);  //so that sending it doesn't allocate (see FixedFormat.h)
+  return true;
+}
+
+bool RemoteLayout::service(Print *serial, BLE *ble) {
+  if (send_pos < 0) return false;
+
+  //the whole layout to BLE, as one message
+  if ((send_pos == 0) && ble) bleSendMessage(ble, layout);
+
+  //and the next piece to USB
+  int n = layout_len - send_pos;
+  if (n > CHUNK_BYTES) n = CHUNK_BYTES;
+  serial->write((const uint8_t *)(layout + send_pos), n);
+  send_pos += n;
+  if (send_pos < layout_len) return true;
+
+  serial->println();
+  send_pos = -1;
+  return false;
+}
+
+void RemoteLayout::printAsCode(Print *s, TympanRemoteFormatter &gui) {
+  const int chars_per_line = 100;
+  String layout_str = gui.asString();
+  const char *text = layout_str.c_str();
+  s->println("// GHA_RemoteLayout.h: the TympanRemote App layout, made ahead of time by SerialManager's 'o' command");
+  s->println("static const char remote_layout[] PROGMEM =");
+  for (int i=0; text[i] != '\0'; i++) {
+    if ((i % chars_per_line) == 0) s->print("  \"");
+    if ((text[i] == '"') || (text[i] == '\\')) s->print('\\');
+    s->print(text[i]);
+    if (((i+1) % chars_per_line == 0) || (text[i+1] == '\0')) s->println("\"");
+  }
+  s->println("  ;");
+}
+
+#endif
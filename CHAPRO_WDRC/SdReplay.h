@@ -0,0 +1,277 @@
+/*
+   SdReplay
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Re-process a recording from the SD card through the algorithm on the Tympan itself, as fast as the CPU
+            allows instead of at the speed of the I2S clock, and write the result back to the SD card.  This way,
+            field recordings can be re-run with a new fitting on the real hardware without waiting in real time.
+
+            The replay gets its own CHAPRO context, prepared from a copy of the prescription (normally the one that
+            is running, so load a preset or upload a fitting first), one step per call, like a program change (see
+            AudioEffectBTNRH.h).  The live audio keeps running on its own context, in the audio interrupt, and the
+            replay takes whatever CPU is left over in loop(): serviceReplay() processes blocks until taskShouldYield()
+            says that the other tasks need a turn (see TaskScheduler.h).
+
+            The input is a 16-bit WAV file as written by the SD writer (audioSDWriter), whose first channel is the
+            raw input to the algorithm (see AudioConnections.h).  The output has the same layout as a recording:
+            the raw input on the left, and the newly processed output (after the digital gain) on the right, so
+            that it can be compared with the original recording's right channel.
+
+            The AFC is off during the replay by default: the replayed output doesn't reach the microphone, so the
+            feedback in the recording doesn't follow it, and the AFC would be adapting to the wrong loop.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _SdReplay_h
+#define _SdReplay_h
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include "SdShared.h"
+#include "test_gha.h"
+#include "TaskScheduler.h"   //for taskShouldYield()
+
+#define SD_REPLAY_MAX_CHAN 4   //the SD writer records 2 or 4 channels
+
+class SdReplay {
+  public:
+    SdReplay(SdFs &_sd) : sd(_sd) {};
+
+    //start replaying in_fname into out_fname with this prescription.  The files are opened here, and the context
+    //is prepared and the audio processed by serviceReplay().  Returns OK or one of the errors below.
+    int startReplay(const char *in_fname, const char *out_fname, const CHA_DSL *dsl, const CHA_WDRC *agc, const CHA_AFC *afc,
+                    float out_gain_dB, bool use_afc = false);
+    bool serviceReplay(void);  //call from loop().  Returns true if there is more to do right away
+    void stopReplay(void);     //abandon the replay (the output so far is kept)
+    bool isBusy(void) { return stage != RP_IDLE; }
+
+    //the newest recording ("AUDIOnnn.WAV", as named by the SD writer) and a name for its replay ("RPLAYnnn.WAV").
+    //Returns false if there are no recordings.
+    bool findLatestRecording(char *in_fname, char *out_fname, int n_max);
+
+    //the results of the last replay
+    int lastError = OK;
+    unsigned long n_frames = 0;          //frames processed
+    unsigned long proc_usec = 0;         //time spent in process_chunk()
+    unsigned long total_millis = 0;      //start to finish, including the SD card and the time given to other tasks
+    float audio_sec(void) { return (float)n_frames / (float)srate; }
+    void printResult(Print *s);
+
+    enum ERR {OK=0, ERR_BUSY=-1, ERR_SD=-2, ERR_READ=-3, ERR_FORMAT=-4, ERR_RATE=-5, ERR_WRITE=-6, ERR_STOPPED=-7, ERR_PRESCRIPTION=-8};
+    const char *getErrorString(int err);
+
+  protected:
+    enum STAGE {RP_IDLE=0, RP_FILTERBANK, RP_COMPRESSOR, RP_FEEDBACK, RP_RUN, RP_FINISH};
+    volatile int stage = RP_IDLE;
+    SdFs &sd;  //the volume shared with the SD writer (see SdShared.h)
+    bool beginSD(void) { return beginSharedSD(sd); }
+    FsFile in_file, out_file;
+
+    //the replay's own context and prescription
+    void *cp_replay[NPTR] = {0};
+    CHA_DSL dsl;
+    CHA_WDRC agc;
+    CHA_AFC afc;
+    bool afc_on = false;
+    float out_gain = 1.0f;
+
+    //the recording
+    int n_chan = 0;
+    uint32_t data_bytes_left = 0;
+    unsigned long start_millis = 0;
+
+    //buffers for one block (a multiple of the chunk size)
+    static const int BLOCK_FRAMES = 256;
+    int16_t in_buf[BLOCK_FRAMES * SD_REPLAY_MAX_CHAN];
+    int16_t out_buf[BLOCK_FRAMES * 2];
+    float x[BLOCK_FRAMES], y[BLOCK_FRAMES];
+
+    int readWavHeader(void);
+    bool writeWavHeader(uint32_t frames);
+    bool processBlock(void);  //returns false at the end of the recording (or on an error)
+    void finish(int err);
+    static uint16_t get16(const uint8_t *b) { return (uint16_t)(b[0] | (b[1] << 8)); }
+    static uint32_t get32(const uint8_t *b) { return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24); }
+    static void put16(uint8_t *b, uint16_t v) { b[0] = v & 0xFF; b[1] = v >> 8; }
+    static void put32(uint8_t *b, uint32_t v) { for (int i=0; i<4; i++) b[i] = (v >> (8*i)) & 0xFF; }
+};
+
+int SdReplay::startReplay(const char *in_fname, const char *out_fname, const CHA_DSL *_dsl, const CHA_WDRC *_agc, const CHA_AFC *_afc,
+                          float out_gain_dB, bool use_afc) {
+  if (stage != RP_IDLE) return ERR_BUSY;
+  if (!beginSD()) return ERR_SD;
+  in_file = sd.open(in_fname, O_RDONLY);
+  if (!in_file) return ERR_READ;
+  int err = readWavHeader();
+  if (err != OK) { in_file.close(); return err; }
+  out_file = sd.open(out_fname, O_RDWR | O_CREAT | O_TRUNC);
+  if (!out_file || !writeWavHeader(0)) { in_file.close(); out_file.close(); return ERR_WRITE; }
+
+  memcpy(&dsl, _dsl, sizeof(CHA_DSL));
+  memcpy(&agc, _agc, sizeof(CHA_WDRC));
+  memcpy(&afc, _afc, sizeof(CHA_AFC));
+  out_gain = powf(10.0f, out_gain_dB / 20.0f);
+  afc_on = use_afc;
+  n_frames = 0;
+  proc_usec = 0;
+  lastError = OK;
+  start_millis = millis();
+  stage = RP_FILTERBANK;  //serviceReplay() takes it from here
+  return OK;
+}
+
+//readWavHeader: find the format and the audio data.  The file is left at the start of the audio data.
+int SdReplay::readWavHeader(void) {
+  uint8_t b[16];
+  if ((in_file.read(b, 12) != 12) || memcmp(b, "RIFF", 4) || memcmp(b + 8, "WAVE", 4)) return ERR_FORMAT;
+  bool have_fmt = false;
+  while (in_file.read(b, 8) == 8) {
+    uint32_t len = get32(b + 4);
+    uint64_t next = in_file.curPosition() + len + (len & 1);  //chunks are padded to an even length
+    if (!memcmp(b, "fmt ", 4)) {
+      if ((len < 16) || (in_file.read(b, 16) != 16)) return ERR_FORMAT;
+      uint16_t format = get16(b), bits = get16(b + 14);
+      n_chan = get16(b + 2);
+      if (((format != 1) && (format != 0xFFFE)) || (bits != 16) || (n_chan < 1) || (n_chan > SD_REPLAY_MAX_CHAN)) return ERR_FORMAT;
+      if (get32(b + 4) != (uint32_t)(srate + 0.5)) return ERR_RATE;  //no resampling: it must be at the algorithm's rate
+      have_fmt = true;
+    } else if (!memcmp(b, "data", 4)) {
+      if (!have_fmt) return ERR_FORMAT;
+      uint64_t avail = in_file.size() - in_file.curPosition();
+      data_bytes_left = ((len == 0) || (len > avail)) ? (uint32_t)avail : len;  //(a recording that was cut off may not have its length filled in)
+      return OK;
+    }
+    if (!in_file.seekSet(next)) return ERR_FORMAT;
+  }
+  return ERR_FORMAT;
+}
+
+//writeWavHeader: a 16-bit, 2-channel header for this many frames, at the start of the output file
+bool SdReplay::writeWavHeader(uint32_t frames) {
+  uint8_t h[44];
+  uint32_t data_bytes = frames * 2 * sizeof(int16_t);
+  memcpy(h, "RIFF", 4);  put32(h + 4, 36 + data_bytes);
+  memcpy(h + 8, "WAVEfmt ", 8);
+  put32(h + 16, 16);  put16(h + 20, 1);  put16(h + 22, 2);
+  put32(h + 24, (uint32_t)(srate + 0.5));  put32(h + 28, (uint32_t)(srate + 0.5) * 2 * sizeof(int16_t));
+  put16(h + 32, 2 * sizeof(int16_t));  put16(h + 34, 16);
+  memcpy(h + 36, "data", 4);  put32(h + 40, data_bytes);
+  return out_file.seekSet(0) && (out_file.write(h, sizeof(h)) == sizeof(h));
+}
+
+bool SdReplay::processBlock(void) {
+  int frame_bytes = n_chan * sizeof(int16_t);
+  int n_max = (BLOCK_FRAMES / chunk) * chunk;  //whole chunks
+  int n = (data_bytes_left / frame_bytes < (uint32_t)n_max) ? (int)(data_bytes_left / frame_bytes) : n_max;
+  if (n <= 0) return false;
+  if (in_file.read(in_buf, n * frame_bytes) != n * frame_bytes) { finish(ERR_READ); return false; }
+  data_bytes_left -= n * frame_bytes;
+
+  //the raw input is the first channel.  A partial chunk at the end is padded with zeros
+  int n_pad = ((n + chunk - 1) / chunk) * chunk;
+  for (int i=0; i<n; i++) x[i] = in_buf[i * n_chan] * (1.0f / 32768.0f);
+  for (int i=n; i<n_pad; i++) x[i] = 0.0f;
+  unsigned long t0 = micros();
+  for (int i=0; i<n_pad; i += chunk) process_chunk(cp_replay, x + i, y + i, chunk);  //see test_gha.h
+  proc_usec += micros() - t0;
+
+  //left: the raw input, as recorded.  right: the new output, after the digital gain
+  for (int i=0; i<n; i++) {
+    float v = y[i] * out_gain * 32768.0f;
+    out_buf[2*i] = in_buf[i * n_chan];
+    out_buf[2*i + 1] = (int16_t)fmaxf(-32768.0f, fminf(32767.0f, v));
+  }
+  if (out_file.write(out_buf, n * 2 * sizeof(int16_t)) != n * 2 * sizeof(int16_t)) { finish(ERR_WRITE); return false; }
+  n_frames += n;
+  return true;
+}
+
+//serviceReplay: call from loop().  Each call does one step of preparing the context, then as many blocks as the
+//  scheduler allows.  Returns true if there is more to do right away.
+bool SdReplay::serviceReplay(void) {
+  switch (stage) {
+    case RP_FILTERBANK:
+      //in test_gha.h (the design usually comes from the cache)
+      if (prepare_filterbank(cp_replay, &dsl, &agc) < 0) { finish(ERR_PRESCRIPTION); return false; }
+      stage = RP_COMPRESSOR;
+      return true;
+    case RP_COMPRESSOR:
+      prepare_compressor(cp_replay, &dsl, &agc);  //in test_gha.h
+      stage = RP_FEEDBACK;
+      return true;
+    case RP_FEEDBACK:
+      afc.fbg = 0;  //no simulated feedback
+      afc.sqm = 0;
+      prepare_feedback(cp_replay, &afc);          //in test_gha.h
+      if (!afc_on) ((int *)cp_replay[_ivar])[_mxl] = 0;  //as setAfcEnabled(false) does
+      stage = RP_RUN;
+      return true;
+    case RP_RUN:
+      while (processBlock()) {
+        if (taskShouldYield()) return true;  //see TaskScheduler.h.  We'll continue from here next time
+      }
+      if (stage == RP_RUN) stage = RP_FINISH;  //(unless processBlock() has already finished with an error)
+      return true;
+    case RP_FINISH:
+      finish(OK);
+      return false;
+    default:
+      return false;
+  }
+}
+
+void SdReplay::stopReplay(void) {
+  if (stage != RP_IDLE) finish(ERR_STOPPED);
+}
+
+//finish: patch the output's header with its length, close the files, and free the context
+void SdReplay::finish(int err) {
+  if (!writeWavHeader(n_frames) && (err == OK)) err = ERR_WRITE;
+  out_file.close();
+  in_file.close();
+  if (cp_replay[_size] != NULL) cha_cleanup(cp_replay);
+  memset(cp_replay, 0, NPTR*sizeof(void *));
+  total_millis = millis() - start_millis;
+  lastError = err;
+  stage = RP_IDLE;
+}
+
+bool SdReplay::findLatestRecording(char *in_fname, char *out_fname, int n_max) {
+  char fname[16];
+  if (!beginSD()) return false;
+  for (int i=999; i>=0; i--) {
+    snprintf(fname, sizeof(fname), "AUDIO%03d.WAV", i);
+    if (sd.exists(fname)) {
+      snprintf(in_fname, n_max, "%s", fname);
+      snprintf(out_fname, n_max, "RPLAY%03d.WAV", i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void SdReplay::printResult(Print *s) {
+  s->print("SdReplay: "); s->print(getErrorString(lastError)); s->print(": ");
+  s->print(audio_sec(), 1); s->print(" sec of audio in "); s->print(total_millis / 1000.0f, 1); s->print(" sec (");
+  s->print((total_millis > 0) ? 1000.0f * audio_sec() / total_millis : 0.0f, 1); s->print("x real time; ");
+  s->print((proc_usec > 0) ? 1.0e6f * audio_sec() / proc_usec : 0.0f, 1); s->println("x in process_chunk alone)");
+}
+
+const char* SdReplay::getErrorString(int err) {
+  switch (err) {
+    case OK: return "OK";
+    case ERR_BUSY: return "a replay is already running";
+    case ERR_SD: return "could not access the SD card";
+    case ERR_READ: return "could not read the recording";
+    case ERR_FORMAT: return "not a 16-bit WAV file";
+    case ERR_RATE: return "recorded at a different sample rate";
+    case ERR_WRITE: return "could not write the output";
+    case ERR_STOPPED: return "stopped";
+    case ERR_PRESCRIPTION: return "the prescription is too big to prepare";
+  }
+  return "unknown error";
+}
+
+#endif
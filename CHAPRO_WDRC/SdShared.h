@@ -0,0 +1,27 @@
+/*
+   SdShared
+
+   Created: OpenAudio, October 2026
+
+   Purpose: The SD card is mounted once, as one SdFs volume, and that volume is shared by everything that uses
+            the card (the SD writer, the presets, the AFC model, the filterbank cache, and the replay).  Each
+            SdFs keeps its own copy of the FAT and the directory, so two volumes on the same card would each
+            write their own view of it, and could corrupt it.  So, create one SdFs in the main *.ino file and
+            pass it (by reference) to each class that needs the card.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _SdShared_h
+#define _SdShared_h
+
+#include <SdFat.h>
+
+//beginSharedSD: mount the card, unless it is already mounted (by this or by anything else sharing the volume, such
+//  as the SD writer).  Returns false if there is no card, and tries again the next time that it is called.
+static inline bool beginSharedSD(SdFs &sd) {
+  if (sd.fatType() != 0) return true;  //already mounted
+  return sd.begin(SdioConfig(FIFO_SDIO));
+}
+
+#endif
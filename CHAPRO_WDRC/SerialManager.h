@@ -4,7 +4,16 @@
 
 #include <Tympan_Library.h>
 #include "AudioEffectBTNRH.h"
+#include "PresetManager.h"
+#include "AfcModelStore.h"
+#include "SdReplay.h"
+#include "BinaryFrame.h"
+#include "PrescriptionUpload.h"
+#include "BatchCommand.h"
 #include "State.h"
+#include "FixedFormat.h"
+#include "GuiStateCache.h"
+#include "RemoteLayout.h"
 
 
 //classes from the main sketch that might be used here
@@ -14,6 +23,10 @@ extern EarpieceMixer_F32_UI earpieceMixer; //created in the main *.ino file
 extern AudioSDWriter_F32_UI audioSDWriter;
 extern AudioEffectBTNRH_F32 BTNRH_alg1; //, BTNRH_alg2;
 extern AudioEffectGain_F32 gain1;
+extern PresetManager presetManager;        //created in the main *.ino file
+extern AfcModelStore afcModelStore;        //created in the main *.ino file
+extern SdReplay sdReplay;                  //created in the main *.ino file
+extern TaskScheduler taskScheduler;        //created in the main *.ino file
 extern float setDigitalGain_dB(float);
 
 //
@@ -39,8 +52,12 @@ class SerialManager : public SerialManagerBase  {  // see Tympan_Library for Ser
       
     void printHelp(void);
     void createTympanRemoteLayout(void); 
-    void printTympanRemoteLayout(void); 
+    void printTympanRemoteLayout(void);  //starts sending the layout...serviceLayout() sends it
+    void prepareLayout(void);            //make the layout ahead of time (eg, at boot), so that it is ready for the App
+    bool serviceLayout(void);            //call from loop().  Returns true if there is more to send
     bool processCharacter(char c);  //this is called automatically by SerialManagerBase.respondToByte(char c)
+    bool processCharacterTriple(char mode_char, char chan_char, char data_char);  //the commands for the UI elements (eg, the SD writer)
+    void receiveByte(char c, bool from_ble = false);  //use instead of respondToByte() so that binary frames are caught
 
     //method for updating the GUI on the App
     void setFullGUIState(bool activeButtonsOnly = false);
@@ -48,10 +65,23 @@ class SerialManager : public SerialManagerBase  {  // see Tympan_Library for Ser
     void updateGUI_AFCparams(void);
     void updateGUI_AFCenabled(void);
     void updateGUI_AFCparams_constants(void);
+    void updateGUI_preset(void);
+    bool serviceGUI(void) { return layout.isSending() ? false : guiCache.service(ble); }  //call from loop() to send the buttons that changed
+    void forgetGUIState(void) { guiCache.forgetSent(); }  //the App knows nothing, so send every button again
 
   private:
 
     TympanRemoteFormatter myGUI;  //Creates the GUI-writing class for interacting with TympanRemote App
+    RemoteLayout layout;          //the layout made from myGUI (or compiled in), ready to send (see RemoteLayout.h)
+    bool layout_too_long = false;  //set if the layout didn't fit, and only the serial monitor page is sent instead
+
+    //binary frames (eg, prescription uploads), one parser per link
+    BinaryFrameParser usbFrames, bleFrames;
+    void processFrame(BinaryFrameParser &frame, bool from_ble);
+    void sendReply(const char *s, bool from_ble);
+
+    //what the App's buttons are showing, so that only changes are sent (see GuiStateCache.h)
+    GuiStateCache guiCache;
    
 };
 
@@ -62,18 +92,31 @@ void SerialManager::printHelp(void) {
   Serial.println(" Print Algorithm Settings: (no prefix)");
   Serial.println("   d: Print DSL settings.");
   Serial.println("   g: Print AGC settings.");   
+  Serial.println("   c: Print the filterbank coefficients, for pasting into GHA_FilterbankTable.h.");
+  Serial.println("   C: Print the filterbank design cache statistics.");
+  Serial.println("   t/T: Print/reset the timing statistics of the tasks in loop().");
+  Serial.println("   o: Print the App layout, for pasting into GHA_RemoteLayout.h.");
   Serial.println("   s: print AFC settings.");
   Serial.println(" Overall Gain: (no prefix)");
-  Serial.println("   k/K: incr/decrease gain (current: " + String(gain1.getGain_dB(),1) + " dB)");
+  Serial.print("   k/K: incr/decrease gain (current: "); Serial.print(gain1.getGain_dB(),1); Serial.println(" dB)");
   Serial.println("   z/Z: mute/unmute");
+  Serial.println(" Prescription: (no prefix)");
+  Serial.println("   u: reload the prescription from GHA_Constants.h (glitch-free hot-swap)");
+  Serial.println("   v: list the presets saved on the SD card");
+  Serial.println("   V: save the running prescription as a new preset on the SD card");
+  Serial.print("   n/N: load the next/previous preset from the SD card (current: "); Serial.print(presetManager.curPreset); Serial.println(")");
+  Serial.println("   b/B: start/stop re-processing the newest SD recording with the running prescription, faster than real time");
+  Serial.println("   (binary frames starting with 0x01, or in hex between '<' and '>' over BLE, upload a new prescription or set many parameters at once...see PrescriptionUpload.h and BatchCommand.h)");
   Serial.println(" AFC Parameters: (no prefix)");
   Serial.println("   x/X: enable/disable AFC");
-  //Serial.println("   a/A: incr/decrease afl, model length (current: " + String(BTNRH_alg1.get_cha_ivar(_afl)) + ")");
-  //Serial.println("   w/W: incr/decrease wfl, whiten filter length (current: " + String(BTNRH_alg1.get_cha_ivar(_wfl)) + ")");
-  Serial.println("   m/M: incr/decrease mu, speed of adaptation, bigger is faster (current: " + String((float)(BTNRH_alg1.get_cha_dvar(_mu)),8) + ")");
-  Serial.println("   r/R: incr/decrease rho, smoothing (current: " + String((float)(BTNRH_alg1.get_cha_dvar(_rho)),8) + ")");
-  Serial.println("   e/E: incr/decrease eps (current: " + String((float)(BTNRH_alg1.get_cha_dvar(_eps)),8) + ")");
+  Serial.print("   a/A: incr/decrease afl, model length (current: "); Serial.print(BTNRH_alg1.getAfcFilterLength(_afl)); Serial.print(", max "); Serial.print(AFC_MAX_AFL); Serial.println(")");
+  Serial.print("   w/W: incr/decrease wfl, whiten filter length (current: "); Serial.print(BTNRH_alg1.getAfcFilterLength(_wfl)); Serial.print(", max "); Serial.print(AFC_MAX_WFL); Serial.println(")");
+  Serial.print("   l/L: incr/decrease pfl, band-limit filter length (current: "); Serial.print(BTNRH_alg1.getAfcFilterLength(_pfl)); Serial.print(", max "); Serial.print(AFC_MAX_PFL); Serial.println(")");
+  Serial.print("   m/M: incr/decrease mu, speed of adaptation, bigger is faster (current: "); Serial.print((float)(BTNRH_alg1.get_cha_dvar(_mu)),8); Serial.println(")");
+  Serial.print("   r/R: incr/decrease rho, smoothing (current: "); Serial.print((float)(BTNRH_alg1.get_cha_dvar(_rho)),8); Serial.println(")");
+  Serial.print("   e/E: incr/decrease eps (current: "); Serial.print((float)(BTNRH_alg1.get_cha_dvar(_eps)),8); Serial.println(")");
   Serial.println("   q: reset the feedback model.");
+  Serial.println("   y/Y: save/restore the feedback model to/from the SD card (also auto-saved every 60 sec).");
   Serial.println("   f: print the feedback model.  Prints ONCE.");
   Serial.println("   p/P: start/stop REPEATED printing of the feedback model.");   
   Serial.println("   ]/}: start/stop REPEATED printing of the feedback model to BLE tothe mobile App.");     
@@ -101,26 +144,89 @@ bool SerialManager::processCharacter(char c) {  //this is called by SerialManage
       break;
     case 'k':
       new_val = myState.digital_gain_dB + 2.0;
-      myTympan.println("Command received: changing gain to " + String(new_val,1) + " dB");;
+      myTympan.print("Command received: changing gain to "); myTympan.print(new_val,1); myTympan.println(" dB");
       setDigitalGain_dB(new_val);
       updateGUI_gain();
       break;
     case 'K':
       new_val = myState.digital_gain_dB - 2.0;
-      myTympan.println("Command received: changing gain to " + String(new_val,1) + " dB");;
+      myTympan.print("Command received: changing gain to "); myTympan.print(new_val,1); myTympan.println(" dB");
       setDigitalGain_dB(new_val);
       updateGUI_gain();
       break;
     case 'z':
       new_val = -200.0f;
-      myTympan.println("Command received: muting (changing gain to " + String(new_val,1) + " dB)");;
+      myTympan.print("Command received: muting (changing gain to "); myTympan.print(new_val,1); myTympan.println(" dB)");
       gain1.setGain_dB(new_val);
       break;
     case 'Z':
       new_val = myState.digital_gain_dB;
-      myTympan.println("Command received: unmuting (changing gain to " + String(new_val,1) + " dB)");;
+      myTympan.print("Command received: unmuting (changing gain to "); myTympan.print(new_val,1); myTympan.println(" dB)");
       setDigitalGain_dB(new_val);
       break;  
+    case 'u':
+      if (BTNRH_alg1.reloadPrescription()) {
+        Serial.println("SerialManager: command received...reloading the prescription (hot-swap)...");
+      } else {
+        Serial.println("SerialManager: command received...*** a prescription change is already underway ***");
+      }
+      break;
+    case 'v':
+      presetManager.printPresets(&Serial);
+      break;
+    case 'V':
+      if (audioSDWriter.getState() == AudioSDWriter::STATE::RECORDING) {
+        Serial.println("SerialManager: command received...*** cannot save a preset while recording to the SD card ***");
+      } else if (sdReplay.isBusy()) {
+        Serial.println("SerialManager: command received...*** cannot save a preset while replaying a recording ***");
+      } else {
+        FixedBuf<GHA_PRESET_NAME_LEN> name("Preset "); name.print(presetManager.getNumPresets());
+        int ret_val = presetManager.savePreset(name.c_str(), BTNRH_alg1);
+        Serial.print("SerialManager: command received...saving preset \""); Serial.print(name.c_str()); Serial.print("\": ");
+        if (ret_val >= 0) { Serial.println("OK"); } else { Serial.print("FAILED ("); Serial.print(ret_val); Serial.println(")"); }
+        updateGUI_preset();
+      }
+      break;
+    case 'n': case 'N':
+      {
+        int n_presets = presetManager.getNumPresets();
+        if (n_presets < 1) { Serial.println("SerialManager: command received...no presets found on the SD card."); break; }
+        int index = presetManager.curPreset + ((c == 'n') ? 1 : -1);
+        if (index >= n_presets) index = 0;
+        if (index < 0) index = n_presets-1;
+        int ret_val = presetManager.loadPreset(index, BTNRH_alg1);
+        Serial.print("SerialManager: command received...loading preset "); Serial.print(index); Serial.print(": ");
+        if (ret_val == GHA_PRESET_OK) {
+          Serial.print("OK ("); Serial.print(presetManager.lastLoad_micros);
+          Serial.println(BTNRH_alg1.isProgramChangeActive() ? " usec, then prepared in the background)" : " usec, applied in place)");
+        } else {
+          Serial.print("FAILED ("); Serial.print(ret_val); Serial.println(")");
+        }
+        updateGUI_preset();
+      }
+      break;
+    case 'b':
+      {
+        char in_fname[16], out_fname[16];
+        CHA_DSL dsl; CHA_WDRC agc; CHA_AFC afc;
+        if (audioSDWriter.getState() == AudioSDWriter::STATE::RECORDING) {
+          Serial.println("SerialManager: command received...*** cannot replay a recording while recording to the SD card ***");
+          break;
+        }
+        if (!sdReplay.findLatestRecording(in_fname, out_fname, sizeof(in_fname))) {
+          Serial.println("SerialManager: command received...no recordings found on the SD card.");
+          break;
+        }
+        BTNRH_alg1.getActivePrescription(&dsl, &agc, &afc);
+        int ret_val = sdReplay.startReplay(in_fname, out_fname, &dsl, &agc, &afc, myState.digital_gain_dB);  //see SdReplay.h
+        Serial.print("SerialManager: command received...replaying "); Serial.print(in_fname); Serial.print(" into "); Serial.print(out_fname);
+        Serial.print(": "); Serial.println(sdReplay.getErrorString(ret_val));
+      }
+      break;
+    case 'B':
+      Serial.println("SerialManager: command received...stopping the replay.");
+      sdReplay.stopReplay();  //the loop() task prints the result
+      break;
     case 'x':
       { 
         bool is_enabled = BTNRH_alg1.setAfcEnabled(true);
@@ -145,39 +251,56 @@ bool SerialManager::processCharacter(char c) {  //this is called by SerialManage
       Serial.println("SerialManager: command received...print settings for LEFT AGC:");
       BTNRH_alg1.print_agc_params();
       break;
+    case 'c':
+      Serial.println("SerialManager: command received...print filterbank coefficients:");
+      BTNRH_alg1.print_filterbank_table();
+      break;
+    case 'C':
+      print_filterbank_cache_stats();  //see test_gha.h
+      break;
+    case 'o':
+      if (myGUI.get_nPages() < 1) createTympanRemoteLayout();
+      RemoteLayout::printAsCode(&Serial, myGUI);
+      break;
+    case 't':
+      taskScheduler.printStats(&Serial);
+      Serial.print("GUI sync: buttons sent = "); Serial.print(guiCache.n_sent); Serial.print(", changes coalesced = "); Serial.println(guiCache.n_coalesced);
+      break;
+    case 'T':
+      Serial.println("SerialManager: command received...resetting the task timing statistics.");
+      taskScheduler.resetStats();
+      break;
                 
-//    case 'a':
-//      ind = _afl; scale_fac = 5.0;
-//      old_val = BTNRH_alg1.get_cha_ivar(ind); new_val = max(0,min(150,old_val+scale_fac));
-//      BTNRH_alg1.set_cha_ivar(ind, new_val);
-//      BTNRH_alg1.set_cha_ivar(_in1, 0); //BTNRH_alg2.set_cha_ivar(_in1, 0);  //command afc_process to re-initialize its parameters
-//      BTNRH_alg1.reset_feedback_model();
-//      myTympan.print("Command received: changing AFC afl to "); myTympan.println(BTNRH_alg1.get_cha_ivar(ind));
-//      break;            
-//    case 'A':
-//      ind = _afl; scale_fac = -5.0;
-//      old_val = BTNRH_alg1.get_cha_ivar(ind); new_val = max(0,min(150,old_val+scale_fac));
-//      BTNRH_alg1.set_cha_ivar(ind, new_val);
-//      BTNRH_alg1.set_cha_ivar(_in1, 0); //BTNRH_alg2.set_cha_ivar(_in1, 0);  //command afc_process to re-initialize its parameters
-//      BTNRH_alg1.reset_feedback_model();
-//      myTympan.print("Command received: changing AFC afl to "); myTympan.println(BTNRH_alg1.get_cha_ivar(ind));
-//      break;   
-//    case 'w':
-//      ind = _wfl; scale_fac = 1.0;
-//      old_val = BTNRH_alg1.get_cha_ivar(ind); new_val = max(0,min(20,old_val+scale_fac));
-//      BTNRH_alg1.set_cha_ivar(ind, new_val);
-//      BTNRH_alg1.set_cha_ivar(_in1, 0); //BTNRH_alg2.set_cha_ivar(_in1, 0);  //command afc_process to re-initialize its parameters
-//      BTNRH_alg1.reset_feedback_model();
-//      myTympan.print("Command received: changing AFC wfl to "); myTympan.println(BTNRH_alg1.get_cha_ivar(ind));
-//      break;            
-//    case 'W':
-//      ind = _wfl; scale_fac = -1.0;
-//      old_val = BTNRH_alg1.get_cha_ivar(ind); new_val = max(0,min(20,old_val+scale_fac));
-//      BTNRH_alg1.set_cha_ivar(ind, new_val);
-//      BTNRH_alg1.set_cha_ivar(_in1, 0); //BTNRH_alg2.set_cha_ivar(_in1, 0);  //command afc_process to re-initialize its parameters
-//      BTNRH_alg1.reset_feedback_model();
-//      myTympan.print("Command received: changing AFC wfl to "); myTympan.println(BTNRH_alg1.get_cha_ivar(ind));
-//      break;  
+    case 'a':
+      new_val = BTNRH_alg1.setAfcFilterLength(_afl, BTNRH_alg1.getAfcFilterLength(_afl) + 5); //applied at the next audio block
+      myTympan.print("Command received: changing AFC afl to "); myTympan.println((int)new_val);
+      updateGUI_AFCparams_constants();
+      break;            
+    case 'A':
+      new_val = BTNRH_alg1.setAfcFilterLength(_afl, BTNRH_alg1.getAfcFilterLength(_afl) - 5); //applied at the next audio block
+      myTympan.print("Command received: changing AFC afl to "); myTympan.println((int)new_val);
+      updateGUI_AFCparams_constants();
+      break;   
+    case 'w':
+      new_val = BTNRH_alg1.setAfcFilterLength(_wfl, BTNRH_alg1.getAfcFilterLength(_wfl) + 1); //applied at the next audio block
+      myTympan.print("Command received: changing AFC wfl to "); myTympan.println((int)new_val);
+      updateGUI_AFCparams_constants();
+      break;            
+    case 'W':
+      new_val = BTNRH_alg1.setAfcFilterLength(_wfl, BTNRH_alg1.getAfcFilterLength(_wfl) - 1); //applied at the next audio block
+      myTympan.print("Command received: changing AFC wfl to "); myTympan.println((int)new_val);
+      updateGUI_AFCparams_constants();
+      break;  
+    case 'l':
+      new_val = BTNRH_alg1.setAfcFilterLength(_pfl, BTNRH_alg1.getAfcFilterLength(_pfl) + 2); //applied at the next audio block
+      myTympan.print("Command received: changing AFC pfl to "); myTympan.println((int)new_val);
+      updateGUI_AFCparams_constants();
+      break;            
+    case 'L':
+      new_val = BTNRH_alg1.setAfcFilterLength(_pfl, BTNRH_alg1.getAfcFilterLength(_pfl) - 2); //applied at the next audio block
+      myTympan.print("Command received: changing AFC pfl to "); myTympan.println((int)new_val);
+      updateGUI_AFCparams_constants();
+      break;  
                
     case 'm':
       ind = _mu; scale_fac = 2.0f;
@@ -227,7 +350,19 @@ bool SerialManager::processCharacter(char c) {  //this is called by SerialManage
       break;
     case 'q':
       Serial.println("SerialManager: command received...reseting LEFT AFC feedback model...");
-      for (int i=0; i<40; i++) {  BTNRH_alg1.reset_feedback_model(); delay(5); } //reset multiple times     
+      BTNRH_alg1.reset_feedback_model();  //the audio thread does the full reset at its next block
+      break;
+    case 'y':
+      if (audioSDWriter.getState() == AudioSDWriter::STATE::RECORDING) {
+        Serial.println("SerialManager: command received...*** cannot save the AFC model while recording to the SD card ***");
+      } else if (sdReplay.isBusy()) {
+        Serial.println("SerialManager: command received...*** cannot save the AFC model while replaying a recording ***");
+      } else {
+        Serial.print("SerialManager: command received...saving the AFC model to SD: "); Serial.println(afcModelStore.getErrorString(afcModelStore.saveModel(BTNRH_alg1)));
+      }
+      break;
+    case 'Y':
+      Serial.print("SerialManager: command received...restoring the AFC model from SD: "); Serial.println(afcModelStore.getErrorString(afcModelStore.restoreModel(BTNRH_alg1)));
       break;
     case 'Q':
       //Serial.println("SerialManager: command received...reseting RIGHT AFC feedback model...");
@@ -286,6 +421,69 @@ bool SerialManager::processCharacter(char c) {  //this is called by SerialManage
   return ret_val;
 }
 
+//processCharacterTriple: the SD writer's commands (from the App's SD card, or typed) come here rather than to
+//processCharacter().  The SD writer can't start recording while a replay is using the card.
+bool SerialManager::processCharacterTriple(char mode_char, char chan_char, char data_char) {
+  if ((mode_char == audioSDWriter.getIDchar()) && (data_char == 'r') && sdReplay.isBusy()) {
+    Serial.println("SerialManager: command received...*** cannot start recording while replaying a recording ***");
+    return true;
+  }
+  return SerialManagerBase::processCharacterTriple(mode_char, chan_char, data_char);
+}
+
+//receiveByte: bytes that belong to a binary frame go to the frame parser.  All others are normal commands.
+//The frames come as raw bytes over USB, and as hex text over BLE (see BinaryFrame.h).
+void SerialManager::receiveByte(char c, bool from_ble) {
+  BinaryFrameParser &frame = from_ble ? bleFrames : usbFrames;
+  bool is_frame = from_ble ? frame.consumeHex(c, millis()) : frame.consume((uint8_t)c, millis());
+  if (!is_frame) { respondToByte(c); return; }
+  if (frame.available()) { processFrame(frame, from_ble); frame.release(); }
+}
+
+void SerialManager::processFrame(BinaryFrameParser &frame, bool from_ble) {
+  int err;
+  FixedBuf<64> reply;
+  switch (frame.type) {
+    case 'P':
+      err = applyUploadedPrescription(frame.payload, frame.length, BTNRH_alg1);  //see PrescriptionUpload.h
+      if (err == PRESCRIPTION_UPLOAD_OK) {
+        presetManager.curPreset = -1;  //no longer running a saved preset
+        sendReply("ACK P 0", from_ble);
+      } else {
+        reply.print("NAK P "); reply.print(err);
+        sendReply(reply.c_str(), from_ble);
+      }
+      break;
+    case 'S':
+      {
+        int bad_record; bool changed_prescription;
+        err = applyBatchCommand(frame.payload, frame.length, BTNRH_alg1, &bad_record, &changed_prescription);  //see BatchCommand.h
+        if (err >= 0) {
+          if (changed_prescription) { presetManager.curPreset = -1; updateGUI_preset(); }  //no longer running a saved preset
+          updateGUI_gain(); updateGUI_AFCenabled(); updateGUI_AFCparams(); updateGUI_AFCparams_constants();  //only the changes are sent
+          reply.print("ACK S "); reply.print(err);
+        } else {
+          reply.print("NAK S "); reply.print(err); reply.print(' '); reply.print(bad_record);
+        }
+        sendReply(reply.c_str(), from_ble);
+      }
+      break;
+    case '?':
+      reply.print("ACK ? "); reply.print((int)sizeof(BTNRH_WDRC::CHA_DSL2)); reply.print(' ');
+      reply.print((int)sizeof(BTNRH_WDRC::CHA_WDRC2)); reply.print(' '); reply.print((int)sizeof(BTNRH_WDRC::CHA_AFC));
+      sendReply(reply.c_str(), from_ble);
+      break;
+    default:
+      reply.print("NAK "); reply.print((char)frame.type); reply.print(" unknown");
+      sendReply(reply.c_str(), from_ble);
+      break;
+  }
+}
+
+void SerialManager::sendReply(const char *s, bool from_ble) {
+  if (from_ble) { bleSendMessage(ble, s); } else { Serial.println(s); }
+}
+
 void SerialManager::printFeedbackCoeff(AudioEffectBTNRH_F32 &alg) {
   int n_coeff = alg.get_cha_ivar(_afl);
   float *efbp = (float *)(alg.cp[_efbp]);
@@ -334,14 +532,20 @@ void SerialManager::createTympanRemoteLayout(void) {
       card_h->addButton("-","R","",2);card_h->addButton("","","valRho",8);card_h->addButton("+","r","",2);
 
     card_h = page_h->addCard("Constants");
-      card_h->addButton("AFL","","",4); card_h->addButton("","","valAFL",8);
-      card_h->addButton("WFL","","",4); card_h->addButton("","","valWFL",8);
-      card_h->addButton("PFL","","",4); card_h->addButton("","","valPFL",8);
+      card_h->addButton("AFL","","",4); card_h->addButton("-","A","",2); card_h->addButton("","","valAFL",4); card_h->addButton("+","a","",2);
+      card_h->addButton("WFL","","",4); card_h->addButton("-","W","",2); card_h->addButton("","","valWFL",4); card_h->addButton("+","w","",2);
+      card_h->addButton("PFL","","",4); card_h->addButton("-","L","",2); card_h->addButton("","","valPFL",4); card_h->addButton("+","l","",2);
       card_h->addButton("FBL","","",4); card_h->addButton("","","valFBL",8);
       card_h->addButton("HDEL","","",4); card_h->addButton("","","valHDEL",8);
       card_h->addButton("ALF","","",4); card_h->addButton("","","valALF",8);
 
      
+  page_h = myGUI.addPage("Presets");
+    card_h = page_h->addCard("Preset (SD Card)");
+      card_h->addButton("-","N","",2); card_h->addButton("","","presetName",8); card_h->addButton("+","n","",2);
+    card_h = page_h->addCard("Save Running Prescription");
+      card_h->addButton("Save as New Preset","V","",12);
+
   //Add second page for more control of earpieces...such as front-back delay and front-back gain
   //page_h = earpieceMixer.addPage_digitalEarpieces(&myGUI); //use its predefined page for controlling the digital earpieces
 
@@ -351,13 +555,45 @@ void SerialManager::createTympanRemoteLayout(void) {
 }
 
 
-// Print the layout for the Tympan Remote app, in a JSON-ish string
+// Print the layout for the Tympan Remote app, in a JSON-ish string.  It is sent by serviceLayout(), from loop().
 void SerialManager::printTympanRemoteLayout(void) {
-    if (myGUI.get_nPages() < 1) createTympanRemoteLayout();  //create the GUI, if it hasn't already been created
-    String s = myGUI.asString();
-    Serial.println(s);
-    ble->sendMessage(s); //ble is held by SerialManagerBase
-    setFullGUIState();
+    prepareLayout();
+    if (layout_too_long) {
+      //tell the App why it only has the serial monitor (it shows this message there)
+      Serial.println("SerialManager: the App layout is too long for REMOTE_LAYOUT_MAX_LEN.  Sending the serial monitor only.");
+      bleSendMessage(ble, "Tympan: the App layout is too long.  Increase REMOTE_LAYOUT_MAX_LEN.");
+    }
+    if (layout.isReady()) {
+      layout.startSending();
+    } else {
+      //nothing to send, but the App still needs the state of its buttons
+      guiCache.forgetSent();
+      setFullGUIState();
+    }
+}
+
+void SerialManager::prepareLayout(void) {
+  if (layout.isReady() || layout_too_long) return;  //(don't make it again, to find again that it doesn't fit)
+#ifndef GHA_HAVE_REMOTE_LAYOUT
+  if (myGUI.get_nPages() < 1) createTympanRemoteLayout();  //create the GUI, if it hasn't already been created
+#endif
+  if (layout.build(myGUI)) return;
+
+  //too long for the buffer, so fall back to a layout with just the serial monitor
+  layout_too_long = true;
+  TympanRemoteFormatter fallbackGUI;
+  fallbackGUI.addPredefinedPage("serialMonitor");
+  layout.build(fallbackGUI);
+}
+
+bool SerialManager::serviceLayout(void) {
+  if (!layout.isSending()) return false;
+  if (layout.service(&Serial, ble)) return true;  //ble is held by SerialManagerBase
+
+  //the App has the whole layout now, so it needs the state of every button
+  guiCache.forgetSent();
+  setFullGUIState();
+  return false;
 }
 
 // //////////////////////////////////  Methods for updating the display on the GUI
@@ -372,26 +608,32 @@ void SerialManager::setFullGUIState(bool activeButtonsOnly) {  //the "activeButt
   updateGUI_AFCparams();
   updateGUI_AFCenabled();
   updateGUI_AFCparams_constants();
+  updateGUI_preset();
 }
 
 void SerialManager::updateGUI_gain(void) {
-  setButtonText("digGain",String(myState.digital_gain_dB,1)); //button name, new button text
+  guiCache.setText("digGain",myState.digital_gain_dB,1); //button name, new button text
 }
 void SerialManager::updateGUI_AFCenabled(void) {
-  setButtonState("afcOn",BTNRH_alg1.getAfcEnabled());
-  setButtonState("afcOff",!BTNRH_alg1.getAfcEnabled());
+  guiCache.setState("afcOn",BTNRH_alg1.getAfcEnabled());
+  guiCache.setState("afcOff",!BTNRH_alg1.getAfcEnabled());
 }
 void SerialManager::updateGUI_AFCparams(void) {
-  setButtonText("valMu",String((float)(BTNRH_alg1.get_cha_dvar(_mu)),8));    //button name, new button text
-  setButtonText("valEps",String((float)(BTNRH_alg1.get_cha_dvar(_eps)),8));  //button name, new button text
-  setButtonText("valRho",String((float)(BTNRH_alg1.get_cha_dvar(_rho)),8));  //button name, new button text
+  guiCache.setText("valMu",(float)(BTNRH_alg1.get_cha_dvar(_mu)),8);    //button name, new button text
+  guiCache.setText("valEps",(float)(BTNRH_alg1.get_cha_dvar(_eps)),8);  //button name, new button text
+  guiCache.setText("valRho",(float)(BTNRH_alg1.get_cha_dvar(_rho)),8);  //button name, new button text
 }
 void SerialManager::updateGUI_AFCparams_constants(void) {
-  setButtonText("valAFL",String((float)(BTNRH_alg1.get_cha_ivar(_afl)),0));  //button name, new button text
-  setButtonText("valWFL",String((float)(BTNRH_alg1.get_cha_ivar(_wfl)),0));  //button name, new button text
-  setButtonText("valPFL",String((float)(BTNRH_alg1.get_cha_ivar(_pfl)),0));  //button name, new button text
-  setButtonText("valFBL",String((float)(BTNRH_alg1.get_cha_ivar(_fbl)),0));  //button name, new button text
-  setButtonText("valHDEL",String((float)(BTNRH_alg1.get_cha_ivar(_hdel)),0));  //button name, new button text
-  setButtonText("valALF",String((float)(BTNRH_alg1.get_cha_dvar(_alf)),8));  //button name, new button text
+  guiCache.setText("valAFL",(float)(BTNRH_alg1.getAfcFilterLength(_afl)),0);  //button name, new button text
+  guiCache.setText("valWFL",(float)(BTNRH_alg1.getAfcFilterLength(_wfl)),0);  //button name, new button text
+  guiCache.setText("valPFL",(float)(BTNRH_alg1.getAfcFilterLength(_pfl)),0);  //button name, new button text
+  guiCache.setText("valFBL",(float)(BTNRH_alg1.get_cha_ivar(_fbl)),0);  //button name, new button text
+  guiCache.setText("valHDEL",(float)(BTNRH_alg1.get_cha_ivar(_hdel)),0);  //button name, new button text
+  guiCache.setText("valALF",(float)(BTNRH_alg1.get_cha_dvar(_alf)),8);  //button name, new button text
+}
+void SerialManager::updateGUI_preset(void) {
+  char name[GHA_PRESET_NAME_LEN] = "(none)";
+  if (presetManager.curPreset >= 0) presetManager.getPresetName(presetManager.curPreset, name);
+  guiCache.setText("presetName",name);  //button name, new button text
 }
 #endif
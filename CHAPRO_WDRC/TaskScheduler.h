@@ -0,0 +1,151 @@
+/*
+   TaskScheduler
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Small cooperative scheduler for the services that loop() has to call.  Each task declares how
+            often it wants to run (its period) and how long it may run each time (its budget).  A task that
+            has a long job (eg, sending the feedback model over BLE) does a piece of it, checks taskShouldYield(),
+            and returns true if it has more to do, so that it is called again on the next pass instead of
+            holding up the others.  Tasks marked "urgent" (eg, SD servicing) are checked before every other
+            task, so that one slow task can't starve them.
+
+            For every task, the scheduler keeps the number of runs, the worst and average run times, the
+            number of runs that went over budget, and the worst latency (how late it ran, relative to when
+            it was due).
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _TaskScheduler_h
+#define _TaskScheduler_h
+
+#include <Arduino.h>
+
+class TaskScheduler;
+TaskScheduler *activeTaskScheduler = NULL;  //the scheduler that is running a task right now (if any)
+
+class TaskScheduler {
+  public:
+    typedef bool (*TaskFunc)(void);  //return true if the task has more work to do right away
+    static const int MAX_TASKS = 16;
+
+    //add a task.  Returns its index, or -1 if there is no room
+    int addTask(const char *name, TaskFunc func, unsigned long period_millis, unsigned long budget_usec, bool urgent = false);
+    void run(void);  //call from loop()
+
+    bool shouldYield(void);  //for the running task: has it used up its budget?
+    void printStats(Print *s);
+    void resetStats(void);
+
+  protected:
+    typedef struct {
+      const char *name;
+      TaskFunc func;
+      unsigned long period_millis, budget_usec;
+      bool urgent;
+      bool more_work;               //the task asked to be called again as soon as possible
+      unsigned long lastRun_millis;
+      unsigned long n_runs, n_overruns;
+      unsigned long max_run_usec, total_run_usec;
+      unsigned long max_latency_millis;
+    } Task;
+    Task tasks[MAX_TASKS];
+    int n_tasks = 0;
+    int cur_task = -1;
+    unsigned long curTaskStart_micros = 0;
+
+    bool isDue(Task &t, unsigned long now_millis) { return t.more_work || ((now_millis - t.lastRun_millis) >= t.period_millis); }
+    void runTask(int i, unsigned long now_millis);
+    void runUrgentTasks(void);
+};
+
+//taskShouldYield: for use inside long jobs.  Returns false if no scheduler is running the caller.
+bool taskShouldYield(void) {
+  if (activeTaskScheduler == NULL) return false;
+  return activeTaskScheduler->shouldYield();
+}
+
+int TaskScheduler::addTask(const char *name, TaskFunc func, unsigned long period_millis, unsigned long budget_usec, bool urgent) {
+  if (n_tasks >= MAX_TASKS) return -1;
+  Task &t = tasks[n_tasks];
+  memset(&t, 0, sizeof(Task));
+  t.name = name;
+  t.func = func;
+  t.period_millis = period_millis;
+  t.budget_usec = budget_usec;
+  t.urgent = urgent;
+  t.lastRun_millis = millis();
+  return n_tasks++;
+}
+
+void TaskScheduler::run(void) {
+  unsigned long now_millis = millis();
+  for (int i=0; i < n_tasks; i++) {
+    if (tasks[i].urgent || !isDue(tasks[i], now_millis)) continue;
+    runUrgentTasks();  //before every normal task, so that no normal task can delay them by more than one run
+    runTask(i, millis());
+    now_millis = millis();
+  }
+  runUrgentTasks();
+}
+
+void TaskScheduler::runUrgentTasks(void) {
+  unsigned long now_millis = millis();
+  for (int i=0; i < n_tasks; i++) {
+    if (tasks[i].urgent && isDue(tasks[i], now_millis)) runTask(i, now_millis);
+  }
+}
+
+void TaskScheduler::runTask(int i, unsigned long now_millis) {
+  Task &t = tasks[i];
+
+  //how late is it?  (a task that is continuing its work is not late)
+  if (!t.more_work && (t.n_runs > 0)) {
+    unsigned long latency_millis = (now_millis - t.lastRun_millis) - t.period_millis;
+    if (latency_millis > t.max_latency_millis) t.max_latency_millis = latency_millis;
+  }
+
+  //run it
+  TaskScheduler *prev = activeTaskScheduler;
+  activeTaskScheduler = this;
+  cur_task = i;
+  curTaskStart_micros = micros();
+  t.more_work = t.func();
+  unsigned long dur_usec = micros() - curTaskStart_micros;
+  cur_task = -1;
+  activeTaskScheduler = prev;
+
+  //keep score
+  t.lastRun_millis = now_millis;
+  t.n_runs++;
+  t.total_run_usec += dur_usec;
+  if (dur_usec > t.max_run_usec) t.max_run_usec = dur_usec;
+  if (dur_usec > t.budget_usec) t.n_overruns++;
+}
+
+bool TaskScheduler::shouldYield(void) {
+  if (cur_task < 0) return false;
+  return (micros() - curTaskStart_micros) >= tasks[cur_task].budget_usec;
+}
+
+void TaskScheduler::printStats(Print *s) {
+  s->println("TaskScheduler: name: period (msec), budget (usec): runs, avg/max run (usec), overruns, max latency (msec)");
+  for (int i=0; i < n_tasks; i++) {
+    Task &t = tasks[i];
+    unsigned long avg_usec = (t.n_runs > 0) ? (t.total_run_usec / t.n_runs) : 0;
+    s->print("  "); s->print(t.name); s->print(t.urgent ? " (urgent): " : ": ");
+    s->print(t.period_millis); s->print(", "); s->print(t.budget_usec); s->print(": ");
+    s->print(t.n_runs); s->print(", "); s->print(avg_usec); s->print("/"); s->print(t.max_run_usec); s->print(", ");
+    s->print(t.n_overruns); s->print(", "); s->println(t.max_latency_millis);
+  }
+}
+
+void TaskScheduler::resetStats(void) {
+  for (int i=0; i < n_tasks; i++) {
+    Task &t = tasks[i];
+    t.n_runs = 0; t.n_overruns = 0; t.max_run_usec = 0; t.total_run_usec = 0; t.max_latency_millis = 0;
+  }
+}
+
+#endif
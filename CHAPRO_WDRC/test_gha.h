@@ -24,8 +24,10 @@ typedef struct
 
 //static char msg[MAX_MSG] = {0};
 static double srate = 24000; // sampling rate (Hz)
-static int chunk = 8;        // chunk size   (WEA: This was 32.  I switched to 8 to lower the system's latency.)
+#define GHA_CHUNK 8         // chunk size, as a compile-time constant (see GhaChain.h)
+static int chunk = GHA_CHUNK; // chunk size   (WEA: This was 32.  I switched to 8 to lower the system's latency.)
 static int prepared = 0;
+static int gha_verbose = 1;  // set to 0 to silence the progress messages from prepare() (eg, while booting)
 
 // ////////////// Old method
 //static CHA_AFC afc = {0};
@@ -50,6 +52,54 @@ CHA_AFC afc_global = {     // Here are the settings for the adaptive feedback ca
   8                 //pup, band-limit update period
 };  //the rest of the parameters are assumed zero and will be set by the rest of the code
 
+// Maximum AFC filter lengths.  cha_afc_prepare() sizes the AFC buffers from the lengths that it is given,
+// so we prepare it at these maximums and then run at the configured lengths.  This way, afl, wfl, and pfl
+// can be changed at runtime (up to these limits) without re-preparing or re-allocating anything.
+#define AFC_MAX_AFL 150     //max adaptive filter length
+#define AFC_MAX_WFL 20      //max whiten filter length
+#define AFC_MAX_PFL 64      //max band-limit filter length
+#define AFC_MAX_FBL 150     //max simulated-feedback length (sizes _sfbp and, with afl and hdel, the ring buffers)
+#define AFC_MAX_HDEL 512    //max hardware delay, in samples (21 msec at 24 kHz)
+
+// Largest filterbank that prepare_filterbank() can hold (it designs into fixed-size arrays), and its order
+#define FB_CACHE_MXCH  8   // channels
+#define FB_CACHE_MXZP 64   // zeros (or poles), 2*nz*nc
+#define GHA_NZ 4           // filterbank order, nz (set in configure_compressor())
+
+// Most values of CHAPRO's own AFC quality metric (afc.sqm) to save.  CHAPRO saves one per chunk for the whole
+// run, so the buffer is capped here rather than growing with the run.  It is only allocated for a run of known
+// length (io->nsmp * io->nrep > 0, as in the host programs).  On the Tympan, which runs without end, there is no
+// buffer.  To follow the misalignment over runs of any length, in constant memory, use AfcQualityMetric.h instead.
+#define AFC_MAX_NQM 65536
+
+// Optional fixed fitting, built into the firmware at compile time.  It is off by default, so that the prescription
+// comes from GHA_Constants.h (which Daniel's controller app writes, and which 'u' reads again).  To use one, write
+// GHA_FixedFit.h next to this file, with the three structures from GHA_Constants.h renamed fixed_dsl2, fixed_gha2,
+// and fixed_afc2 and declared constexpr, and define GHA_USE_FIXED_FIT (here, or in the build flags).  The compiler
+// then translates them (see translator.h) and checks that prepare() can hold them, and they are used instead of
+// GHA_Constants.h, including by 'u'.  So, while it is on, changes to GHA_Constants.h have no effect until they are
+// copied into GHA_FixedFit.h.  (The AGC itself is still prepared by cha_agc_prepare() at boot.)  Separately, if
+// GHA_FilterbankTable.h exists (paste in the output of print_filterbank_table()), prepare_filterbank() uses its
+// coefficients instead of designing the filterbank, whenever the filterbank matches.
+//#define GHA_USE_FIXED_FIT
+#ifdef GHA_USE_FIXED_FIT
+#include "GHA_FixedFit.h"
+#define GHA_HAVE_FIXED_FIT
+static constexpr CHA_DSL fixed_dsl PROGMEM = translate_DSL(fixed_dsl2);
+static constexpr CHA_WDRC fixed_agc PROGMEM = translate_WDRC(fixed_gha2);
+static_assert((fixed_dsl.nchannel >= 1) && (fixed_dsl.nchannel <= FB_CACHE_MXCH), "GHA_FixedFit.h: too many channels for prepare_filterbank()");
+static_assert(2 * GHA_NZ * fixed_dsl.nchannel <= FB_CACHE_MXZP, "GHA_FixedFit.h: too many zeros and poles for prepare_filterbank()");
+static_assert((fixed_afc2.afl >= 0) && (fixed_afc2.afl <= AFC_MAX_AFL), "GHA_FixedFit.h: afl is out of range");
+#endif
+#if defined(__has_include)
+#if __has_include("GHA_FilterbankTable.h")
+#include "GHA_FilterbankTable.h"
+#define GHA_HAVE_FILTERBANK_TABLE
+static_assert(2 * FB_TABLE_NZ * FB_TABLE_NC <= FB_CACHE_MXZP, "GHA_FilterbankTable.h: too many zeros and poles for prepare_filterbank()");
+static_assert(FB_TABLE_NC <= FB_CACHE_MXCH, "GHA_FilterbankTable.h: too many channels for prepare_filterbank()");
+#endif
+#endif
+
 
 /***********************************************************/
 
@@ -73,7 +123,7 @@ process_chunk(CHA_PTR cp, float *x, float *y, int cs)
     }
 }
 
-// prepare input/output
+// prepare input/output (for WAV files on a desktop, see host/gha_wav.cpp, which streams them through process_chunk())
 
 static int
 prepare_io(I_O *io)
@@ -95,70 +145,440 @@ prepare_io(I_O *io)
     return (0);
 }
 
-// prepare IIR filterbank
+#ifdef GHA_HAVE_FILTERBANK_TABLE
+// are the compiled-in coefficients (GHA_FilterbankTable.h) the ones that this filterbank needs?
+static int
+filterbank_table_matches(double *cf, int nc, int nz, double sr, double td)
+{
+    int k;
+
+    if ((nc != FB_TABLE_NC) || (nz != FB_TABLE_NZ) || (sr != fb_table_sr) || (td != fb_table_td)) return (0);
+    for (k = 0; k < nc - 1; k++) {
+        if (cf[k] != fb_table_cf[k]) return (0);
+    }
+    return (1);
+}
+#endif
+
+// design the IIR filterbank and print its coefficients in the format of GHA_FilterbankTable.h
+
+static void
+print_filterbank_table(CHA_DSL *dsl, CHA_WDRC *agc)
+{
+    float z[64], p[64], g[8];
+    int d[8];
+    int k, nc = dsl->nchannel, nz = agc->nz;
+
+    if ((nc < 1) || (nc > 8) || (2 * nz * nc > 64)) {
+        printf("test_gha: print_filterbank_table: nc=%d, nz=%d is too big\n", nc, nz);
+        return;
+    }
+    cha_iirfb_design(z, p, g, d, dsl->cross_freq, nc, nz, srate, agc->td);
+    printf("// GHA_FilterbankTable.h: filterbank coefficients, computed ahead of time by print_filterbank_table()\n");
+    printf("#define FB_TABLE_NC %d\n", nc);
+    printf("#define FB_TABLE_NZ %d\n", nz);
+    printf("static const double fb_table_sr = %.17g;\n", srate);
+    printf("static const double fb_table_td = %.17g;\n", agc->td);
+    printf("static const double fb_table_cf[] PROGMEM = {");
+    for (k = 0; k < nc - 1; k++) printf("%s%.17g", k ? ", " : "", dsl->cross_freq[k]);
+    if (nc < 2) printf("0");  // keep the array from being empty
+    printf("};\n");
+    printf("static const float fb_table_z[] PROGMEM = {");
+    for (k = 0; k < 2 * nz * nc; k++) printf("%s%.9g", k ? ", " : "", z[k]);
+    printf("};\n");
+    printf("static const float fb_table_p[] PROGMEM = {");
+    for (k = 0; k < 2 * nz * nc; k++) printf("%s%.9g", k ? ", " : "", p[k]);
+    printf("};\n");
+    printf("static const float fb_table_g[] PROGMEM = {");
+    for (k = 0; k < nc; k++) printf("%s%.9g", k ? ", " : "", g[k]);
+    printf("};\n");
+    printf("static const int fb_table_d[] PROGMEM = {");
+    for (k = 0; k < nc; k++) printf("%s%d", k ? ", " : "", d[k]);
+    printf("};\n");
+}
+
+// Filterbank design cache.  cha_iirfb_design() is a double-precision pole/zero design that only depends on
+// (cross_freq[], nc, nz, sr, td), which rarely change between fittings.  So keep the most recent designs in RAM
+// and re-use them.  FilterbankCacheStore.h can also save the cache to the SD card and load it back after boot, so
+// that the designs from earlier sessions are re-used, too.
+
+#define FB_CACHE_SIZE  4   // number of designs kept in RAM (each up to FB_CACHE_MXCH channels, see above)
+
+typedef struct
+{
+    int32_t nc, nz;
+    double sr, td;
+    double cf[FB_CACHE_MXCH];
+    float z[FB_CACHE_MXZP], p[FB_CACHE_MXZP], g[FB_CACHE_MXCH];
+    int32_t d[FB_CACHE_MXCH];
+    uint32_t design_usec;    // how long the design took, when it was made
+} FB_DESIGN;
+
+static FB_DESIGN fb_cache[FB_CACHE_SIZE];
+static int fb_cache_n = 0;            // number of valid entries
+static int fb_cache_next = 0;         // entry to replace next (oldest first)
+static int fb_cache_dirty = 0;        // set when a new design is added, so that it can be saved
+static unsigned long fb_cache_hits = 0, fb_cache_misses = 0;
+static unsigned long fb_cache_saved_usec = 0;  // design time that the hits have saved
+
+static int
+fb_cache_key_matches(FB_DESIGN *e, double *cf, int nc, int nz, double sr, double td)
+{
+    int k;
+
+    if ((e->nc != nc) || (e->nz != nz) || (e->sr != sr) || (e->td != td)) return (0);
+    for (k = 0; k < nc - 1; k++) {
+        if (e->cf[k] != cf[k]) return (0);
+    }
+    return (1);
+}
+
+// look for a matching design.  Returns 1 (and fills z, p, g, d) if it was found.
+
+static int
+fb_cache_lookup(float *z, float *p, float *g, int *d, double *cf, int nc, int nz, double sr, double td)
+{
+    FB_DESIGN *e;
+    int i, k;
+
+    for (i = 0; i < fb_cache_n; i++) {
+        e = &fb_cache[i];
+        if (!fb_cache_key_matches(e, cf, nc, nz, sr, td)) continue;
+        memcpy(z, e->z, 2 * nz * nc * sizeof(float));
+        memcpy(p, e->p, 2 * nz * nc * sizeof(float));
+        memcpy(g, e->g, nc * sizeof(float));
+        for (k = 0; k < nc; k++) d[k] = e->d[k];
+        fb_cache_hits++;
+        fb_cache_saved_usec += e->design_usec;
+        return (1);
+    }
+    fb_cache_misses++;
+    return (0);
+}
+
+static void
+fb_cache_store(float *z, float *p, float *g, int *d, double *cf, int nc, int nz, double sr, double td, uint32_t design_usec)
+{
+    FB_DESIGN *e = &fb_cache[fb_cache_next];
+    int k;
+
+    if ((nc > FB_CACHE_MXCH) || (2 * nz * nc > FB_CACHE_MXZP)) return;
+    memset(e, 0, sizeof(FB_DESIGN));
+    e->nc = nc;
+    e->nz = nz;
+    e->sr = sr;
+    e->td = td;
+    for (k = 0; k < nc - 1; k++) e->cf[k] = cf[k];
+    memcpy(e->z, z, 2 * nz * nc * sizeof(float));
+    memcpy(e->p, p, 2 * nz * nc * sizeof(float));
+    memcpy(e->g, g, nc * sizeof(float));
+    for (k = 0; k < nc; k++) e->d[k] = d[k];
+    e->design_usec = design_usec;
+    fb_cache_next = (fb_cache_next + 1) % FB_CACHE_SIZE;
+    if (fb_cache_n < FB_CACHE_SIZE) fb_cache_n++;
+    fb_cache_dirty = 1;
+}
+
 static void
-prepare_filterbank(CHA_PTR cp)
+print_filterbank_cache_stats(void)
+{
+    printf("test_gha: filterbank design cache: %d of %d entries, %lu hits, %lu misses, %lu usec of design time saved\n",
+        fb_cache_n, FB_CACHE_SIZE, fb_cache_hits, fb_cache_misses, fb_cache_saved_usec);
+}
+
+// Can prepare() hold this prescription?  The filterbank goes through the fixed-size arrays in prepare_filterbank(),
+// and the AFC lengths must be within the maximums above.  Returns NULL if it fits, or else the reason why not.
+// Check any prescription from outside the firmware (a preset file, an upload) with this before preparing it.
+
+static const char *
+prescription_check_sizes(const CHA_DSL *dsl, const CHA_WDRC *agc, const CHA_AFC *afc)
+{
+    int nc = dsl->nchannel, nz = agc->nz;
+
+    if ((nc < 1) || (nc > FB_CACHE_MXCH)) return "too many channels for prepare_filterbank()";
+    if ((nz < 1) || (2 * nz * nc > FB_CACHE_MXZP)) return "too high a filter order for prepare_filterbank()";
+    if ((afc->afl < 0) || (afc->afl > AFC_MAX_AFL)) return "afl is out of range";
+    if ((afc->wfl < 0) || (afc->wfl > AFC_MAX_WFL)) return "wfl is out of range";
+    if ((afc->pfl < 0) || (afc->pfl > AFC_MAX_PFL)) return "pfl is out of range";
+    if ((afc->fbl < 0) || (afc->fbl > AFC_MAX_FBL)) return "fbl is out of range";
+    if ((afc->hdel < 0) || (afc->hdel > AFC_MAX_HDEL)) return "hdel is out of range";
+    return (NULL);
+}
+
+// prepare IIR filterbank.  Returns 0, or -1 (without preparing anything) if the filterbank doesn't fit the
+// arrays below.  (Prescriptions from outside the firmware are checked before now, with prescription_check_sizes().)
+static int
+prepare_filterbank(CHA_PTR cp, CHA_DSL *dsl, CHA_WDRC *agc)
 {
     double td, sr, *cf;
     int cs, nc, nz;
     // zeros, poles, gains, & delays
-    float z[64], p[64], g[8];
-    int d[8];
+    float z[FB_CACHE_MXZP], p[FB_CACHE_MXZP], g[FB_CACHE_MXCH];
+    int d[FB_CACHE_MXCH];
+    uint32_t t0;
 
     sr = srate;
     cs = chunk;
     // prepare IIRFB
-    nc = dsl_global.nchannel;
-    cf = dsl_global.cross_freq;
-    nz = agc_global.nz;
-    td = agc_global.td;
-    printf("test_gha: prepare_filterbank: sr=%0.0f, cs=%d, nc=%d, nz=%d, td=%0.2f\n",sr,cs,nc,nz,td);  //added WEA
-    cha_iirfb_design(z, p, g, d, cf, nc, nz, sr, td); //see iirfb_design.c
+    nc = dsl->nchannel;
+    cf = dsl->cross_freq;
+    nz = agc->nz;
+    td = agc->td;
+    if ((nc < 1) || (nc > FB_CACHE_MXCH) || (nz < 1) || (2 * nz * nc > FB_CACHE_MXZP)) {
+        printf("test_gha: prepare_filterbank: nc=%d, nz=%d is more than can be held.  Not prepared.\n",nc,nz);
+        return (-1);
+    }
+    if (gha_verbose) printf("test_gha: prepare_filterbank: sr=%0.0f, cs=%d, nc=%d, nz=%d, td=%0.2f\n",sr,cs,nc,nz,td);  //added WEA
+#ifdef GHA_HAVE_FILTERBANK_TABLE
+    if (filterbank_table_matches(cf, nc, nz, sr, td)) {
+        // use the coefficients that were computed ahead of time
+        memcpy(z, fb_table_z, sizeof(fb_table_z));
+        memcpy(p, fb_table_p, sizeof(fb_table_p));
+        memcpy(g, fb_table_g, sizeof(fb_table_g));
+        memcpy(d, fb_table_d, sizeof(fb_table_d));
+        if (gha_verbose) printf("test_gha: prepare_filterbank: using the compiled-in filterbank coefficients\n");
+    } else
+#endif
+    if (fb_cache_lookup(z, p, g, d, cf, nc, nz, sr, td)) {
+        if (gha_verbose) printf("test_gha: prepare_filterbank: using the cached filterbank design\n");
+    } else {
+        t0 = micros();
+        cha_iirfb_design(z, p, g, d, cf, nc, nz, sr, td); //see iirfb_design.c
+        fb_cache_store(z, p, g, d, cf, nc, nz, sr, td, micros() - t0);
+    }
     cha_iirfb_prepare(cp, z, p, g, d, nc, nz, sr, cs);
-    printf("test_gha: prepare_filterbank complete.\n");  // added WEA
+    if (gha_verbose) printf("test_gha: prepare_filterbank complete.\n");  // added WEA
+    return (0);
 }
 
 // prepare AGC compressor
 
 static void
-prepare_compressor(CHA_PTR cp)
+prepare_compressor(CHA_PTR cp, CHA_DSL *dsl, CHA_WDRC *agc)
 {
     // prepare AGC
-    cha_agc_prepare(cp, &dsl_global, &agc_global);
+    cha_agc_prepare(cp, dsl, agc);
 }
 
-// prepare feedback
+// change the AFC filter lengths of an already-prepared AFC (must be called between chunks)
 
 static void
-prepare_feedback(CHA_PTR cp)
+set_afc_lengths(CHA_PTR cp, int afl, int wfl, int pfl)
 {
-    // prepare AFC
-    cha_afc_prepare(cp, &afc_global);
+    float *efbp = (float *)cp[_efbp];
+    float *wfrp = (float *)cp[_wfrp];
+    float *ffrp = (float *)cp[_ffrp];
+    int i;
+
+    afl = (afl < 0) ? 0 : ((afl > AFC_MAX_AFL) ? AFC_MAX_AFL : afl);
+    wfl = (wfl < 0) ? 0 : ((wfl > AFC_MAX_WFL) ? AFC_MAX_WFL : wfl);
+    pfl = (pfl < 0) ? 0 : ((pfl > AFC_MAX_PFL) ? AFC_MAX_PFL : pfl);
+
+    // zero any coefficients beyond the new lengths so that a later increase starts them from zero.
+    // The coefficients within the new lengths are kept so that the model does not need to re-converge.
+    if (efbp) for (i = afl; i < AFC_MAX_AFL; i++) efbp[i] = 0;
+    if (wfrp) for (i = wfl; i < AFC_MAX_WFL; i++) wfrp[i] = 0;
+    if (ffrp) for (i = pfl; i < AFC_MAX_PFL; i++) ffrp[i] = 0;
+
+    CHA_IVAR[_afl] = afl;
+    CHA_IVAR[_wfl] = wfl;
+    CHA_IVAR[_pfl] = pfl;
+    CHA_IVAR[_in1] = 0;  // command afc_process to re-initialize its parameters
 }
 
-// prepare signal processing
+// CHAPRO pointer indices that hold the adapted AFC state (see CHAPRO's afc_prepare.c): the signal history (the
+// ring buffers), the feedback-path estimate, the whiten and band-limit filters (CHAPRO adapts both as it runs, see
+// alf and pup), and their histories.  Not the simulated feedback path (_sfbp) or the quality metric (_qm).
+static const int afc_state_ptrs[] = {_rng0, _rng1, _rng2, _rng3, _efbp, _wfrp, _ffrp, _wfbp, _ffzp};
+
+// The whiten and band-limit filters as cha_afc_prepare() left them, before any adaptation, so that
+// reset_feedback() can put them back.  Take one with save_afc_design() right after prepare_feedback().
+typedef struct {
+    float wfrp[AFC_MAX_WFL];
+    float ffrp[AFC_MAX_PFL];
+} AFC_DESIGN;
 
 static void
+save_afc_design(CHA_PTR cp, AFC_DESIGN *d)
+{
+    int *psiz = (int *)cp[_size];
+
+    memset(d, 0, sizeof(AFC_DESIGN));
+    if (!psiz) return;
+    if (cp[_wfrp]) memcpy(d->wfrp, cp[_wfrp], (psiz[_wfrp] < (int)sizeof(d->wfrp)) ? psiz[_wfrp] : sizeof(d->wfrp));
+    if (cp[_ffrp]) memcpy(d->ffrp, cp[_ffrp], (psiz[_ffrp] < (int)sizeof(d->ffrp)) ? psiz[_ffrp] : sizeof(d->ffrp));
+}
+
+// reset the adapted state of an already-prepared AFC (must be called between chunks).  The whiten and band-limit
+// filters go back to the design d (from save_afc_design()), at their current lengths, so the AFC starts again
+// from where cha_afc_prepare() left it.  If d is NULL, they are zeroed like the rest.
+
+static void
+reset_feedback(CHA_PTR cp, const AFC_DESIGN *d)
+{
+    int *psiz = (int *)cp[_size];  // allocation sizes (bytes) recorded by cha_allocate()
+    float *wfrp = (float *)cp[_wfrp], *ffrp = (float *)cp[_ffrp];
+    int i, k;
+
+    for (i = 0; i < (int)(sizeof(afc_state_ptrs) / sizeof(afc_state_ptrs[0])); i++) {
+        k = afc_state_ptrs[i];
+        if (cp[k] && psiz) memset(cp[k], 0, psiz[k]);
+    }
+    if (d && wfrp) for (i = 0; (i < CHA_IVAR[_wfl]) && (i < AFC_MAX_WFL); i++) wfrp[i] = d->wfrp[i];
+    if (d && ffrp) for (i = 0; (i < CHA_IVAR[_pfl]) && (i < AFC_MAX_PFL); i++) ffrp[i] = d->ffrp[i];
+    CHA_IVAR[_in1] = 0;  // command afc_process to re-initialize its parameters
+}
+
+// copy the adapted AFC state from one prepared context to another (must be called between chunks).  The
+// feedback-path estimate is always carried over: the taps that both models have (the shorter afl), with the rest
+// of the new model zeroed, so that a change of model length (eg, with 'a'/'A') doesn't throw away the converged
+// model.  The signal history, the ring-buffer position, and the whiten and band-limit filters only make sense in a
+// context with the same chunk size, hardware delay, and ring size, so they are only copied if those match.
+// Returns 2 if everything was copied, 1 if only the estimate, else 0.
+
+static int
+copy_feedback(CHA_PTR cp_dst, CHA_PTR cp_src)
+{
+    int *dsiz = (int *)cp_dst[_size], *ssiz = (int *)cp_src[_size];
+    int *divar = (int *)cp_dst[_ivar], *sivar = (int *)cp_src[_ivar];
+    float *defbp = (float *)cp_dst[_efbp], *sefbp = (float *)cp_src[_efbp];
+    int i, k, n, n_dst, full;
+
+    if (!dsiz || !ssiz || !divar || !sivar || !defbp || !sefbp) return (0);
+    full = (divar[_cs] == sivar[_cs]) && (divar[_hdel] == sivar[_hdel]) && (dsiz[_rng0] == ssiz[_rng0]);
+    if (full) {
+        for (i = 0; i < (int)(sizeof(afc_state_ptrs) / sizeof(afc_state_ptrs[0])); i++) {
+            k = afc_state_ptrs[i];
+            if ((k != _efbp) && cp_dst[k] && cp_src[k] && (dsiz[k] == ssiz[k])) memcpy(cp_dst[k], cp_src[k], dsiz[k]);
+        }
+        // keep the ring-buffer position consistent with the copied history
+        divar[_rhd] = sivar[_rhd];
+        divar[_rtl] = sivar[_rtl];
+    }
+
+    // the estimate doesn't depend on the ring: the overlapping taps, and zeros beyond them
+    n_dst = dsiz[_efbp] / (int)sizeof(float);
+    n = (divar[_afl] < sivar[_afl]) ? divar[_afl] : sivar[_afl];
+    if (n > n_dst) n = n_dst;
+    if (n > ssiz[_efbp] / (int)sizeof(float)) n = ssiz[_efbp] / (int)sizeof(float);
+    for (i = 0; i < n_dst; i++) defbp[i] = (i < n) ? sefbp[i] : 0.0f;
+    return (full ? 2 : 1);
+}
+
+// can a change from one prescription to another skip re-preparing the filterbank and the AFC?  (ie, do the
+// two only differ in the AGC settings, such as tkgain, cr, tk, bolt, and the attack and release times?)
+
+static int
+prescription_is_agc_only_change(CHA_DSL *dsl_old, CHA_WDRC *agc_old, CHA_DSL *dsl_new, CHA_WDRC *agc_new)
+{
+    int k;
+
+    if ((dsl_new->nchannel != dsl_old->nchannel) || (agc_new->nz != agc_old->nz) || (agc_new->td != agc_old->td)) return (0);
+    for (k = 0; k < dsl_new->nchannel - 1; k++) {
+        if (dsl_new->cross_freq[k] != dsl_old->cross_freq[k]) return (0);
+    }
+    return (1);
+}
+
+// The prescription-dependent values of a prepared context: the filterbank coefficients, the AGC's copies of the
+// prescription, and its broadband settings.  patch_context() changes only these.  Everything else is running
+// state (the filterbank history, the AGC's peak detectors, and all of the AFC), so it isn't listed.
+static const int prescription_ptrs[] = {_bb, _aa, _dsl, _gha};
+static const int prescription_dvars[] = {_alfa, _beta, _mxdb, _tkgn, _tk, _cr, _bolt};
+
+// Update the prescription-dependent values of a running context (must be called between chunks).  cp_new is a
+// scratch context prepared from the new prescription, with the same filterbank.  Returns the number of values
+// that were changed, or -1 (changing nothing) if cp_new doesn't have the same layout as the running context.
+
+static int
+patch_context(CHA_PTR cp, CHA_PTR cp_new)
+{
+    int *siz = (int *)cp[_size], *nsiz = (int *)cp_new[_size];
+    double *dvar = (double *)cp[_dvar], *ndvar = (double *)cp_new[_dvar];
+    uint32_t *dst, *nu;
+    int i, j, k, n, n_changed = 0;
+    int n_ptrs = sizeof(prescription_ptrs) / sizeof(prescription_ptrs[0]);
+    int n_dvars = sizeof(prescription_dvars) / sizeof(prescription_dvars[0]);
+
+    if (!siz || !nsiz || !dvar || !ndvar) return (-1);
+    for (j = 0; j < n_ptrs; j++) {  // check everything first, so that a mismatch changes nothing
+        k = prescription_ptrs[j];
+        if (!cp[k] != !cp_new[k]) return (-1);
+        if (cp[k] && (nsiz[k] != siz[k])) return (-1);
+    }
+    for (j = 0; j < n_ptrs; j++) {
+        k = prescription_ptrs[j];
+        if (!cp[k]) continue;
+        dst = (uint32_t *)cp[k];
+        nu = (uint32_t *)cp_new[k];
+        n = siz[k] / (int)sizeof(uint32_t);
+        for (i = 0; i < n; i++) {
+            if (dst[i] != nu[i]) {
+                dst[i] = nu[i];
+                n_changed++;
+            }
+        }
+    }
+    for (j = 0; j < n_dvars; j++) {
+        k = prescription_dvars[j];
+        if (dvar[k] != ndvar[k]) {
+            dvar[k] = ndvar[k];
+            n_changed++;
+        }
+    }
+    return (n_changed);
+}
+
+// prepare feedback
+
+static void
+prepare_feedback(CHA_PTR cp, CHA_AFC *afc)
+{
+    int afl, wfl, pfl;
+
+    // prepare AFC with the maximum filter lengths so that its buffers never need to grow...
+    afl = afc->afl;
+    wfl = afc->wfl;
+    pfl = afc->pfl;
+    afc->afl = AFC_MAX_AFL;
+    afc->wfl = AFC_MAX_WFL;
+    afc->pfl = AFC_MAX_PFL;
+    cha_afc_prepare(cp, afc);
+
+    // ...then run at the configured lengths
+    afc->afl = afl;
+    afc->wfl = wfl;
+    afc->pfl = pfl;
+    set_afc_lengths(cp, afl, wfl, pfl);
+}
+
+// prepare signal processing.  Returns 0, or -1 if the filterbank couldn't be prepared (and so nothing was).
+
+static int
 prepare(I_O *io, CHA_PTR cp)
 {
     prepare_io(io);
     srate = io->rate;
     chunk = io->cs;
-    prepare_filterbank(cp);
-    prepare_compressor(cp);
-    if (afc_global.sqm)
-        afc_global.nqm = io->nsmp * io->nrep;      
-    prepare_feedback(cp);
+    if (prepare_filterbank(cp, &dsl_global, &agc_global) < 0) return (-1);
+    prepare_compressor(cp, &dsl_global, &agc_global);
+    if (afc_global.sqm) {
+        afc_global.nqm = io->nsmp * io->nrep;
+        if (afc_global.nqm < 0) afc_global.nqm = 0;  // a run without end: no buffer
+        if (afc_global.nqm > AFC_MAX_NQM) afc_global.nqm = AFC_MAX_NQM;
+    }
+    prepare_feedback(cp, &afc_global);
     prepared++;
     // generate C code from prepared data
     //cha_data_gen(cp, DATA_HDR);
     //printf("test_gha.h: prepare:((int *)cp[_ivar])[_in1] = %i, ((int *)cp[_ivar])[_in2] = %i\n",((int *)cp[_ivar])[_in1],((int *)cp[_ivar])[_in2]);
+    return (0);
 }
 
 /***********************************************************/
 
 static void
-configure_compressor()
+configure_compressor(CHA_DSL *pdsl, CHA_WDRC *pagc, CHA_AFC *pafc)
 {
     // DSL prescription example   
     /*
@@ -172,21 +592,28 @@ configure_compressor()
     static CHA_WDRC agc_ex = {1, 50, 24000, 119, 0, 105, 10, 105};
     */
 
+#ifdef GHA_HAVE_FIXED_FIT
+    //use the fixed fitting, which was already translated by the compiler (see GHA_USE_FIXED_FIT, above)
+    *pdsl = fixed_dsl;
+    *pagc = fixed_agc;
+    *pafc = translate_AFC(fixed_afc2, *pafc);
+#else
     //let's get the DSL and AGC settings from Daniel's Controller's *.h file
     { //open brace to contain the scope to avoid unintended damage elsewhere
       #include "GHA_Constants.h" //this head file holds dsl, gha, and afc info.  It's from Daniel's Controller
-      convertStructures_DSL(dsl, dsl_global);  //from the format given in GHA_Constants.h to the format needed for CHAPRO
-      convertStructures_WDRC(gha, agc_global); //from the format given in GHA_Constants.h to the format needed for CHAPRO
-      convertStructures_AFC(afc, afc_global); //from the format given in GHA_Constants.h to the format needed for CHAPRO
+      convertStructures_DSL(dsl, *pdsl);  //from the format given in GHA_Constants.h to the format needed for CHAPRO
+      convertStructures_WDRC(gha, *pagc); //from the format given in GHA_Constants.h to the format needed for CHAPRO
+      convertStructures_AFC(afc, *pafc); //from the format given in GHA_Constants.h to the format needed for CHAPRO
     }
+#endif
         
-    static int nz = 4;
+    static int nz = GHA_NZ;
     static double td = 2.5;
 
     //memcpy(&dsl_global, &dsl_ex, sizeof(CHA_DSL));
     //memcpy(&agc_global, &agc_ex, sizeof(CHA_WDRC));
-    agc_global.nz = nz;
-    agc_global.td = td;
+    pagc->nz = nz;
+    pagc->td = td;
 
 
 //    Serial.println("test_gha: configure_compressor: dsl_global = ");
@@ -213,7 +640,7 @@ configure_compressor()
 }
 
 static void
-configure_feedback()
+configure_feedback(CHA_AFC *pafc)
 {
 //  switch (2) {
 //    case 1:
@@ -245,11 +672,11 @@ configure_feedback()
   //afc_global.hdel = 0; // output/input hardware delay
 //  afc_global.hdel = 38 + 2*chunk; // output/input hardware delay.  Tympan has a hardware delay of 17+21 = 38 samples plus the I2S buffering is 2 block sizes
   
-  afc_global.sqm = 0;  // save quality metric ?
-  //afc_global.fbg = 1;  // simulated-feedback gain
-  afc_global.nqm = 0;  // initialize quality-metric length
+  pafc->sqm = 0;  // save quality metric ?
+  //pafc->fbg = 1;  // simulated-feedback gain
+  pafc->nqm = 0;  // initialize quality-metric length
   //if (!args.simfb)
-      afc_global.fbg = 0;  //zero synthetic feedback
+      pafc->fbg = 0;  //zero synthetic feedback
 }
 
 static void
@@ -260,8 +687,8 @@ configure(I_O *io)
 //    static char *mfn = "test/tst_gha.mat";
 
     // initialize CHAPRO variables
-    configure_compressor();
-    configure_feedback();
+    configure_compressor(&dsl_global, &agc_global, &afc_global);
+    configure_feedback(&afc_global);
     // initialize I/O
 #ifdef ARSCLIB_H
     io->iod = ar_find_dev(ARSC_PREF_SYNC); // find preferred audio device
@@ -41,8 +41,11 @@ namespace BTNRH_WDRC {
 
 }
 
-// now, write functions to translate between CHA_DSL2 to CHA_DSL and CHA_WDRC2 to CHA_WDRC
-void convertStructures_DSL(BTNRH_WDRC::CHA_DSL2 &dsl_in, CHA_DSL &dsl_out) {
+// now, write functions to translate between CHA_DSL2 to CHA_DSL and CHA_WDRC2 to CHA_WDRC.
+// These are constexpr so that, when the prescription itself is constexpr (see GHA_USE_FIXED_FIT in test_gha.h), the
+// compiler does the whole translation and the CHAPRO structures are built into the firmware as constants.
+// Fields that aren't available in the input are left as they are in the given "out" structure.
+constexpr CHA_DSL translate_DSL(const BTNRH_WDRC::CHA_DSL2 &dsl_in, CHA_DSL dsl_out = CHA_DSL{}) {
   dsl_out.attack = dsl_in.attack;
   dsl_out.release = dsl_in.release;
   dsl_out.maxdB = dsl_in.maxdB;
@@ -54,9 +57,10 @@ void convertStructures_DSL(BTNRH_WDRC::CHA_DSL2 &dsl_in, CHA_DSL &dsl_out) {
       dsl_out.cr[i] = dsl_in.cr[i];
       dsl_out.tk[i] = dsl_in.tk[i];
       dsl_out.bolt[i] = dsl_in.bolt[i];      
-  }  
+  }
+  return dsl_out;
 }
-void convertStructures_WDRC(BTNRH_WDRC::CHA_WDRC2 &agc_in, CHA_WDRC &agc_out) {
+constexpr CHA_WDRC translate_WDRC(const BTNRH_WDRC::CHA_WDRC2 &agc_in, CHA_WDRC agc_out = CHA_WDRC{}) {
   agc_out.attack = agc_in.attack;
   agc_out.release = agc_in.release;
   agc_out.fs = agc_in.fs;
@@ -67,7 +71,24 @@ void convertStructures_WDRC(BTNRH_WDRC::CHA_WDRC2 &agc_in, CHA_WDRC &agc_out) {
   agc_out.bolt = agc_in.bolt;
 
   //The fields td, nz, new, wt are not available in agc_in, so we won't do anything with them.
-  //Alternatively, we could have zero'd out these fields here when setting agc_out.
+  return agc_out;
+}
+constexpr CHA_AFC translate_AFC(const BTNRH_WDRC::CHA_AFC &afc_in, CHA_AFC afc_out = CHA_AFC{}) {
+  afc_out.rho = afc_in.rho;
+  afc_out.eps = afc_in.eps;
+  afc_out.mu = afc_in.mu;
+  afc_out.afl = afc_in.afl;
+
+  //None of the other AFC are available in afc_in, so we won't do anything with them.
+  return afc_out;
+}
+
+// the run-time versions, which translate in place
+void convertStructures_DSL(BTNRH_WDRC::CHA_DSL2 &dsl_in, CHA_DSL &dsl_out) {
+  dsl_out = translate_DSL(dsl_in, dsl_out);
+}
+void convertStructures_WDRC(BTNRH_WDRC::CHA_WDRC2 &agc_in, CHA_WDRC &agc_out) {
+  agc_out = translate_WDRC(agc_in, agc_out);
 }
 void convertStructures_AFC(BTNRH_WDRC::CHA_AFC &afc_in, CHA_AFC &afc_out) {
   if (afc_in.default_to_active == 0) {
@@ -76,14 +97,7 @@ void convertStructures_AFC(BTNRH_WDRC::CHA_AFC &afc_in, CHA_AFC &afc_out) {
     Serial.println("    : This is not supported in this CHAPRO-based example.");
     Serial.println("    : Ignoring this setting.");
   }
-  
-  afc_out.rho = afc_in.rho;
-  afc_out.eps = afc_in.eps;
-  afc_out.mu = afc_in.mu;
-  afc_out.afl = afc_in.afl;
-
-  //None of the other AFC are available in afc_in, so we won't do anything with them.
-  //Alternatively, we could have zero'd out these fields here when setting afc_out.
+  afc_out = translate_AFC(afc_in, afc_out);
 }
 
 #endif
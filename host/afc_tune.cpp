@@ -0,0 +1,343 @@
+/*
+   afc_tune
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Search for AFC settings (mu, rho, eps, and alf, and optionally the filter lengths afl, wfl, and pfl)
+            instead of tuning them by hand.  Each candidate ("trial") runs the sketch's processing with CHAPRO's
+            simulated feedback (afc.fbg, afc.fbl) over a corpus of recordings, with the AFC's misalignment tracked
+            (see AfcQualityMetric.h), and is scored by how well the AFC's model matches the simulated feedback path:
+
+               final_dB   the misalignment at the end of each recording (the mean of its last second), in dB,
+                          averaged over the corpus.  Lower is better.
+               conv_s     convergence time: how long until the misalignment stays within 3 dB of its final value,
+                          averaged over the corpus.  Shorter is better.
+               score      final_dB + w * conv_s, which is what the trials are ranked by (w is set with -w)
+
+            Trials whose output blows up are ranked last.  The search is a random search, log-uniform within -d
+            decades of the starting values (the sketch's own, from configure()), followed by -R rounds of
+            narrower searches around the best trials so far.  The trials run in parallel, one per core (see
+            work_pool.h), and are all drawn up front from the seed (-S), so a search can be repeated exactly.
+
+            At the end, the best settings are printed as ready-to-paste blocks for GHA_Constants.h (which sets
+            afl, mu, rho, and eps) and for afc_global in test_gha.h (which holds the rest).
+
+            Build (from the top of the repo, with CHAPRO's sources built into libchapro.a, see README.md):
+
+               g++ -std=gnu++14 -O2 -pthread -Ihost/shim -ICHAPRO_WDRC -I$CHAPRO host/afc_tune.cpp $CHAPRO/libchapro.a -lm -o afc_tune
+               ./afc_tune -n 200 speech1.wav speech2.wav music.wav
+               ./afc_tune -L -n 400 -t 20 corpus/speech*.wav
+
+   MIT License.  use at your own risk.
+*/
+
+#include <unistd.h>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <Arduino.h>
+#include "gha_host.h"
+#include "work_pool.h"
+#include "AfcQualityMetric.h"
+
+#define AFC_TUNE_FBL 100          //length of CHAPRO's simulated feedback path
+#define AFC_TUNE_CONV_DB 3.0      //"converged" is within this many dB of the final misalignment
+#define AFC_TUNE_POINT_SEC 0.01   //how often to measure the misalignment
+
+enum { P_MU = 0, P_RHO, P_EPS, P_ALF, N_LOG_PARAMS };
+static const char *param_name[N_LOG_PARAMS] = {"mu", "rho", "eps", "alf"};
+static const int afl_choices[] = {21, 32, 42, 64, 84, 100, 128, 150};   //all within AFC_MAX_AFL
+static const int wfl_choices[] = {0, 5, 9, 12, 16, 20};                 //all within AFC_MAX_WFL
+static const int pfl_choices[] = {0, 10, 20, 28, 36, 48, 64};           //all within AFC_MAX_PFL
+#define N_CHOICES(a) ((int)(sizeof(a) / sizeof(a[0])))
+
+typedef struct {
+  double p[N_LOG_PARAMS];
+  int afl, wfl, pfl;
+  //results
+  bool stable;
+  double final_dB, conv_s, score;
+} Trial;
+
+typedef struct {
+  std::string fn;
+  double rate;
+  std::vector<float> x;      //calibrated input
+} CorpusFile;
+
+static std::vector<CorpusFile> corpus;
+static GhaPrescription base_rx;
+static int cs = GHA_CHUNK;
+static double fbg = 1.0, conv_weight = 1.0;
+
+// ///////////////////////////////////////// the corpus
+
+static bool load_corpus_file(const char *fn, double max_sec, double rms_lev) {
+  WavReader wav;
+  if (!wav.open(fn)) return false;
+  CorpusFile f;
+  f.fn = fn;
+  f.rate = wav.rate;
+  uint64_t n = wav.n_samples;
+  if ((max_sec > 0) && (n > (uint64_t)(max_sec * wav.rate))) n = (uint64_t)(max_sec * wav.rate);
+  n = (n / cs) * cs;
+  f.x.resize(n);
+  if ((n == 0) || (wav.read(f.x.data(), (int)n) != (int)n)) { fprintf(stderr, "afc_tune: %s: too short\n", fn); return false; }
+  double smsq = 0;
+  for (float v : f.x) smsq += (double)v * v;
+  if (smsq <= 0) { fprintf(stderr, "afc_tune: %s is silent\n", fn); return false; }
+  double scl = GHA_HOST_SPL_REF * pow(10, rms_lev / 20) / sqrt(smsq / n);  //as set_spl() does
+  for (float &v : f.x) v = (float)(v * scl);
+  corpus.push_back(f);
+  return true;
+}
+
+// ///////////////////////////////////////// running a trial
+
+//final misalignment (dB) and convergence time (s) from the tracked misalignment
+static bool score_misalignment(const AfcQualityMetric &m, double point_sec, double *final_dB, double *conv_s) {
+  if ((m.n_points < 2) || (m.n_hist < 1)) return false;
+  int n_last = (int)(1.0 / point_sec);
+  if (n_last > (int)m.n_points / 2) n_last = m.n_points / 2;
+  *final_dB = afc_qm_recent_db(&m, (n_last < 1) ? 1 : n_last);
+  if (isnan(*final_dB)) return false;
+
+  //the last time that it was more than AFC_TUNE_CONV_DB above the final value, smoothed over ~50 ms
+  double entry_sec = m.hist_step * point_sec;
+  int n_smooth = (int)(0.05 / entry_sec); if (n_smooth < 1) n_smooth = 1;
+  double limit = pow(10, (*final_dB + AFC_TUNE_CONV_DB) / 10);
+  int last_above = -1;
+  for (int i=0; i + n_smooth <= m.n_hist; i += n_smooth) {
+    double sum = 0;
+    for (int k=i; k < i + n_smooth; k++) sum += m.hist[k];
+    if (!(sum / n_smooth <= limit)) last_above = i + n_smooth;
+  }
+  *conv_s = (last_above < 0) ? 0.0 : last_above * entry_sec;
+  return true;
+}
+
+static void run_trial(Trial &t, CHA_PTR cp, std::vector<float> &x, std::vector<float> &y) {
+  GhaPrescription rx = base_rx;
+  rx.afc.mu = t.p[P_MU]; rx.afc.rho = t.p[P_RHO]; rx.afc.eps = t.p[P_EPS]; rx.afc.alf = t.p[P_ALF];
+  rx.afc.afl = t.afl; rx.afc.wfl = t.wfl; rx.afc.pfl = t.pfl;
+  rx.afc.fbg = fbg;             //CHAPRO's simulated feedback...
+  rx.afc.fbl = AFC_TUNE_FBL;
+
+  t.stable = true;
+  t.final_dB = t.conv_s = 0;
+  for (const CorpusFile &f : corpus) {
+    int n = (int)f.x.size();
+    x = f.x;                    //the AFC writes back into its input
+    y.resize(n);
+    if (gha_host_prepare(cp, &rx, f.rate, cs) != NULL) { t.stable = false; break; }
+    AfcQualityMetric qm;
+    int decim = (int)(AFC_TUNE_POINT_SEC * f.rate / cs + 0.5);
+    afc_qm_init(&qm, decim, NULL, NULL);
+    for (int i=0; i < n; i += cs) {
+      process_chunk(cp, &x[i], &y[i], cs);
+      afc_qm_update(&qm, cp, NULL, 0);
+    }
+    for (int i=0; i < n; i++) if (!(fabsf(y[i]) < 10.0f)) { t.stable = false; break; }  //NAN, or far beyond full scale
+
+    double final_dB = 0, conv_s = 0;
+    if (!t.stable || !score_misalignment(qm, (double)qm.decim * cs / f.rate, &final_dB, &conv_s)) t.stable = false;
+    gha_host_cleanup(cp);
+    if (!t.stable) break;
+    t.final_dB += final_dB / corpus.size();
+    t.conv_s += conv_s / corpus.size();
+  }
+  t.score = t.stable ? t.final_dB + conv_weight * t.conv_s : INFINITY;
+}
+
+static void run_trials(std::vector<Trial> &trials, size_t first, int n_workers) {
+  std::vector<std::vector<void *>> contexts(n_workers, std::vector<void *>(NPTR, (void *)NULL));
+  std::vector<std::vector<float>> xs(n_workers), ys(n_workers);
+  WorkPool pool(n_workers);
+  for (size_t i=first; i < trials.size(); i++) pool.add((int)i);
+  pool.run([&](int i, int w) { run_trial(trials[i], contexts[w].data(), xs[w], ys[w]); });
+}
+
+// ///////////////////////////////////////// drawing the trials
+
+static int nearest_choice(const int *choices, int n, int v) {
+  int best = 0;
+  for (int i=1; i < n; i++) if (abs(choices[i] - v) < abs(choices[best] - v)) best = i;
+  return best;
+}
+
+//log-normal around center (sd in decades), within (0, 1]
+static double draw_log(std::mt19937 &rng, double center, double sd_decades) {
+  std::normal_distribution<double> nd(0.0, sd_decades);
+  double v = center * pow(10, nd(rng));
+  return (v > 1.0) ? 1.0 : v;
+}
+static double draw_log_uniform(std::mt19937 &rng, double center, double decades) {
+  std::uniform_real_distribution<double> ud(-decades, decades);
+  double v = center * pow(10, ud(rng));
+  return (v > 1.0) ? 1.0 : v;
+}
+static int draw_choice(std::mt19937 &rng, const int *choices, int n, int current, bool wide) {
+  int i = nearest_choice(choices, n, current);
+  if (wide) return choices[std::uniform_int_distribution<int>(0, n - 1)(rng)];
+  int step = std::uniform_int_distribution<int>(-1, 1)(rng);  //a neighbour, or the same
+  i += step;
+  if (i < 0) i = 0;
+  if (i >= n) i = n - 1;
+  return choices[i];
+}
+
+static Trial trial_from(const GhaPrescription &rx) {
+  Trial t = Trial();
+  t.p[P_MU] = rx.afc.mu; t.p[P_RHO] = rx.afc.rho; t.p[P_EPS] = rx.afc.eps; t.p[P_ALF] = rx.afc.alf;
+  t.afl = rx.afc.afl; t.wfl = rx.afc.wfl; t.pfl = rx.afc.pfl;
+  return t;
+}
+
+// ///////////////////////////////////////// output
+
+static void print_trials(const std::vector<Trial> &trials, int n_show) {
+  printf("%4s %12s %12s %12s %12s %4s %4s %4s %9s %7s %8s\n", "rank", "mu", "rho", "eps", "alf", "afl", "wfl", "pfl", "final_dB", "conv_s", "score");
+  for (int i=0; (i < n_show) && (i < (int)trials.size()); i++) {
+    const Trial &t = trials[i];
+    if (!t.stable) { printf("%4d %12.9f %12.9f %12.9f %12.9f %4d %4d %4d   (unstable)\n", i + 1, t.p[P_MU], t.p[P_RHO], t.p[P_EPS], t.p[P_ALF], t.afl, t.wfl, t.pfl); continue; }
+    printf("%4d %12.9f %12.9f %12.9f %12.9f %4d %4d %4d %9.2f %7.2f %8.2f\n", i + 1, t.p[P_MU], t.p[P_RHO], t.p[P_EPS], t.p[P_ALF],
+           t.afl, t.wfl, t.pfl, t.final_dB, t.conv_s, t.score);
+  }
+}
+
+static void print_afc_blocks(const Trial &t, const Trial &base) {
+  const GhaPrescription &rx = base_rx;
+  printf("\n// AFC settings from afc_tune: final misalignment %.2f dB, converged in %.2f s (the starting settings: %.2f dB, %.2f s)\n",
+         t.final_dB, t.conv_s, base.final_dB, base.conv_s);
+  printf("\n// for GHA_Constants.h (afl, mu, rho, and eps are taken from here):\n");
+  printf("BTNRH_WDRC::CHA_AFC afc = {   \n");
+  printf("  1,  //enable AFC at startup?  Set to 1 to default to active.  Set to 0 to default to disabled   !!!! IGNORED BY THIS CHAPRO VERSION\n");
+  printf("  %d,  //afl, length (samples) of adaptive filter for modeling feedback path.  Max allowed is probably 256 samples.\n", t.afl);
+  printf("  %.9f,  //mu, scale factor for how fast the adaptive filter adapts (bigger is faster)\n", t.p[P_MU]);
+  printf("  %.9f,  //rho, smoothing factor for how fast the audio's envelope is tracked (bigger is a longer average)\n", t.p[P_RHO]);
+  printf("  %.9f,  //eps, when estimating the audio envelope, this is the minimum allowed level (helps avoid divide-by-zero)\n", t.p[P_EPS]);
+  printf("};\n");
+  printf("\n// for test_gha.h (rho, eps, mu, and afl are overridden by GHA_Constants.h, above):\n");
+  printf("CHA_AFC afc_global = {     // Here are the settings for the adaptive feedback cancelation\n");
+  printf("  0.0,  //simulated-feedback gain\n");
+  printf("  %.9f,     //rho, forgetting factor\n", t.p[P_RHO]);
+  printf("  %.9f,      //eps, power threshold\n", t.p[P_EPS]);
+  printf("  %.9f,      //mu, step size\n", t.p[P_MU]);
+  printf("  %.9f,      //alf, band-limit update\n", t.p[P_ALF]);
+  printf("  %d,               //afl, adaptive filter length\n", t.afl);
+  printf("  %d,                //wfl, whiten filter length\n", t.wfl);
+  printf("  %d,               //pfl, band-limit filter length\n", t.pfl);
+  printf("  0,                //fbl, simulated-feedback length  [IS ZERO CORRECT?]\n");
+  printf("  38 + 2*chunk,     //hdel, output/input hardware delay..."
+         "\"chunk' was defined earlier in the main code or else this wouldn't work\n");
+  printf("  %d                 //pup, band-limit update period\n", rx.afc.pup);
+  printf("};  //the rest of the parameters are assumed zero and will be set by the rest of the code\n");
+}
+
+static void usage(void) {
+  printf("usage: afc_tune [options] corpus.wav ...\n");
+  printf("options\n");
+  printf("  -n n     random trials (default 200)\n");
+  printf("  -R n     rounds of narrower search around the best trials (default 2, each with n/2 trials)\n");
+  printf("  -d dec   how far (decades) the random trials range from the starting settings (default 1.5)\n");
+  printf("  -L       also search the filter lengths afl, wfl, and pfl\n");
+  printf("  -t sec   use at most this much of each recording (default 30)\n");
+  printf("  -g fbg   simulated-feedback gain (default 1)\n");
+  printf("  -w w     score = final_dB + w * conv_s (default 1 dB per second)\n");
+  printf("  -p pre   start from a preset (\"file\" or \"file:index\") instead of the sketch's settings\n");
+  printf("  -j n     worker threads (default: one per core)\n");
+  printf("  -S seed  random seed (default 1)\n");
+  printf("  -k n     how many of the best trials to list (default 10)\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int n_random = 200, n_rounds = 2, n_workers = (int)std::thread::hardware_concurrency(), n_show = 10, opt;
+  unsigned seed = 1;
+  double decades = 1.5, max_sec = 30;
+  bool search_lengths = false;
+  const char *preset = NULL;
+
+  while ((opt = getopt(argc, argv, "n:R:d:Lt:g:w:p:j:S:k:h")) != -1) {
+    switch (opt) {
+      case 'n': n_random = atoi(optarg); break;
+      case 'R': n_rounds = atoi(optarg); break;
+      case 'd': decades = atof(optarg); break;
+      case 'L': search_lengths = true; break;
+      case 't': max_sec = atof(optarg); break;
+      case 'g': fbg = atof(optarg); break;
+      case 'w': conv_weight = atof(optarg); break;
+      case 'p': preset = optarg; break;
+      case 'j': n_workers = atoi(optarg); break;
+      case 'S': seed = (unsigned)atoi(optarg); break;
+      case 'k': n_show = atoi(optarg); break;
+      default: usage();
+    }
+  }
+  if ((optind >= argc) || (n_random < 1) || (n_rounds < 0)) usage();
+  if (n_workers < 1) n_workers = 1;
+  gha_verbose = 0;
+
+  gha_host_default_prescription(&base_rx, cs);
+  if (preset) {
+    int err = gha_host_load_preset(preset, &base_rx);
+    if (err != GHA_PRESET_OK) { fprintf(stderr, "afc_tune: can't load preset %s (error %d)\n", preset, err); return 1; }
+  }
+  for (int i=optind; i < argc; i++) if (!load_corpus_file(argv[i], max_sec, GHA_HOST_RMS_LEV)) return 1;
+  double corpus_s = 0;
+  for (const CorpusFile &f : corpus) corpus_s += f.x.size() / f.rate;
+
+  //the starting settings, then the random trials
+  std::mt19937 rng(seed);
+  std::vector<Trial> trials;
+  Trial base = trial_from(base_rx);
+  trials.push_back(base);
+  for (int i=0; i < n_random; i++) {
+    Trial t = base;
+    for (int k=0; k < N_LOG_PARAMS; k++) t.p[k] = draw_log_uniform(rng, base.p[k], decades);
+    if (search_lengths) {
+      t.afl = draw_choice(rng, afl_choices, N_CHOICES(afl_choices), base.afl, true);
+      t.wfl = draw_choice(rng, wfl_choices, N_CHOICES(wfl_choices), base.wfl, true);
+      t.pfl = draw_choice(rng, pfl_choices, N_CHOICES(pfl_choices), base.pfl, true);
+    }
+    trials.push_back(t);
+  }
+  fprintf(stderr, "afc_tune: %d files, %.1f s of audio per trial, %d trials on %d workers\n", (int)corpus.size(), corpus_s, (int)trials.size(), n_workers);
+  auto t_start = std::chrono::steady_clock::now();
+  run_trials(trials, 0, n_workers);
+  base = trials[0];
+
+  //narrower searches around the best so far
+  auto by_score = [](const Trial &a, const Trial &b) { return a.score < b.score; };
+  for (int r=0; r < n_rounds; r++) {
+    std::sort(trials.begin(), trials.end(), by_score);
+    int n_parents = (trials.size() < 5) ? (int)trials.size() : 5;
+    double sd = 0.3 * decades / (r + 1);
+    size_t first = trials.size();
+    for (int i=0; i < (n_random + 1) / 2; i++) {
+      const Trial &parent = trials[i % n_parents];
+      Trial t = parent;
+      for (int k=0; k < N_LOG_PARAMS; k++) t.p[k] = draw_log(rng, parent.p[k], sd);
+      if (search_lengths) {
+        t.afl = draw_choice(rng, afl_choices, N_CHOICES(afl_choices), parent.afl, false);
+        t.wfl = draw_choice(rng, wfl_choices, N_CHOICES(wfl_choices), parent.wfl, false);
+        t.pfl = draw_choice(rng, pfl_choices, N_CHOICES(pfl_choices), parent.pfl, false);
+      }
+      trials.push_back(t);
+    }
+    fprintf(stderr, "afc_tune: round %d: best score so far %.2f, %d more trials\n", r + 1, trials[0].score, (int)(trials.size() - first));
+    run_trials(trials, first, n_workers);
+  }
+  std::sort(trials.begin(), trials.end(), by_score);
+  double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+  printf("afc_tune: %d trials in %.1f s (%.1f audio-seconds per wall-second)\n", (int)trials.size(), wall_s, trials.size() * corpus_s / wall_s);
+  printf("afc_tune: starting settings: ");
+  for (int k=0; k < N_LOG_PARAMS; k++) printf("%s=%.9f ", param_name[k], base.p[k]);
+  if (base.stable) printf("afl=%d wfl=%d pfl=%d: final %.2f dB, converged in %.2f s\n", base.afl, base.wfl, base.pfl, base.final_dB, base.conv_s);
+  else printf("afl=%d wfl=%d pfl=%d: unstable\n", base.afl, base.wfl, base.pfl);
+  print_trials(trials, n_show);
+  if (!trials[0].stable) { printf("afc_tune: *** no stable settings were found ***\n"); return 1; }
+  print_afc_blocks(trials[0], base);
+  return 0;
+}
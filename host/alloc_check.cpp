@@ -0,0 +1,132 @@
+/*
+   alloc_check
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Host test that the GUI updates and the parameter printouts of the CHAPRO_WDRC sketch don't use the
+            heap (see FixedFormat.h).  Every call to operator new is counted.  Each output path is run once to
+            warm up (bleSendMessage() reserves its String the first time), and then again while counting.  Any
+            allocation in the second run is a failure, except those made inside the Tympan library's
+            BLE::sendMessage(), which copies every message (see the BLE shim).  The sketch can't avoid those, so
+            they are counted and reported separately.  The BLE receive path isn't covered.
+
+            Build (from the top of the repo, with CHAPRO's sources built into libchapro.a, see README.md):
+
+               g++ -std=gnu++14 -O2 -Ihost/shim -ICHAPRO_WDRC -I$CHAPRO host/alloc_check.cpp $CHAPRO/libchapro.a -lm -o alloc_check
+               ./alloc_check
+
+   MIT License.  use at your own risk.
+*/
+
+#include <new>
+#include <unistd.h>
+#include <Arduino.h>
+#include <Tympan_Library.h>
+#include <SdFat.h>
+
+// ///////////////////////////////////////// count every allocation
+static unsigned long n_allocs = 0, n_library_allocs = 0;
+static void count_alloc(void) { if (host_library_depth > 0) n_library_allocs++; else n_allocs++; }  //see AudioStream_F32.h
+//these replace the global operators, so new and delete both go to malloc() and free().  GCC can't see that once
+//they are inlined, and warns that free() is given a pointer from new, so that warning is turned off here only.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(size_t n) { count_alloc(); void *p = malloc(n ? n : 1); if (!p) throw std::bad_alloc(); return p; }
+void *operator new[](size_t n) { count_alloc(); void *p = malloc(n ? n : 1); if (!p) throw std::bad_alloc(); return p; }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// ///////////////////////////////////////// the same objects as the sketch
+#include "test_gha.h"
+#include "AudioEffectBTNRH.h"
+AudioSettings_F32 audio_settings((int)srate, chunk);
+SdFs sd;
+Tympan myTympan;
+AudioEffectGain_F32 gain1;
+EarpieceMixer_F32_UI earpieceMixer;
+AudioSDWriter_F32_UI audioSDWriter;
+AudioEffectBTNRH_F32 BTNRH_alg1(audio_settings);
+
+#include "PresetManager.h"
+#include "AfcModelStore.h"
+#include "SdReplay.h"
+#include "SerialManager.h"
+#include "State.h"
+PresetManager presetManager(sd);
+AfcModelStore afcModelStore(sd);
+SdReplay sdReplay(sd);
+TaskScheduler taskScheduler;
+BLE_UI ble;
+SerialManager serialManager(&ble);
+State myState(&audio_settings, &myTympan, &serialManager);
+
+float setDigitalGain_dB(float val_dB) { return myState.digital_gain_dB = gain1.setGain_dB(val_dB); }
+
+// ///////////////////////////////////////// the test
+static FILE *report = stdout;
+typedef void (*OutputPath)(void);
+static void path_fullGUIState(void) {
+  serialManager.forgetGUIState();  //else nothing has changed since the warm-up, and nothing would be sent
+  serialManager.setFullGUIState();
+  while (serialManager.serviceGUI());
+}
+static void path_appConnect(void) {
+  serialManager.processCharacter('J');
+  while (serialManager.serviceLayout());
+  while (serialManager.serviceGUI());
+}
+static void path_gainCommand(void) {
+  serialManager.processCharacter('k'); serialManager.serviceGUI();
+  serialManager.processCharacter('K'); serialManager.serviceGUI();
+}
+static void path_afcCommand(void) {
+  serialManager.processCharacter('m'); serialManager.serviceGUI();
+  serialManager.processCharacter('M'); serialManager.serviceGUI();
+}
+static void path_printAfcParams(void) { BTNRH_alg1.print_afc_params(); }
+static void path_printAgcParams(void) { BTNRH_alg1.print_agc_params(); }
+static void path_modelToSerial(void) { BTNRH_alg1.servicePrintingFeedbackModel(1000000UL, 0); }
+static void path_modelToApp(void) { while (BTNRH_alg1.servicePrintingFeedbackModel_toApp(1000000UL, 0, ble) && BTNRH_alg1.isPrintingFeedbackModel_toApp()); }
+
+static int check(const char *name, OutputPath path) {
+  path();  //warm up
+  unsigned long n_start = n_allocs, lib_start = n_library_allocs, msg_start = ble.n_messages;
+  path();
+  unsigned long n = n_allocs - n_start;
+  fprintf(report, "alloc_check: %-22s %4lu BLE messages, %lu allocations (+%lu in BLE::sendMessage): %s\n", name,
+          ble.n_messages - msg_start, n, n_library_allocs - lib_start, (n == 0) ? "OK" : "FAILED");
+  return (n == 0) ? 0 : 1;
+}
+
+int main(void) {
+  gha_verbose = 0;
+  BTNRH_alg1.setup();
+
+  //the parameter printouts go to stdout, which isn't what we're here to see
+  fflush(stdout);
+  FILE *saved_stdout = stdout;
+  report = fdopen(dup(fileno(stdout)), "w");
+  stdout = fopen("/dev/null", "w");
+  int n_failed = 0;
+  n_failed += check("setFullGUIState", path_fullGUIState);
+  n_failed += check("App connect", path_appConnect);
+  n_failed += check("gain command", path_gainCommand);
+  n_failed += check("AFC command", path_afcCommand);
+  n_failed += check("print_afc_params", path_printAfcParams);
+  n_failed += check("print_agc_params", path_printAgcParams);
+  n_failed += check("model to Serial", path_modelToSerial);
+  n_failed += check("model to App", path_modelToApp);
+  fclose(stdout);
+  fclose(report);
+  stdout = saved_stdout;
+
+  printf("alloc_check: %s\n", (n_failed == 0) ? "PASSED" : "FAILED");
+  return (n_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/*
+   bench_util.h
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Shared pieces for the host benchmarks: a CPU cycle counter, a nanosecond clock, summary statistics
+            for repeated runs, and a test signal at a calibrated level.
+
+            Cycles come from the kernel's hardware counter (perf_event_open) when we're allowed to use it, which
+            counts the real CPU cycles of this thread.  Otherwise, on x86, we fall back to the time-stamp counter
+            (rdtsc), which ticks at a fixed rate and so doesn't follow turbo or power saving.  cycle_source says
+            which one was used, so that results from different machines can be compared fairly.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_bench_util_h
+#define _host_bench_util_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+#define BENCH_SPL_REF 1.1219e-6   //same as set_spl() in tst_gha.c: rms of 1.1219e-6 is 0 dB SPL
+
+// ///////////////////////////////////////////////// clocks
+
+static inline uint64_t bench_now_ns(void) {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class CycleCounter {
+  public:
+    ~CycleCounter(void) { if (fd >= 0) close(fd); }
+
+    const char *begin(void);           //returns cycle_source
+    inline uint64_t read(void) {
+      if (fd >= 0) { uint64_t v = 0; if (::read(fd, &v, sizeof(v)) == sizeof(v)) return v; return 0; }
+#ifdef BENCH_HAVE_TSC
+      return __rdtsc();
+#else
+      return 0;
+#endif
+    }
+    bool isValid(void) { return strcmp(cycle_source, "none") != 0; }
+
+    const char *cycle_source = "none";  //"perf", "tsc", or "none"
+
+  private:
+    int fd = -1;
+};
+
+const char *CycleCounter::begin(void) {
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.type = PERF_TYPE_HARDWARE;
+  pe.size = sizeof(pe);
+  pe.config = PERF_COUNT_HW_CPU_CYCLES;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  fd = (int)syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);  //this thread, any CPU
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    cycle_source = "perf";
+  } else {
+#ifdef BENCH_HAVE_TSC
+    cycle_source = "tsc";
+#else
+    cycle_source = "none";
+#endif
+  }
+  return cycle_source;
+}
+
+// ///////////////////////////////////////////////// statistics over the repetitions
+
+typedef struct {
+  int n;
+  double mean, median, min, max, stddev;
+} BenchStats;
+
+static BenchStats bench_stats(std::vector<double> v) {
+  BenchStats s = {0, 0, 0, 0, 0, 0};
+  s.n = (int)v.size();
+  if (s.n == 0) return s;
+  std::sort(v.begin(), v.end());
+  for (double x : v) s.mean += x;
+  s.mean /= s.n;
+  s.median = (s.n % 2) ? v[s.n / 2] : 0.5 * (v[s.n / 2 - 1] + v[s.n / 2]);
+  s.min = v.front();
+  s.max = v.back();
+  for (double x : v) s.stddev += (x - s.mean) * (x - s.mean);
+  s.stddev = (s.n > 1) ? sqrt(s.stddev / (s.n - 1)) : 0.0;
+  return s;
+}
+
+// ///////////////////////////////////////////////// test signal
+
+//white noise, scaled to the given rms level in dB SPL (the same calibration as set_spl()).  Repeatable for a given seed.
+static void bench_fill_noise(float *x, int n, double db_spl, uint32_t seed) {
+  double smsq = 0;
+  for (int i=0; i < n; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    x[i] = (float)((int32_t)seed / 2147483648.0);
+    smsq += (double)x[i] * x[i];
+  }
+  double scl = BENCH_SPL_REF * pow(10, db_spl / 20) / sqrt(smsq / n);
+  for (int i=0; i < n; i++) x[i] = (float)(x[i] * scl);
+}
+
+#endif
@@ -0,0 +1,362 @@
+/*
+   feedback_sim
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Closed-loop acoustic-feedback simulator for the CHAPRO_WDRC sketch's processing, with measured
+            feedback paths.  Instead of CHAPRO's built-in simulated feedback (afc.fbg, afc.fbl), the output of
+            process_chunk() goes back to its input through a measured impulse response (a WAV file, one per ear,
+            hundreds to thousands of taps), after the hardware delay (afc.hdel):
+
+               mic[n] = source[n] + g * (h * out)[n - hdel]
+
+            The impulse response is applied by partitioned FFT convolution (see fft_conv.h), with blocks as long
+            as the hardware delay allows (the feedback into a chunk then only ever needs outputs that have already
+            been made), so that long paths cost little more than short ones.
+
+            Every combination of ear (impulse response), gain offset (g, in dB, to find the gain margin), and
+            source recording is a job, and the jobs run in parallel, one per core (see work_pool.h).  Each job
+            reports whether the loop stayed stable, the AFC's final misalignment from the measured path (see
+            AfcQualityMetric.h), and how much faster than real time it ran.  At the end, each ear's largest
+            stable gain offset is listed.  With -m, each job also writes its misalignment over time to two csv
+            files: every point, as the metric flushes them, and the metric's whole-run trace.
+
+            The impulse responses must be at the source's sample rate.  They are taken to be from the Tympan's
+            output samples to its input samples, not counting the hardware delay (use -d to say otherwise).
+
+            Build (from the top of the repo, with CHAPRO's sources built into libchapro.a, see README.md):
+
+               g++ -std=gnu++14 -O2 -pthread -Ihost/shim -ICHAPRO_WDRC -I$CHAPRO host/feedback_sim.cpp $CHAPRO/libchapro.a -lm -o feedback_sim
+               ./feedback_sim -i speech.wav -g 0,5,10,15,20 ears/left1.wav ears/right1.wav
+               ./feedback_sim -i speech.wav -i music.wav -p fitting.bin:2 -o results.csv ears/ear*.wav
+
+   MIT License.  use at your own risk.
+*/
+
+#include <unistd.h>
+#include <string>
+#include <algorithm>
+#include <Arduino.h>
+#include "gha_host.h"
+#include "work_pool.h"
+#include "fft_conv.h"
+#include "AfcQualityMetric.h"
+
+#define FEEDBACK_SIM_BLOCK_CHUNKS 256   //chunks per source read
+#define FEEDBACK_SIM_MAX_ABS 1000.0f    //an output beyond this (or NAN) means that the loop has gone unstable
+#define FEEDBACK_SIM_POINT_SEC 0.01     //how often to measure the misalignment
+
+typedef struct {
+  std::string fn;
+  std::vector<float> h;
+} Ear;
+
+typedef struct {
+  std::string fn;
+  float scl;             //to the calibrated level
+} Source;
+
+typedef struct {
+  int ear, source;
+  double gain_dB;
+  //results
+  bool ok, stable;
+  std::string msg;
+  double audio_sec, unstable_sec, final_dB, peak, speed_ratio;
+} SimJob;
+
+static std::vector<Ear> ears;
+static std::vector<Source> sources;
+static GhaPrescription rx;
+static int cs = GHA_CHUNK, sim_delay = -1, conv_block = 0;
+static double max_sec = 0;
+static const char *wav_dir = NULL, *qm_dir = NULL;
+
+static bool load_ear(const char *fn, double rate) {
+  WavReader wav;
+  if (!wav.open(fn)) return false;
+  if (wav.rate != rate) { fprintf(stderr, "feedback_sim: %s is at %.0f Hz, but the sources are at %.0f Hz\n", fn, wav.rate, rate); return false; }
+  Ear ear;
+  ear.fn = fn;
+  ear.h.resize(wav.n_samples);
+  if ((wav.n_samples == 0) || (wav.read(ear.h.data(), (int)wav.n_samples) != (int)wav.n_samples)) { fprintf(stderr, "feedback_sim: can't read %s\n", fn); return false; }
+  ears.push_back(ear);
+  return true;
+}
+
+//the largest power-of-2 block, a multiple of the chunk size, that is no longer than the delay
+static int choose_block(int delay) {
+  int b = cs;
+  if (b & (b - 1)) return 0;  //the convolver needs a power of 2
+  while (2 * b <= delay) b *= 2;
+  return b;
+}
+
+static std::string base_name(const std::string &fn) {
+  size_t i = fn.find_last_of('/');
+  std::string s = (i == std::string::npos) ? fn : fn.substr(i + 1);
+  size_t j = s.find_last_of('.');
+  return (j == std::string::npos) ? s : s.substr(0, j);
+}
+
+//the start of each of a job's output file names, eg "dir/left1_+5.0dB_speech"
+static std::string job_file_name(const char *dir, const SimJob &job) {
+  char gain_str[32];
+  snprintf(gain_str, sizeof(gain_str), "%+.1fdB", job.gain_dB);
+  return std::string(dir) + "/" + base_name(ears[job.ear].fn) + "_" + gain_str + "_" + base_name(sources[job.source].fn);
+}
+
+//the misalignment points, as the metric flushes them (see AfcQualityMetric.h)
+typedef struct {
+  FILE *f;
+  double point_sec;
+  uint32_t n;        //points written so far
+} QmFile;
+
+static void write_qm_points(void *arg, const float *qm, int n) {
+  QmFile *out = (QmFile *)arg;
+  for (int i=0; i < n; i++, out->n++) {
+    fprintf(out->f, "%.3f,%.3f\n", (out->n + 1) * out->point_sec, (qm[i] > 0) ? 10 * log10(qm[i]) : -INFINITY);
+  }
+}
+
+//the metric's whole-run trace.  Each entry is the mean of hist_step points, and is timed at its middle
+static bool write_qm_hist(const std::string &fn, const AfcQualityMetric &qm, double point_sec) {
+  FILE *f = fopen(fn.c_str(), "w");
+  if (!f) return false;
+  fprintf(f, "time_s,misalignment_dB\n");
+  for (int i=0; i < qm.n_hist; i++) fprintf(f, "%.3f,%.3f\n", (i + 0.5) * qm.hist_step * point_sec, afc_qm_hist_db(&qm, i));
+  return (fclose(f) == 0);
+}
+
+//one job, on one worker.  cp belongs to the worker
+static void run_job(SimJob &job, CHA_PTR cp) {
+  const Ear &ear = ears[job.ear];
+  const Source &src = sources[job.source];
+  WavReader wav_in;
+  WavWriter wav_out;
+  job.ok = false;
+  job.stable = true;
+  if (!wav_in.open(src.fn.c_str())) { job.msg = "can't read the source"; return; }
+
+  //the feedback path at this gain, and the AFC's view of it: the AFC models the path after its own hdel
+  int delay = (sim_delay >= 0) ? sim_delay : rx.afc.hdel;
+  float g = (float)pow(10, job.gain_dB / 20);
+  std::vector<float> h(ear.h.size()), ref;
+  for (size_t i=0; i < h.size(); i++) h[i] = g * ear.h[i];
+  int shift = delay - rx.afc.hdel;
+  for (int i=0; i < (int)h.size() + shift; i++) ref.push_back((i < shift) ? 0.0f : h[i - shift]);
+
+  int B = (conv_block > 0) ? conv_block : choose_block(delay);
+  if ((B < cs) || (B > delay) || (B % cs)) { job.msg = "the hardware delay must be at least one chunk long (and the block a multiple of the chunk, no longer than the delay)"; return; }
+  PartitionedConvolver conv;
+  if (!conv.init(h.data(), (int)h.size(), B)) { job.msg = "can't set up the convolution"; return; }
+
+  const char *why_not = gha_host_prepare(cp, &rx, wav_in.rate, cs);
+  if (why_not) { job.msg = why_not; return; }
+  if (wav_dir) {
+    std::string ofn = job_file_name(wav_dir, job) + ".wav";
+    if (!wav_out.open(ofn.c_str(), wav_in.rate, 32)) { job.msg = "can't create " + ofn; gha_host_cleanup(cp); return; }
+  }
+  AfcQualityMetric qm;
+  int decim = (int)(FEEDBACK_SIM_POINT_SEC * wav_in.rate / cs + 0.5);
+  QmFile qm_out = { NULL, std::max(decim, 1) * cs / wav_in.rate, 0 };
+  if (qm_dir) {
+    std::string ofn = job_file_name(qm_dir, job) + "_misalign.csv";
+    if (!(qm_out.f = fopen(ofn.c_str(), "w"))) { job.msg = "can't create " + ofn; gha_host_cleanup(cp); return; }
+    fprintf(qm_out.f, "time_s,misalignment_dB\n");
+  }
+  afc_qm_init(&qm, decim, qm_out.f ? write_qm_points : NULL, &qm_out);
+
+  //the loop.  z[] is the convolution of the output with the path, indexed by output sample (mod its length)
+  int n_block = cs * FEEDBACK_SIM_BLOCK_CHUNKS;
+  int n_z = 1;
+  while (n_z < delay + 2 * B) n_z *= 2;
+  std::vector<float> x(n_block), y(n_block), z(n_z, 0.0f), y_acc(B), z_block(B);
+  uint64_t n_max = (max_sec > 0) ? (uint64_t)(max_sec * wav_in.rate) : UINT64_MAX;
+  uint64_t t = 0;          //samples so far
+  int i_acc = 0;           //samples in y_acc
+  double t_proc;
+  job.peak = 0;
+  int n;
+  auto t0 = std::chrono::steady_clock::now();
+  while (job.stable && (t < n_max) && ((n = wav_in.read(x.data(), n_block)) > 0)) {
+    if (t + n > n_max) n = (int)(n_max - t);
+    int n_pad = ((n + cs - 1) / cs) * cs;
+    for (int i=0; i < n; i++) x[i] *= src.scl;
+    for (int i=n; i < n_pad; i++) x[i] = 0.0f;
+    int i;
+    for (i=0; i < n_pad; i += cs) {
+      //feedback into the microphone
+      for (int k=0; k < cs; k++) {
+        int64_t s = (int64_t)(t + i + k) - delay;
+        if (s >= 0) x[i + k] += z[s & (n_z - 1)];
+      }
+      process_chunk(cp, &x[i], &y[i], cs);
+      afc_qm_update(&qm, cp, ref.data(), (int)ref.size());
+
+      //the output, on its way around the loop
+      for (int k=0; k < cs; k++) {
+        float v = y[i + k];
+        if (!(fabsf(v) < FEEDBACK_SIM_MAX_ABS)) { job.stable = false; v = 0.0f; }
+        if (fabsf(v) > job.peak) job.peak = fabsf(v);
+        y_acc[i_acc++] = v;
+      }
+      if (i_acc == B) {
+        conv.process(y_acc.data(), z_block.data());
+        uint64_t s0 = t + i + cs - B;   //the output sample that y_acc started at
+        for (int k=0; k < B; k++) z[(s0 + k) & (n_z - 1)] = z_block[k];
+        i_acc = 0;
+      }
+      if (!job.stable) { job.unstable_sec = (t + i) / wav_in.rate; n = std::min(n, i + cs); break; }
+    }
+    if (wav_dir) wav_out.write(y.data(), n);
+    t += n;
+  }
+  t_proc = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  gha_host_cleanup(cp);
+  if (wav_dir && !wav_out.close()) { job.msg = "error writing the output"; if (qm_out.f) fclose(qm_out.f); return; }
+  if (qm_out.f) {
+    afc_qm_flush(&qm);
+    bool ok = (fclose(qm_out.f) == 0);
+    ok = write_qm_hist(job_file_name(qm_dir, job) + "_misalign_hist.csv", qm, qm_out.point_sec) && ok;
+    if (!ok) { job.msg = "error writing the misalignment"; return; }
+  }
+
+  job.ok = true;
+  job.audio_sec = t / wav_in.rate;
+  job.final_dB = afc_qm_recent_db(&qm, (int)(1.0 / FEEDBACK_SIM_POINT_SEC));
+  job.speed_ratio = (t_proc > 0) ? job.audio_sec / t_proc : 0.0;
+  job.msg = std::to_string(h.size()) + " taps, " + std::to_string(conv.numPartitions()) + " partitions of " + std::to_string(B);
+}
+
+static void usage(void) {
+  printf("usage: feedback_sim [options] -i source.wav [-i source.wav ...] path.wav ...\n");
+  printf("options\n");
+  printf("  -i fn    source recording (as many as you like).  Each is run with every path and gain\n");
+  printf("  -g list  gain offsets for the paths, in dB (default 0), eg -g 0,5,10,15\n");
+  printf("  -t sec   use at most this much of each source (default: all of it)\n");
+  printf("  -l dB    scale each source to this rms level, in dB SPL (default %.0f)\n", GHA_HOST_RMS_LEV);
+  printf("  -p pre   prescription from a preset (\"file\" or \"file:index\") instead of the sketch's\n");
+  printf("  -c cs    chunk size (default %d, as in the sketch)\n", GHA_CHUNK);
+  printf("  -d n     simulated hardware delay, in samples (default: the prescription's hdel, 38 + 2*cs)\n");
+  printf("  -b n     convolution block size (default: the largest that the delay allows)\n");
+  printf("  -j n     worker threads (default: one per core)\n");
+  printf("  -o csv   also write the results to a csv file\n");
+  printf("  -W dir   write each job's output to a WAV file in dir\n");
+  printf("  -m dir   write each job's misalignment over time to csv files in dir: every %.0f ms (*_misalign.csv)\n", 1000 * FEEDBACK_SIM_POINT_SEC);
+  printf("           and the whole-run trace, at most %d points (*_misalign_hist.csv)\n", AFC_QM_HIST_LEN);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int n_workers = (int)std::thread::hardware_concurrency(), opt;
+  double rms_lev = GHA_HOST_RMS_LEV;
+  const char *preset = NULL, *csv_fn = NULL;
+  std::vector<const char *> source_fns;
+  std::vector<double> gains;
+
+  while ((opt = getopt(argc, argv, "i:g:t:l:p:c:d:b:j:o:W:m:h")) != -1) {
+    switch (opt) {
+      case 'i': source_fns.push_back(optarg); break;
+      case 'g': { char *s = optarg; while (*s) { gains.push_back(strtod(s, &s)); if (*s == ',') s++; else break; } break; }
+      case 't': max_sec = atof(optarg); break;
+      case 'l': rms_lev = atof(optarg); break;
+      case 'p': preset = optarg; break;
+      case 'c': cs = atoi(optarg); break;
+      case 'd': sim_delay = atoi(optarg); break;
+      case 'b': conv_block = atoi(optarg); break;
+      case 'j': n_workers = atoi(optarg); break;
+      case 'o': csv_fn = optarg; break;
+      case 'W': wav_dir = optarg; break;
+      case 'm': qm_dir = optarg; break;
+      default: usage();
+    }
+  }
+  if (source_fns.empty() || (optind >= argc) || (cs < 1) || (cs > 128)) usage();
+  if (gains.empty()) gains.push_back(0.0);
+  if (n_workers < 1) n_workers = 1;
+  gha_verbose = 0;
+
+  //prescription
+  gha_host_default_prescription(&rx, cs);
+  if (preset) {
+    int err = gha_host_load_preset(preset, &rx);
+    if (err != GHA_PRESET_OK) { fprintf(stderr, "feedback_sim: can't load preset %s (error %d)\n", preset, err); return 1; }
+    rx.afc.hdel = 38 + 2 * cs;
+  }
+  rx.afc.fbg = 0;  //our feedback, not CHAPRO's
+  rx.afc.fbl = 0;
+
+  //sources (calibrated like set_spl()), all at the same rate, then the paths
+  double rate = 0;
+  std::vector<float> buf(cs * FEEDBACK_SIM_BLOCK_CHUNKS);
+  for (const char *fn : source_fns) {
+    WavReader wav;
+    double lev;
+    if (!wav.open(fn)) return 1;
+    if ((rate > 0) && (wav.rate != rate)) { fprintf(stderr, "feedback_sim: the sources must all be at the same sample rate\n"); return 1; }
+    rate = wav.rate;
+    Source src;
+    src.fn = fn;
+    src.scl = gha_host_spl_scale(wav, buf.data(), (int)buf.size(), rms_lev, &lev);
+    if (src.scl <= 0) { fprintf(stderr, "feedback_sim: %s is silent\n", fn); return 1; }
+    sources.push_back(src);
+  }
+  for (int i=optind; i < argc; i++) if (!load_ear(argv[i], rate)) return 1;
+
+  std::vector<SimJob> jobs;
+  for (int e=0; e < (int)ears.size(); e++) {
+    for (double gain_dB : gains) {
+      for (int s=0; s < (int)sources.size(); s++) {
+        SimJob job = SimJob();
+        job.ear = e; job.source = s; job.gain_dB = gain_dB;
+        jobs.push_back(job);
+      }
+    }
+  }
+
+  std::vector<std::vector<void *>> contexts(n_workers, std::vector<void *>(NPTR, (void *)NULL));
+  WorkPool pool(n_workers);
+  for (size_t i=0; i < jobs.size(); i++) pool.add((int)i);
+  fprintf(stderr, "feedback_sim: %d paths x %d gains x %d sources = %d jobs on %d workers\n", (int)ears.size(), (int)gains.size(),
+          (int)sources.size(), (int)jobs.size(), n_workers);
+  auto t_start = std::chrono::steady_clock::now();
+  pool.run([&](int j, int w) { run_job(jobs[j], contexts[w].data()); });
+  double wall_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+  //report
+  FILE *csv = csv_fn ? fopen(csv_fn, "w") : NULL;
+  if (csv_fn && !csv) fprintf(stderr, "feedback_sim: can't write %s\n", csv_fn);
+  if (csv) fprintf(csv, "path,gain_dB,source,stable,unstable_at_s,final_misalignment_dB,peak,audio_s,speed_ratio\n");
+  printf("%-24s %7s %-20s %-18s %12s %9s %8s\n", "path", "gain_dB", "source", "result", "misalign_dB", "peak", "speed");
+  double audio_sec = 0;
+  int n_failed = 0;
+  for (const SimJob &job : jobs) {
+    std::string path = base_name(ears[job.ear].fn), source = base_name(sources[job.source].fn);
+    if (!job.ok) { n_failed++; printf("%-24s %+7.1f %-20s *** FAILED: %s ***\n", path.c_str(), job.gain_dB, source.c_str(), job.msg.c_str()); continue; }
+    audio_sec += job.audio_sec;
+    char result[64];
+    if (job.stable) snprintf(result, sizeof(result), "stable");
+    else snprintf(result, sizeof(result), "UNSTABLE at %.2f s", job.unstable_sec);
+    printf("%-24s %+7.1f %-20s %-18s %12.2f %9.3g %7.0fx\n", path.c_str(), job.gain_dB, source.c_str(), result, job.final_dB, job.peak, job.speed_ratio);
+    if (csv) fprintf(csv, "%s,%.2f,%s,%d,%.3f,%.3f,%.6g,%.3f,%.2f\n", path.c_str(), job.gain_dB, source.c_str(), job.stable ? 1 : 0,
+                     job.stable ? 0.0 : job.unstable_sec, job.final_dB, job.peak, job.audio_sec, job.speed_ratio);
+  }
+  if (csv) fclose(csv);
+
+  //gain margin: the largest gain offset at which every source stayed stable
+  printf("\n%-24s %s\n", "path", "largest stable gain offset");
+  for (int e=0; e < (int)ears.size(); e++) {
+    double best = -INFINITY;
+    for (double gain_dB : gains) {
+      bool all_stable = true;
+      for (const SimJob &job : jobs) if ((job.ear == e) && (job.gain_dB == gain_dB) && !(job.ok && job.stable)) all_stable = false;
+      if (all_stable && (gain_dB > best)) best = gain_dB;
+    }
+    if (best > -INFINITY) printf("%-24s %+.1f dB\n", base_name(ears[e].fn).c_str(), best);
+    else printf("%-24s none of those tested\n", base_name(ears[e].fn).c_str());
+  }
+  printf("\nfeedback_sim: %.1f s of audio in %.1f s on %d workers (speed_ratio %.1f overall)\n", audio_sec, wall_sec, n_workers, audio_sec / wall_sec);
+  return (n_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/*
+   fft_conv.h
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Convolution with long impulse responses (hundreds to thousands of taps) for the host programs, by
+            uniformly-partitioned overlap-save: the impulse response is cut into partitions of B taps, each is
+            transformed once (an FFT of 2B points), and each block of B input samples costs one forward FFT,
+            one complex multiply-add per partition, and one inverse FFT.  That is O(log B + L/B) per sample,
+            instead of O(L) per sample for direct convolution.  The convolver itself adds no delay: each call
+            to process() returns the B outputs for the same B inputs that it was given.  Any latency comes from
+            how the caller gathers its input into blocks (eg, feedback_sim waits for a whole block of output
+            before convolving it, which is why its hardware delay must be at least B).
+
+               PartitionedConvolver conv;
+               conv.init(h, n_taps, B);          //B is a power of 2
+               conv.process(x_block, y_block);   //B samples in, B samples out
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_fft_conv_h
+#define _host_fft_conv_h
+
+#include <complex>
+#include <vector>
+#include <math.h>
+
+typedef std::complex<float> cfloat;
+
+//in-place, iterative radix-2 FFT of a fixed power-of-2 size
+class Fft {
+  public:
+    bool init(int _n);
+    void forward(cfloat *x) { transform(x, twiddle.data()); }
+    void inverse(cfloat *x) { transform(x, twiddle_inv.data()); }  //unscaled: divide by n yourself
+    int size(void) { return n; }
+
+  private:
+    int n = 0;
+    std::vector<int> bitrev;
+    std::vector<cfloat> twiddle, twiddle_inv;
+    void transform(cfloat *x, const cfloat *w);
+};
+
+bool Fft::init(int _n) {
+  if ((_n < 2) || (_n & (_n - 1))) return false;
+  n = _n;
+  int log2n = 0;
+  while ((1 << log2n) < n) log2n++;
+  bitrev.resize(n);
+  for (int i=0; i < n; i++) {
+    int r = 0;
+    for (int b=0; b < log2n; b++) if (i & (1 << b)) r |= 1 << (log2n - 1 - b);
+    bitrev[i] = r;
+  }
+  twiddle.resize(n / 2);
+  twiddle_inv.resize(n / 2);
+  for (int i=0; i < n / 2; i++) {
+    double a = 2 * M_PI * i / n;
+    twiddle[i] = cfloat((float)cos(a), (float)-sin(a));
+    twiddle_inv[i] = std::conj(twiddle[i]);
+  }
+  return true;
+}
+
+void Fft::transform(cfloat *x, const cfloat *w) {
+  for (int i=0; i < n; i++) if (i < bitrev[i]) std::swap(x[i], x[bitrev[i]]);
+  for (int len=2; len <= n; len <<= 1) {
+    int half = len / 2, step = n / len;
+    for (int i=0; i < n; i += len) {
+      for (int k=0; k < half; k++) {
+        cfloat t = w[k * step] * x[i + k + half];
+        x[i + k + half] = x[i + k] - t;
+        x[i + k] += t;
+      }
+    }
+  }
+}
+
+class PartitionedConvolver {
+  public:
+    bool init(const float *h, int n_taps, int block_size);
+    void process(const float *x, float *y);  //block_size samples in and out
+    void reset(void);                        //forget the past input (keeps the impulse response)
+    int blockSize(void) { return B; }
+    int numPartitions(void) { return P; }
+
+  private:
+    int B = 0, P = 0, n_bins = 0;    //block size, partitions, bins kept (0..B, the rest are conjugates)
+    int i_fdl = 0;                   //where the newest input spectrum is in the frequency-domain delay line
+    Fft fft;
+    std::vector<cfloat> H;           //P partition spectra, n_bins each
+    std::vector<cfloat> fdl;         //P past input spectra, n_bins each
+    std::vector<float> x_prev;       //the previous input block (overlap-save)
+    std::vector<cfloat> work;        //2B points
+    std::vector<cfloat> acc;         //n_bins
+};
+
+bool PartitionedConvolver::init(const float *h, int n_taps, int block_size) {
+  if ((n_taps < 1) || !fft.init(2 * block_size)) return false;
+  B = block_size;
+  P = (n_taps + B - 1) / B;
+  n_bins = B + 1;
+  H.assign((size_t)P * n_bins, cfloat(0, 0));
+  fdl.assign((size_t)P * n_bins, cfloat(0, 0));
+  x_prev.assign(B, 0.0f);
+  work.resize(2 * B);
+  acc.resize(n_bins);
+  for (int p=0; p < P; p++) {
+    for (int i=0; i < 2 * B; i++) {
+      int k = p * B + i;
+      work[i] = cfloat(((i < B) && (k < n_taps)) ? h[k] : 0.0f, 0.0f);
+    }
+    fft.forward(work.data());
+    for (int i=0; i < n_bins; i++) H[(size_t)p * n_bins + i] = work[i] / (float)(2 * B);  //fold in the inverse FFT's scaling
+  }
+  i_fdl = 0;
+  return true;
+}
+
+void PartitionedConvolver::reset(void) {
+  std::fill(fdl.begin(), fdl.end(), cfloat(0, 0));
+  std::fill(x_prev.begin(), x_prev.end(), 0.0f);
+  i_fdl = 0;
+}
+
+void PartitionedConvolver::process(const float *x, float *y) {
+  //spectrum of [previous block, this block] into the delay line
+  for (int i=0; i < B; i++) { work[i] = cfloat(x_prev[i], 0.0f); work[B + i] = cfloat(x[i], 0.0f); x_prev[i] = x[i]; }
+  fft.forward(work.data());
+  i_fdl = (i_fdl + P - 1) % P;
+  cfloat *X = &fdl[(size_t)i_fdl * n_bins];
+  for (int i=0; i < n_bins; i++) X[i] = work[i];
+
+  //multiply-add every partition with the input from that many blocks ago
+  std::fill(acc.begin(), acc.end(), cfloat(0, 0));
+  for (int p=0; p < P; p++) {
+    const cfloat *Hp = &H[(size_t)p * n_bins];
+    const cfloat *Xp = &fdl[(size_t)((i_fdl + p) % P) * n_bins];
+    for (int i=0; i < n_bins; i++) acc[i] += Hp[i] * Xp[i];
+  }
+
+  //back to the time domain; the second half is the new output (the first half is wrapped around)
+  for (int i=0; i < n_bins; i++) work[i] = acc[i];
+  for (int i=1; i < B; i++) work[2 * B - i] = std::conj(acc[i]);
+  fft.inverse(work.data());
+  for (int i=0; i < B; i++) y[i] = work[B + i].real();
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*
+   gha_batch
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Run many WAV files through the CHAPRO_WDRC sketch's processing at once, using every core.  Each file
+            is a job with its own CHAPRO context and, optionally, its own prescription (a preset from a GhaPreset
+            file, as saved by the sketch's PresetManager).  The jobs run on a work-stealing thread pool (see
+            work_pool.h).
+
+            The contexts are prepared by the sketch's own prepare() (one at a time, as it works through the
+            globals in test_gha.h, see gha_host.h), and are then processed by process_chunk() in parallel.  Each
+            file is streamed a block at a time (see wav_io.h), and calibrated like set_spl() (see gha_wav.cpp).
+
+            The jobs come from a job file, one per line (blank lines and lines starting with '#' are skipped):
+
+               input.wav  output.wav  [preset]         preset is "file" or "file:index"
+
+            or from the command line, with -d for where to put the outputs (same names as the inputs).
+
+            At the end, it reports the throughput in audio-hours per wall-clock second, and how busy the workers
+            were (the parallel efficiency: 100% means that the processing scaled linearly with the workers).
+
+            Build (from the top of the repo, with CHAPRO's sources built into libchapro.a, see README.md):
+
+               g++ -std=gnu++14 -O2 -pthread -Ihost/shim -ICHAPRO_WDRC -I$CHAPRO host/gha_batch.cpp $CHAPRO/libchapro.a -lm -o gha_batch
+               ./gha_batch -J jobs.txt
+               ./gha_batch -d processed rec1.wav rec2.wav rec3.wav
+
+   MIT License.  use at your own risk.
+*/
+
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <Arduino.h>
+#include "gha_host.h"
+#include "work_pool.h"
+
+#define GHA_BATCH_BLOCK_CHUNKS 256   //chunks per file read and write
+
+typedef struct {
+  std::string ifn, ofn, preset;
+  //results
+  bool ok;
+  std::string msg;
+  double audio_sec, proc_sec;        //duration of the audio, and time spent in process_chunk()
+} BatchJob;
+
+static int cs = GHA_CHUNK, out_bits = 16;
+static double rms_lev = GHA_HOST_RMS_LEV, fixed_scale = 0;
+static const char *default_preset = NULL;
+static bool verbose = false;
+
+static bool read_job_file(const char *fn, std::vector<BatchJob> &jobs) {
+  FILE *f = fopen(fn, "r");
+  if (f == NULL) { fprintf(stderr, "gha_batch: can't open %s\n", fn); return false; }
+  char line[2048], a[1024], b[1024], c[1024];
+  int line_no = 0;
+  while (fgets(line, sizeof(line), f)) {
+    line_no++;
+    int n = sscanf(line, "%1023s %1023s %1023s", a, b, c);
+    if ((n <= 0) || (a[0] == '#')) continue;
+    if (n < 2) { fprintf(stderr, "gha_batch: %s:%d: needs an input and an output file\n", fn, line_no); fclose(f); return false; }
+    BatchJob job = BatchJob();
+    job.ifn = a; job.ofn = b;
+    if (n >= 3) job.preset = c;
+    jobs.push_back(job);
+  }
+  fclose(f);
+  return true;
+}
+
+//one job, on one worker.  cp and the buffers belong to the worker
+static void run_job(BatchJob &job, CHA_PTR cp, float *x, float *y, int n_block) {
+  GhaPrescription rx;
+  WavReader wav_in;
+  WavWriter wav_out;
+  float scl;
+  double lev;
+
+  job.ok = false;
+  if (!wav_in.open(job.ifn.c_str())) { job.msg = "can't read the input"; return; }
+
+  //prescription
+  gha_host_default_prescription(&rx, cs);
+  const char *preset = !job.preset.empty() ? job.preset.c_str() : default_preset;
+  if (preset) {
+    int err = gha_host_load_preset(preset, &rx);
+    if (err != GHA_PRESET_OK) { job.msg = "can't load preset " + std::string(preset) + " (error " + std::to_string(err) + ")"; return; }
+  }
+
+  //level
+  if (fixed_scale > 0) {
+    scl = (float)fixed_scale;
+  } else {
+    scl = gha_host_spl_scale(wav_in, x, n_block, rms_lev, &lev);
+    if (scl <= 0) { job.msg = "the input is silent"; return; }
+  }
+
+  const char *why_not = gha_host_prepare(cp, &rx, wav_in.rate, cs);
+  if (why_not) { job.msg = why_not; return; }
+  if (!wav_out.open(job.ofn.c_str(), wav_in.rate, out_bits)) { job.msg = "can't create the output"; gha_host_cleanup(cp); return; }
+
+  //stream it through, as gha_wav does
+  double t_proc = 0;
+  int n;
+  while ((n = wav_in.read(x, n_block)) > 0) {
+    for (int i=0; i < n; i++) x[i] *= scl;
+    int n_pad = ((n + cs - 1) / cs) * cs;
+    for (int i=n; i < n_pad; i++) x[i] = 0.0f;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i=0; i < n_pad; i += cs) process_chunk(cp, x + i, y + i, cs);
+    t_proc += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    wav_out.write(y, n);
+  }
+  gha_host_cleanup(cp);
+  if (!wav_out.close()) { job.msg = "error writing the output"; return; }
+
+  job.ok = true;
+  job.audio_sec = wav_out.n_samples / wav_in.rate;
+  job.proc_sec = t_proc;
+  job.msg = std::string("preset \"") + rx.name + "\"";
+  if (wav_out.n_clipped) job.msg += ", " + std::to_string(wav_out.n_clipped) + " samples clipped";
+}
+
+static void usage(void) {
+  printf("usage: gha_batch [options] -J jobs.txt\n");
+  printf("       gha_batch [options] -d outdir input.wav ...\n");
+  printf("options\n");
+  printf("  -j n     worker threads (default: one per core, %u here)\n", std::thread::hardware_concurrency());
+  printf("  -c cs    chunk size (default %d, as in the sketch)\n", GHA_CHUNK);
+  printf("  -l dB    scale each input to this rms level, in dB SPL (default %.0f)\n", GHA_HOST_RMS_LEV);
+  printf("  -s scl   scale the inputs by scl instead (single pass, no rms measurement)\n");
+  printf("  -p pre   preset for the jobs that don't name one (\"file\" or \"file:index\")\n");
+  printf("  -f       write 32-bit float samples (default is 16-bit)\n");
+  printf("  -v       report each job\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int n_workers = (int)std::thread::hardware_concurrency(), opt;
+  const char *job_fn = NULL, *out_dir = NULL;
+  std::vector<BatchJob> jobs;
+
+  while ((opt = getopt(argc, argv, "J:d:j:c:l:s:p:fvh")) != -1) {
+    switch (opt) {
+      case 'J': job_fn = optarg; break;
+      case 'd': out_dir = optarg; break;
+      case 'j': n_workers = atoi(optarg); break;
+      case 'c': cs = atoi(optarg); break;
+      case 'l': rms_lev = atof(optarg); break;
+      case 's': fixed_scale = atof(optarg); break;
+      case 'p': default_preset = optarg; break;
+      case 'f': out_bits = 32; break;
+      case 'v': verbose = true; break;
+      default: usage();
+    }
+  }
+  if (n_workers < 1) n_workers = 1;
+  if ((cs < 1) || (cs > 128)) usage();
+  if (job_fn) {
+    if (!read_job_file(job_fn, jobs)) return 1;
+  } else if (out_dir && (optind < argc)) {
+    for (int i=optind; i < argc; i++) {
+      BatchJob job = BatchJob();
+      job.ifn = argv[i];
+      const char *base = strrchr(argv[i], '/');
+      job.ofn = std::string(out_dir) + "/" + (base ? base + 1 : argv[i]);
+      jobs.push_back(job);
+    }
+  } else {
+    usage();
+  }
+  if (jobs.empty()) { fprintf(stderr, "gha_batch: no jobs\n"); return 1; }
+  gha_verbose = 0;
+
+  //one context and one pair of buffers per worker, made once
+  int n_block = cs * GHA_BATCH_BLOCK_CHUNKS;
+  std::vector<std::vector<void *>> contexts(n_workers, std::vector<void *>(NPTR, (void *)NULL));
+  std::vector<std::vector<float>> x_bufs(n_workers, std::vector<float>(n_block)), y_bufs(n_workers, std::vector<float>(n_block));
+  std::vector<double> busy_sec(n_workers, 0.0);
+  std::mutex print_lock;
+  std::atomic<int> n_done(0);
+
+  WorkPool pool(n_workers);
+  for (size_t i=0; i < jobs.size(); i++) pool.add((int)i);
+  fprintf(stderr, "gha_batch: %d jobs on %d workers\n", (int)jobs.size(), n_workers);
+
+  auto t_start = std::chrono::steady_clock::now();
+  pool.run([&](int j, int w) {
+    auto t0 = std::chrono::steady_clock::now();
+    run_job(jobs[j], contexts[w].data(), x_bufs[w].data(), y_bufs[w].data(), n_block);
+    busy_sec[w] += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    int done = ++n_done;
+    if (verbose || !jobs[j].ok) {
+      std::lock_guard<std::mutex> lock(print_lock);
+      const BatchJob &job = jobs[j];
+      if (job.ok) printf("gha_batch: [%d/%d] %s: %.1f s of audio, speed_ratio %.1f, %s\n", done, (int)jobs.size(), job.ifn.c_str(),
+                         job.audio_sec, (job.proc_sec > 0) ? job.audio_sec / job.proc_sec : 0.0, job.msg.c_str());
+      else printf("gha_batch: [%d/%d] %s: *** FAILED: %s ***\n", done, (int)jobs.size(), job.ifn.c_str(), job.msg.c_str());
+    }
+  });
+  double wall_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+  //report
+  int n_ok = 0;
+  double audio_sec = 0, proc_sec = 0, busy = 0;
+  for (const BatchJob &job : jobs) if (job.ok) { n_ok++; audio_sec += job.audio_sec; proc_sec += job.proc_sec; }
+  for (double b : busy_sec) busy += b;
+  printf("gha_batch: %d of %d jobs done, %.3f hours of audio in %.2f s on %d workers (%lu jobs stolen)\n", n_ok, (int)jobs.size(),
+         audio_sec / 3600, wall_sec, n_workers, pool.n_stolen);
+  printf("gha_batch: throughput %.4f audio-hours per wall-second (speed_ratio %.1f overall, %.1f per worker in process_chunk)\n",
+         audio_sec / 3600 / wall_sec, audio_sec / wall_sec, (proc_sec > 0) ? audio_sec / proc_sec : 0.0);
+  printf("gha_batch: parallel efficiency %.0f%% (time the workers were busy / (wall time * workers))\n", 100 * busy / (wall_sec * n_workers));
+  return (n_ok == (int)jobs.size()) ? 0 : 1;
+}
@@ -0,0 +1,348 @@
+/*
+   gha_bench
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Measure how the CPU cost of the CHAPRO_WDRC sketch's processing depends on the settings in
+            configure_compressor() and configure_feedback(), so that a prescription can be budgeted before it
+            is flashed.  Each setting is prepared with the sketch's own configure() and prepare() and timed
+            through process_chunk(), with calibrated noise (65 dB SPL) as the input.
+
+            The settings that can be swept ("knobs") are:
+
+               cs    chunk size (samples per call to process_chunk(), ie, the audio block size)
+               nc    number of channels (the crossovers are spread out over the sketch's range of crossovers)
+               nz    filterbank filter order
+               td    filterbank delay (ms)
+               afl   AFC adaptive filter length
+               wfl   AFC whiten filter length
+               pfl   AFC band-limit filter length
+               afc   AFC on (1) or off (0, the way setAfcEnabled() turns it off)
+
+            By default, each knob is swept on its own while the others stay at the sketch's values.  With -a,
+            every combination is run.  Each setting is run -w times to warm up (not counted) and then -r more
+            times, and the statistics of those are reported.  Where a setting has the chunk size and the AFC
+            setting of one of the GhaChain instantiations below, GhaChain is timed as well, as a second "path".
+
+            Reported, per setting and path (mean, median, min, max, and standard deviation over the repetitions):
+               ns_per_block        time per call, ie, per chunk of cs samples
+               cycles_per_sample   CPU cycles per sample (see bench_util.h for where the cycles come from)
+               rtf                 real-time factor: processing time / duration of the audio (< 1 is faster than real time)
+
+            Build (from the top of the repo, with CHAPRO's sources built into libchapro.a, see README.md):
+
+               g++ -std=gnu++14 -O2 -Ihost/shim -ICHAPRO_WDRC -I$CHAPRO host/gha_bench.cpp $CHAPRO/libchapro.a -lm -o gha_bench
+               ./gha_bench -o sweep.csv -j sweep.json
+               ./gha_bench -p cs=8,32,128 -p nc=4,8 -a
+
+   MIT License.  use at your own risk.
+*/
+
+#include <Arduino.h>
+#include "bench_util.h"
+#include "test_gha.h"
+#include "GhaChain.h"
+#include <string>
+
+#define GHA_BENCH_MAX_CHUNK 128
+
+// ///////////////////////////////////////// the knobs
+enum { K_CS = 0, K_NC, K_NZ, K_TD, K_AFL, K_WFL, K_PFL, K_AFC, N_KNOBS };
+static const char *knob_name[N_KNOBS] = {"cs", "nc", "nz", "td", "afl", "wfl", "pfl", "afc"};
+static std::vector<double> knob_values[N_KNOBS] = {
+  {8, 16, 32, 64, 128},
+  {2, 4, 6, 8},
+  {2, 3, 4},
+  {1.0, 2.5, 5.0},
+  {21, 42, 84, 150},
+  {0, 5, 9, 20},
+  {0, 10, 20, 36, 64},
+  {1, 0}
+};
+typedef struct { double v[N_KNOBS]; } BenchConfig;
+
+// ///////////////////////////////////////// GhaChain instantiations to compare with process_chunk()
+typedef struct {
+  int cs;
+  bool afc;
+  bool (*matches)(CHA_PTR cp);
+  void (*process_block)(CHA_PTR cp, float *x, float *y, int n);
+} ChainEntry;
+#define GHA_BENCH_CHAIN(CS, AFC) { CS, AFC::enabled, GhaChain<CS, AFC>::matches, GhaChain<CS, AFC>::process_block }
+static const ChainEntry chains[] = {
+  GHA_BENCH_CHAIN(8, AfcOn),  GHA_BENCH_CHAIN(16, AfcOn),  GHA_BENCH_CHAIN(32, AfcOn),
+  GHA_BENCH_CHAIN(64, AfcOn), GHA_BENCH_CHAIN(128, AfcOn),
+  GHA_BENCH_CHAIN(8, AfcOff),  GHA_BENCH_CHAIN(16, AfcOff),  GHA_BENCH_CHAIN(32, AfcOff),
+  GHA_BENCH_CHAIN(64, AfcOff), GHA_BENCH_CHAIN(128, AfcOff),
+};
+static const int n_chains = sizeof(chains) / sizeof(chains[0]);
+
+// ///////////////////////////////////////// results
+typedef struct {
+  BenchConfig config;
+  const char *path;
+  int n_samples;                     //per repetition
+  BenchStats ns_per_block, cycles_per_sample, rtf;
+} BenchResult;
+
+static int warmup = 2, reps = 10;
+static double seconds_per_rep = 1.0, level_dB = 65;
+static CycleCounter cycles;
+
+// ///////////////////////////////////////// setting up the sketch's processing for a config
+
+//spread nc channels over the same range of crossovers as the configured prescription.  Each new band takes its
+//prescription from the nearest original band.
+static void set_channels(CHA_DSL *dsl, int nc) {
+  CHA_DSL orig = *dsl;
+  int nc0 = orig.nchannel;
+  if ((nc == nc0) || (nc0 < 2)) return;
+  double f_lo = orig.cross_freq[0], f_hi = orig.cross_freq[nc0 - 2];
+  for (int i=0; i < nc - 1; i++) {
+    dsl->cross_freq[i] = (nc == 2) ? sqrt(f_lo * f_hi) : f_lo * pow(f_hi / f_lo, (double)i / (nc - 2));
+  }
+  for (int i=0; i < nc; i++) {
+    int j = (nc > 1) ? (int)(i * (nc0 - 1.0) / (nc - 1.0) + 0.5) : 0;
+    dsl->tkgain[i] = orig.tkgain[j];
+    dsl->cr[i] = orig.cr[j];
+    dsl->tk[i] = orig.tk[j];
+    dsl->bolt[i] = orig.bolt[j];
+  }
+  dsl->nchannel = nc;
+}
+
+//can the sketch prepare this?  Returns NULL if so, or else the reason why not
+static const char *check_config(const BenchConfig &c) {
+  int cs = (int)c.v[K_CS], nc = (int)c.v[K_NC], nz = (int)c.v[K_NZ];
+  if ((cs < 1) || (cs > GHA_BENCH_MAX_CHUNK)) return "cs out of range";
+  if ((nc < 1) || (nc > FB_CACHE_MXCH)) return "nc is more than prepare_filterbank() can hold";
+  if ((nz < 1) || (2 * nz * nc > FB_CACHE_MXZP)) return "2*nz*nc is more than prepare_filterbank() can hold";
+  if ((c.v[K_AFL] < 1) || (c.v[K_AFL] > AFC_MAX_AFL)) return "afl out of range (1 to AFC_MAX_AFL)";
+  if ((c.v[K_WFL] < 0) || (c.v[K_WFL] > AFC_MAX_WFL)) return "wfl out of range (0 to AFC_MAX_WFL)";
+  if ((c.v[K_PFL] < 0) || (c.v[K_PFL] > AFC_MAX_PFL)) return "pfl out of range (0 to AFC_MAX_PFL)";
+  return NULL;
+}
+
+static void prepare_config(CHA_PTR cp, const BenchConfig &c) {
+  static I_O io;
+  if (cp[_size] != NULL) { cha_cleanup(cp); memset(cp, 0, NPTR * sizeof(void *)); }
+  configure(&io);                     //back to the sketch's settings...
+  set_channels(&dsl_global, (int)c.v[K_NC]);
+  agc_global.nz = (int)c.v[K_NZ];
+  agc_global.td = c.v[K_TD];
+  afc_global.afl = (int)c.v[K_AFL];
+  afc_global.wfl = (int)c.v[K_WFL];
+  afc_global.pfl = (int)c.v[K_PFL];
+  chunk = (int)c.v[K_CS];
+  afc_global.hdel = 38 + 2 * chunk;    //as in afc_global
+  prepare(&io, cp);                   //...and then prepared the same way as the sketch
+  if (c.v[K_AFC] == 0) CHA_IVAR[_mxl] = 0;  //as setAfcEnabled(false) does
+}
+
+// ///////////////////////////////////////// timing
+
+static BenchResult run_config(CHA_PTR cp, const BenchConfig &c, const ChainEntry *chain, const float *x_ref, float *x, float *y, int n) {
+  std::vector<double> ns_block, cyc_sample, rtf;
+  int cs = (int)c.v[K_CS];
+  n = (n / cs) * cs;  //whole chunks only
+  double t_audio_ns = 1e9 * n / srate;
+
+  prepare_config(cp, c);  //fresh context for each path, so that both start from the same AFC state
+  for (int r=0; r < warmup + reps; r++) {
+    memcpy(x, x_ref, n * sizeof(float));  //the AFC writes its output back into x
+    uint64_t c0 = cycles.read(), t0 = bench_now_ns();
+    if (chain) {
+      chain->process_block(cp, x, y, n);
+    } else {
+      for (int i=0; i < n; i += cs) process_chunk(cp, x + i, y + i, cs);
+    }
+    uint64_t t1 = bench_now_ns(), c1 = cycles.read();
+    if (r < warmup) continue;
+    ns_block.push_back((double)(t1 - t0) / (n / cs));
+    cyc_sample.push_back((double)(c1 - c0) / n);
+    rtf.push_back((t1 - t0) / t_audio_ns);
+  }
+
+  BenchResult res;
+  res.config = c;
+  res.path = chain ? "GhaChain" : "process_chunk";
+  res.n_samples = n;
+  res.ns_per_block = bench_stats(ns_block);
+  res.cycles_per_sample = bench_stats(cyc_sample);
+  res.rtf = bench_stats(rtf);
+  return res;
+}
+
+// ///////////////////////////////////////// output
+
+static void print_csv(FILE *f, const std::vector<BenchResult> &results) {
+  const char *stat_names[] = {"mean", "median", "min", "max", "std"};
+  fprintf(f, "path");
+  for (int k=0; k < N_KNOBS; k++) fprintf(f, ",%s", knob_name[k]);
+  fprintf(f, ",samples,warmup,reps");
+  for (const char *m : {"ns_per_block", "cycles_per_sample", "rtf"}) {
+    for (const char *s : stat_names) fprintf(f, ",%s_%s", m, s);
+  }
+  fprintf(f, "\n");
+  for (const BenchResult &r : results) {
+    fprintf(f, "%s", r.path);
+    for (int k=0; k < N_KNOBS; k++) fprintf(f, ",%g", r.config.v[k]);
+    fprintf(f, ",%d,%d,%d", r.n_samples, warmup, reps);
+    for (const BenchStats *s : {&r.ns_per_block, &r.cycles_per_sample, &r.rtf}) {
+      fprintf(f, ",%.6g,%.6g,%.6g,%.6g,%.6g", s->mean, s->median, s->min, s->max, s->stddev);
+    }
+    fprintf(f, "\n");
+  }
+}
+
+static void print_json_stats(FILE *f, const char *name, const BenchStats &s) {
+  fprintf(f, "\"%s\": {\"mean\": %.6g, \"median\": %.6g, \"min\": %.6g, \"max\": %.6g, \"std\": %.6g}", name, s.mean, s.median, s.min, s.max, s.stddev);
+}
+
+static void print_json(FILE *f, const std::vector<BenchResult> &results) {
+  fprintf(f, "{\n  \"srate\": %.0f,\n  \"input_dB_SPL\": %.1f,\n  \"seconds_per_rep\": %g,\n", srate, level_dB, seconds_per_rep);
+  fprintf(f, "  \"warmup\": %d,\n  \"reps\": %d,\n  \"cycle_source\": \"%s\",\n  \"results\": [\n", warmup, reps, cycles.cycle_source);
+  for (size_t i=0; i < results.size(); i++) {
+    const BenchResult &r = results[i];
+    fprintf(f, "    {\"path\": \"%s\"", r.path);
+    for (int k=0; k < N_KNOBS; k++) fprintf(f, ", \"%s\": %g", knob_name[k], r.config.v[k]);
+    fprintf(f, ", \"samples\": %d,\n     ", r.n_samples);
+    print_json_stats(f, "ns_per_block", r.ns_per_block); fprintf(f, ",\n     ");
+    print_json_stats(f, "cycles_per_sample", r.cycles_per_sample); fprintf(f, ",\n     ");
+    print_json_stats(f, "rtf", r.rtf);
+    fprintf(f, "}%s\n", (i + 1 < results.size()) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+}
+
+// ///////////////////////////////////////// the sweep
+
+static void usage(void) {
+  printf("usage: gha_bench [options]\n");
+  printf("options\n");
+  printf("  -p knob=v1,v2,...  values to sweep for one knob (cs, nc, nz, td, afl, wfl, pfl, afc).  Repeat for more knobs\n");
+  printf("  -a                 run every combination, instead of one knob at a time\n");
+  printf("  -w n               warm-up runs per setting, not counted (default %d)\n", warmup);
+  printf("  -r n               counted runs per setting (default %d)\n", reps);
+  printf("  -t sec             seconds of audio per run (default %g)\n", seconds_per_rep);
+  printf("  -l dB              input level, dB SPL (default %g)\n", level_dB);
+  printf("  -o file.csv        write CSV to this file (default: CSV to stdout)\n");
+  printf("  -j file.json       write JSON to this file\n");
+  exit(1);
+}
+
+static bool parse_knob(const char *arg) {
+  const char *eq = strchr(arg, '=');
+  if (eq == NULL) return false;
+  std::string name(arg, eq - arg);
+  for (int k=0; k < N_KNOBS; k++) {
+    if (name != knob_name[k]) continue;
+    knob_values[k].clear();
+    for (const char *p = eq + 1; *p; ) {
+      char *end;
+      knob_values[k].push_back(strtod(p, &end));
+      if (end == p) return false;
+      p = (*end == ',') ? end + 1 : end;
+    }
+    return !knob_values[k].empty();
+  }
+  return false;
+}
+
+static void add_config(std::vector<BenchConfig> &list, const BenchConfig &c) {
+  for (const BenchConfig &e : list) if (memcmp(&e, &c, sizeof(c)) == 0) return;
+  list.push_back(c);
+}
+
+int main(int argc, char **argv) {
+  static void *cp[NPTR] = {0};
+  static I_O io;
+  bool all_combinations = false;
+  const char *csv_fn = NULL, *json_fn = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:aw:r:t:l:o:j:h")) != -1) {
+    switch (opt) {
+      case 'p': if (!parse_knob(optarg)) { fprintf(stderr, "gha_bench: bad -p %s\n", optarg); usage(); } break;
+      case 'a': all_combinations = true; break;
+      case 'w': warmup = atoi(optarg); break;
+      case 'r': reps = atoi(optarg); break;
+      case 't': seconds_per_rep = atof(optarg); break;
+      case 'l': level_dB = atof(optarg); break;
+      case 'o': csv_fn = optarg; break;
+      case 'j': json_fn = optarg; break;
+      default: usage();
+    }
+  }
+  if ((reps < 1) || (warmup < 0) || (seconds_per_rep <= 0)) usage();
+  gha_verbose = 0;
+  cycles.begin();
+
+  //the sketch's own settings are the starting point
+  configure(&io);
+  BenchConfig base;
+  base.v[K_CS] = chunk; base.v[K_NC] = dsl_global.nchannel; base.v[K_NZ] = agc_global.nz; base.v[K_TD] = agc_global.td;
+  base.v[K_AFL] = afc_global.afl; base.v[K_WFL] = afc_global.wfl; base.v[K_PFL] = afc_global.pfl; base.v[K_AFC] = 1;
+
+  std::vector<BenchConfig> configs;
+  if (all_combinations) {
+    size_t n_total = 1;
+    for (int k=0; k < N_KNOBS; k++) n_total *= knob_values[k].size();
+    for (size_t i=0; i < n_total; i++) {
+      BenchConfig c;
+      size_t rem = i;
+      for (int k=0; k < N_KNOBS; k++) { c.v[k] = knob_values[k][rem % knob_values[k].size()]; rem /= knob_values[k].size(); }
+      add_config(configs, c);
+    }
+  } else {
+    add_config(configs, base);
+    for (int k=0; k < N_KNOBS; k++) {
+      for (double v : knob_values[k]) { BenchConfig c = base; c.v[k] = v; add_config(configs, c); }
+    }
+  }
+
+  //the same input for every setting, a whole number of the largest chunk
+  int n = (int)(seconds_per_rep * srate);
+  n = ((n + GHA_BENCH_MAX_CHUNK - 1) / GHA_BENCH_MAX_CHUNK) * GHA_BENCH_MAX_CHUNK;
+  float *x_ref = (float *)malloc(n * sizeof(float)), *x = (float *)malloc(n * sizeof(float)), *y = (float *)malloc(n * sizeof(float));
+  bench_fill_noise(x_ref, n, level_dB, 12345);
+
+  fprintf(stderr, "gha_bench: %d settings, %d+%d runs of %.2f s each, cycles from %s\n", (int)configs.size(), warmup, reps, n / srate, cycles.cycle_source);
+  std::vector<BenchResult> results;
+  for (size_t i=0; i < configs.size(); i++) {
+    const BenchConfig &c = configs[i];
+    const char *why_not = check_config(c);
+    if (why_not) {
+      fprintf(stderr, "gha_bench: skipping");
+      for (int k=0; k < N_KNOBS; k++) fprintf(stderr, " %s=%g", knob_name[k], c.v[k]);
+      fprintf(stderr, ": %s\n", why_not);
+      continue;
+    }
+    results.push_back(run_config(cp, c, NULL, x_ref, x, y, n));
+    for (int j=0; j < n_chains; j++) {
+      const ChainEntry &ch = chains[j];
+      if ((ch.cs != c.v[K_CS]) || (ch.afc != (c.v[K_AFC] != 0))) continue;
+      prepare_config(cp, c);
+      if (!ch.matches(cp)) continue;
+      results.push_back(run_config(cp, c, &ch, x_ref, x, y, n));
+    }
+    fprintf(stderr, "gha_bench: %d/%d:", (int)i + 1, (int)configs.size());
+    for (int k=0; k < N_KNOBS; k++) fprintf(stderr, " %s=%g", knob_name[k], c.v[k]);
+    fprintf(stderr, ": rtf %.4g\n", results.back().rtf.median);
+  }
+
+  //output
+  FILE *f = csv_fn ? fopen(csv_fn, "w") : stdout;
+  if (f == NULL) { fprintf(stderr, "gha_bench: can't create %s\n", csv_fn); return 1; }
+  print_csv(f, results);
+  if (csv_fn) fclose(f);
+  if (json_fn) {
+    if ((f = fopen(json_fn, "w")) == NULL) { fprintf(stderr, "gha_bench: can't create %s\n", json_fn); return 1; }
+    print_json(f, results);
+    fclose(f);
+  }
+
+  cha_cleanup(cp);
+  free(x_ref); free(x); free(y);
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+   gha_host.h
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Shared pieces for the host programs that run the CHAPRO_WDRC sketch's processing on files: setting
+            up a CHAPRO context from a prescription, at a file's sample rate and any chunk size, and calibrating
+            the input level like set_spl() in tst_gha.c.
+
+            The sketch's prepare() works through the globals in test_gha.h (dsl_global, agc_global, afc_global,
+            srate, chunk, and the filterbank cache), so gha_host_prepare() holds a lock while it fills them in
+            and calls prepare().  Once prepared, a context holds everything that process_chunk() needs (CHAPRO
+            keeps all of its state in the context), so any number of contexts can then be run at the same
+            time, on different threads.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_gha_host_h
+#define _host_gha_host_h
+
+#include <mutex>
+#include "wav_io.h"
+#include "test_gha.h"
+#include "GhaPreset.h"
+
+#define GHA_HOST_SPL_REF 1.1219e-6   //same as set_spl() in tst_gha.c
+#define GHA_HOST_RMS_LEV 65.0
+
+typedef struct {
+  CHA_DSL dsl;
+  CHA_WDRC agc;
+  CHA_AFC afc;
+  char name[GHA_PRESET_NAME_LEN];
+} GhaPrescription;
+
+static std::mutex gha_host_prepare_lock;  //for the globals in test_gha.h
+
+//the sketch's own prescription (configure()), with the hardware delay for this chunk size (as in afc_global)
+static void gha_host_default_prescription(GhaPrescription *rx, int cs) {
+  static I_O io;
+  std::lock_guard<std::mutex> lock(gha_host_prepare_lock);
+  configure(&io);
+  rx->dsl = dsl_global;
+  rx->agc = agc_global;
+  rx->afc = afc_global;
+  rx->afc.hdel = 38 + 2 * cs;
+  strcpy(rx->name, "sketch");
+}
+
+//a preset from a GhaPreset file (as saved on the SD card by PresetManager).  spec is "file" or "file:index".
+//Returns GHA_PRESET_OK or one of the GHA_PRESET errors.
+static int gha_host_load_preset(const char *spec, GhaPrescription *rx) {
+  char fname[512];
+  int index = 0;
+  GhaPresetFileHeader hdr;
+  GhaPresetRecord rec;
+  int err;
+
+  strncpy(fname, spec, sizeof(fname) - 1); fname[sizeof(fname) - 1] = '\0';
+  char *colon = strrchr(fname, ':');
+  if (colon) { index = atoi(colon + 1); *colon = '\0'; }
+
+  gha_host_default_prescription(rx, GHA_CHUNK);  //for the AFC fields that a preset doesn't hold
+  FILE *f = fopen(fname, "rb");
+  if (f == NULL) return GHA_PRESET_IO_ERROR;
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1) { fclose(f); return GHA_PRESET_IO_ERROR; }
+  if ((err = gha_preset_header_check(&hdr)) != GHA_PRESET_OK) { fclose(f); return err; }
+  if ((index < 0) || (index >= hdr.n_presets)) { fclose(f); return GHA_PRESET_BAD_INDEX; }
+  if ((fseek(f, (long)gha_preset_record_offset(index), SEEK_SET) != 0) || (fread(&rec, sizeof(rec), 1, f) != 1)) { fclose(f); return GHA_PRESET_IO_ERROR; }
+  fclose(f);
+  if ((err = gha_preset_unpack(&rec, &rx->dsl, &rx->agc, &rx->afc)) != GHA_PRESET_OK) return err;
+  memcpy(rx->name, rec.name, GHA_PRESET_NAME_LEN);
+  rx->name[GHA_PRESET_NAME_LEN - 1] = '\0';
+  return GHA_PRESET_OK;
+}
+
+//prepare cp (which must be empty) for this prescription, at sample rate sr and chunk size cs, the same way that
+//the sketch does it.  (To follow the AFC's misalignment, use AfcQualityMetric.h rather than afc.sqm.)
+//Returns NULL, or the reason why it can't be prepared.
+static const char *gha_host_prepare(CHA_PTR cp, const GhaPrescription *rx, double sr, int cs) {
+  static I_O io;
+  for (int i=0; i < rx->dsl.nchannel - 1; i++) {
+    if (rx->dsl.cross_freq[i] >= sr / 2) return "a crossover frequency is above the Nyquist frequency";
+  }
+  const char *why_not = prescription_check_sizes(&rx->dsl, &rx->agc, &rx->afc);  //see test_gha.h
+  if (why_not != NULL) return why_not;
+
+  std::lock_guard<std::mutex> lock(gha_host_prepare_lock);
+  dsl_global = rx->dsl;
+  agc_global = rx->agc;
+  afc_global = rx->afc;
+  agc_global.fs = sr;
+  srate = sr;
+  chunk = cs;
+  io.nsmp = 0;
+  io.nrep = 1;
+  if (prepare(&io, cp) < 0) return "prepare() failed";  //(prepare_io() sets io.rate and io.cs from srate and chunk)
+  return NULL;
+}
+
+static void gha_host_cleanup(CHA_PTR cp) {
+  if (cp[_size] != NULL) cha_cleanup(cp);
+  memset(cp, 0, NPTR * sizeof(void *));
+}
+
+//the scale that set_spl() would apply to bring the whole file to rms_lev dB SPL.  Reads the file once (and then
+//rewinds it), a block at a time, using buf.  Returns 0 if the file is silent.  *lev is the file's level (dB SPL).
+static float gha_host_spl_scale(WavReader &wav, float *buf, int n_buf, double rms_lev, double *lev) {
+  double smsq = 0;
+  uint64_t n_total = 0;
+  int n;
+  while ((n = wav.read(buf, n_buf)) > 0) {
+    for (int i=0; i < n; i++) smsq += (double)buf[i] * buf[i];
+    n_total += n;
+  }
+  wav.rewind();
+  if ((n_total == 0) || (smsq <= 0)) { *lev = -INFINITY; return 0.0f; }
+  *lev = 20 * log10(sqrt(smsq / n_total) / GHA_HOST_SPL_REF);
+  return (float)pow(10, (rms_lev - *lev) / 20);
+}
+
+#endif
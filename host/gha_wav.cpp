@@ -0,0 +1,132 @@
+/*
+   gha_wav
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Run a WAV file through the CHAPRO_WDRC sketch's hearing-aid processing on a desktop.  This is the
+            supported replacement for the desktop main() of tst_gha.c (still commented out in test_gha.h): it
+            uses the sketch's own configure(), prepare(), and process_chunk(), but streams the audio through a
+            block at a time (see wav_io.h) instead of loading the whole file, so files of any length can be
+            processed and written, in constant memory.
+
+            Like set_spl() in tst_gha.c, the input is scaled so that its rms level is 65 dB SPL (change it with
+            -l), with the level taken as 20*log10(rms/spl_ref) and spl_ref = 1.1219e-6.  That takes a first pass
+            through the file to measure the rms.  With -s, the input is scaled by a fixed factor instead, in a
+            single pass.  The output is written without any scaling, like write_wave() did.
+
+            At the end, it prints the speed_ratio, as the old process() did: the duration of the audio divided
+            by the time spent in process_chunk() (file reading and writing isn't counted).
+
+            Build (from the top of the repo, with CHAPRO's sources built into libchapro.a, see README.md):
+
+               g++ -std=gnu++14 -O2 -Ihost/shim -ICHAPRO_WDRC -I$CHAPRO host/gha_wav.cpp $CHAPRO/libchapro.a -lm -o gha_wav
+               ./gha_wav speech.wav speech_gha.wav
+
+   MIT License.  use at your own risk.
+*/
+
+#include <unistd.h>
+#include <Arduino.h>
+#include "gha_host.h"
+
+#define GHA_WAV_MAX_CHUNK 128
+#define GHA_WAV_BLOCK_CHUNKS 256   //chunks per file read and write
+
+static void usage(void) {
+  printf("usage: gha_wav [options] input.wav output.wav\n");
+  printf("options\n");
+  printf("  -c cs    chunk size (1 to %d, default %d, as in the sketch)\n", GHA_WAV_MAX_CHUNK, GHA_CHUNK);
+  printf("  -l dB    scale the input to this rms level, in dB SPL (default %.0f)\n", GHA_HOST_RMS_LEV);
+  printf("  -s scl   scale the input by scl instead (single pass, no rms measurement)\n");
+  printf("  -p pre   use a preset (\"file\" or \"file:index\", a GhaPreset file) instead of the sketch's prescription\n");
+  printf("  -f       write 32-bit float samples (default is 16-bit)\n");
+  printf("  -q       quiet (don't print the messages from prepare())\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  static void *cp[NPTR] = {0};
+  GhaPrescription rx;
+  int cs = GHA_CHUNK, out_bits = 16, opt;
+  const char *preset = NULL;
+  double rms_lev = GHA_HOST_RMS_LEV, fixed_scale = 0, lev;
+  float scl;
+
+  while ((opt = getopt(argc, argv, "c:l:s:p:fqh")) != -1) {
+    switch (opt) {
+      case 'c': cs = atoi(optarg); break;
+      case 'l': rms_lev = atof(optarg); break;
+      case 's': fixed_scale = atof(optarg); break;
+      case 'p': preset = optarg; break;
+      case 'f': out_bits = 32; break;
+      case 'q': gha_verbose = 0; break;
+      default: usage();
+    }
+  }
+  if ((argc - optind != 2) || (cs < 1) || (cs > GHA_WAV_MAX_CHUNK)) usage();
+  const char *ifn = argv[optind], *ofn = argv[optind + 1];
+
+  WavReader wav_in;
+  if (!wav_in.open(ifn)) return 1;
+  if (wav_in.n_chan > 1) printf("gha_wav: %s has %d channels.  Using the first one.\n", ifn, wav_in.n_chan);
+
+  //buffers, sized once
+  int n_block = cs * GHA_WAV_BLOCK_CHUNKS;
+  float *x = (float *)calloc(n_block, sizeof(float));
+  float *y = (float *)calloc(n_block, sizeof(float));
+
+  //input level, as set_spl() does
+  if (fixed_scale > 0) {
+    scl = (float)fixed_scale;
+  } else {
+    scl = gha_host_spl_scale(wav_in, x, n_block, rms_lev, &lev);
+    if (scl <= 0) { fprintf(stderr, "gha_wav: %s is silent, so it can't be scaled to %.1f dB SPL.  Use -s.\n", ifn, rms_lev); return 1; }
+    printf("gha_wav: input level %.1f dB SPL, scaled by %.4g to %.1f dB SPL\n", lev, scl, rms_lev);
+  }
+
+  //the sketch's setup, at the file's sample rate and the chosen chunk size
+  if (wav_in.rate != srate) {
+    printf("gha_wav: %s is at %.0f Hz.  The Tympan runs at %.0f Hz, so the filterbank and the AGC are prepared for %.0f Hz instead.\n",
+           ifn, wav_in.rate, srate, wav_in.rate);
+  }
+  gha_host_default_prescription(&rx, cs);
+  if (preset) {
+    int err = gha_host_load_preset(preset, &rx);
+    if (err != GHA_PRESET_OK) { fprintf(stderr, "gha_wav: can't load preset %s (error %d)\n", preset, err); return 1; }
+    printf("gha_wav: using preset \"%s\"\n", rx.name);
+  }
+  const char *why_not = gha_host_prepare(cp, &rx, wav_in.rate, cs);
+  if (why_not) { fprintf(stderr, "gha_wav: can't prepare for %s: %s.  Resample it to %.0f Hz.\n", ifn, why_not, srate); return 1; }
+
+  WavWriter wav_out;
+  if (!wav_out.open(ofn, srate, out_bits)) return 1;
+
+  //stream it through, a block at a time
+  double t_proc = 0;
+  int n;
+  while ((n = wav_in.read(x, n_block)) > 0) {
+    for (int i=0; i < n; i++) x[i] *= scl;
+    int n_pad = ((n + cs - 1) / cs) * cs;  //the last block might not be a whole number of chunks
+    for (int i=n; i < n_pad; i++) x[i] = 0.0f;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i=0; i < n_pad; i += cs) process_chunk(cp, x + i, y + i, cs);
+    t_proc += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    wav_out.write(y, n);
+  }
+  if (!wav_out.close()) { fprintf(stderr, "gha_wav: error writing %s\n", ofn); return 1; }
+
+  //report
+  double t_wave = wav_out.n_samples / srate;
+  printf("gha_wav: %s: %llu samples, sr=%.0f cs=%d nc=%d nz=%d\n", ofn, (unsigned long long)wav_out.n_samples, srate, cs, dsl_global.nchannel, agc_global.nz);
+  if (wav_out.n_clipped) printf("gha_wav: *** %lu output samples were clipped ***\n", wav_out.n_clipped);
+  printf("speed_ratio: ");
+  printf("(wave_time/wall_time) = (%.3f/%.3f) ", t_wave, t_proc);
+  printf("= %.1f\n", (t_proc > 0) ? t_wave / t_proc : 0.0);
+
+  cha_cleanup(cp);
+  free(x);
+  free(y);
+  return 0;
+}
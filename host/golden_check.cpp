@@ -0,0 +1,354 @@
+/*
+   golden_check
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Regression check for faster versions of the sketches' processing.  The reference processing
+            (process_chunk() from CHAPRO_WDRC/test_gha.h and cha_nfc_process() as in chapro_test_NFC) is run
+            once over a fixed set of calibrated signals, and its outputs are saved as the "golden" outputs.
+            After that, every candidate path (see candidate_paths[], below) is run over the same inputs and
+            compared with the golden outputs:
+
+               max_err     largest difference from the golden output (full scale = 1.0)
+               snr         golden output power / power of the difference, in dB
+               misalign    for the simulated-feedback case, the final AFC misalignment (of the feedback-path
+                           estimate from the simulated path, see AfcQualityMetric.h) minus the golden one, in dB
+
+            Each path has its own tolerances.  A path that doesn't meet them fails, and so does the program.
+
+            The signals (each scaled to its level in dB SPL, like set_spl() in tst_gha.c):
+               speech      at 55, 65, and 80 dB SPL.  With -s, a speech recording (eg, test/carrots.wav from
+                           CHAPRO) at the sketch's sample rate.  Otherwise, a synthetic speech-like signal
+                           (a voiced harmonic series with a moving pitch and syllable-rate modulation)
+               tones       500 Hz, 2 kHz, and 4 kHz at 65 dB SPL, and 1 kHz at 95 dB SPL (into the limiter)
+               noise       white, at 50, 70, and 90 dB SPL
+               feedback    the 65 dB SPL speech with CHAPRO's simulated feedback turned on (afc.fbg = 1,
+                           afc.fbl = 100)
+
+            The golden directory holds each input and golden output as a 32-bit float WAV file, plus golden.txt
+            with the final misalignment of the feedback case.  The inputs are read back from there when
+            checking, so that the check doesn't depend on how this machine makes the signals.
+
+            Build (from the top of the repo, with CHAPRO's sources built into libchapro.a, see README.md):
+
+               g++ -std=gnu++14 -O2 -Ihost/shim -ICHAPRO_WDRC -Ichapro_test_NFC -I$CHAPRO host/golden_check.cpp $CHAPRO/libchapro.a -lm -o golden_check
+               ./golden_check -g golden        #once, with the reference CHAPRO and sketch code
+               ./golden_check golden           #then after every change
+
+   MIT License.  use at your own risk.
+*/
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "wav_io.h"
+#include "bench_util.h"   //for bench_fill_noise()
+#include "test_gha.h"
+#include "GhaChain.h"
+#include "AfcQualityMetric.h"
+namespace nfc_sketch {     //test_nfc.h has its own srate, chunk, configure(), and prepare()
+#include "test_nfc.h"
+}
+
+#define GOLDEN_SECONDS 4.0
+#define GOLDEN_FEEDBACK_SECONDS 10.0   //long enough for the AFC to converge
+#define GOLDEN_MISALIGN_RES 0.0001     //golden.txt keeps the misalignment to 4 decimals
+
+// ///////////////////////////////////////// the signals
+enum { SIG_SPEECH, SIG_TONE, SIG_NOISE };
+typedef struct {
+  const char *name;
+  int signal;
+  double freq_Hz;        //for tones
+  double level_dB;       //rms, dB SPL
+  bool feedback;         //run with CHAPRO's simulated feedback
+  bool nfc;              //also run through the NFC
+} GoldenCase;
+
+static const GoldenCase cases[] = {
+  {"speech_55",    SIG_SPEECH, 0,    55, false, true},
+  {"speech_65",    SIG_SPEECH, 0,    65, false, true},
+  {"speech_80",    SIG_SPEECH, 0,    80, false, true},
+  {"tone_500",     SIG_TONE,   500,  65, false, false},
+  {"tone_2000",    SIG_TONE,   2000, 65, false, false},
+  {"tone_4000",    SIG_TONE,   4000, 65, false, true},
+  {"tone_1000_95", SIG_TONE,   1000, 95, false, false},
+  {"noise_50",     SIG_NOISE,  0,    50, false, false},
+  {"noise_70",     SIG_NOISE,  0,    70, false, true},
+  {"noise_90",     SIG_NOISE,  0,    90, false, false},
+  {"feedback_65",  SIG_SPEECH, 0,    65, true,  false},
+};
+static const int n_cases = sizeof(cases) / sizeof(cases[0]);
+
+static const char *speech_fn = NULL;
+
+static void scale_to_spl(std::vector<float> &x, double level_dB) {
+  double smsq = 0;
+  for (float v : x) smsq += (double)v * v;
+  if (smsq <= 0) return;
+  double scl = BENCH_SPL_REF * pow(10, level_dB / 20) / sqrt(smsq / x.size());
+  for (float &v : x) v = (float)(v * scl);
+}
+
+//a voiced harmonic series with a slowly moving pitch, a falling spectrum, and syllable-rate (4 Hz) modulation with pauses
+static void make_speech_like(std::vector<float> &x, double sr) {
+  double phase = 0;
+  for (size_t i=0; i < x.size(); i++) {
+    double t = i / sr;
+    double f0 = 140 + 40 * sin(2 * M_PI * 0.7 * t);
+    phase += 2 * M_PI * f0 / sr;
+    double v = 0;
+    for (int h=1; (h * f0 < 0.45 * sr) && (h <= 40); h++) v += sin(h * phase) / h;
+    double env = sin(M_PI * fmod(4.0 * t, 1.0));
+    if (fmod(t, 2.0) > 1.5) env = 0;  //a pause every two seconds
+    x[i] = (float)(v * env * env);
+  }
+}
+
+static bool make_input(const GoldenCase &c, double sr, std::vector<float> &x) {
+  x.assign((size_t)((c.feedback ? GOLDEN_FEEDBACK_SECONDS : GOLDEN_SECONDS) * sr), 0.0f);
+  switch (c.signal) {
+    case SIG_SPEECH:
+      if (speech_fn) {
+        WavReader wav;
+        if (!wav.open(speech_fn)) return false;
+        if (wav.rate != sr) { fprintf(stderr, "golden_check: %s must be at %.0f Hz\n", speech_fn, sr); return false; }
+        size_t n = 0;
+        while (n < x.size()) {  //repeat the recording to fill the length
+          int m = wav.read(&x[n], (int)(x.size() - n));
+          if (m <= 0) { if (n == 0) return false; wav.rewind(); continue; }
+          n += m;
+        }
+      } else {
+        make_speech_like(x, sr);
+      }
+      break;
+    case SIG_TONE:
+      for (size_t i=0; i < x.size(); i++) x[i] = (float)sin(2 * M_PI * c.freq_Hz * i / sr);
+      break;
+    case SIG_NOISE:
+      bench_fill_noise(x.data(), (int)x.size(), 0, 12345);
+      break;
+  }
+  scale_to_spl(x, c.level_dB);
+  return true;
+}
+
+// ///////////////////////////////////////// the processing paths
+enum { CHAIN_GHA, CHAIN_NFC };
+typedef struct {
+  double max_err;        //largest allowed difference from the golden output
+  double min_snr_dB;
+  double max_misalign_dB;  //largest allowed change in the final misalignment
+} Tolerance;
+
+typedef struct {
+  const char *name;
+  int chain;
+  bool (*process)(CHA_PTR cp, float *x, float *y, int n);  //returns false if the path can't run this context
+  Tolerance tol;
+} CandidatePath;
+
+typedef GhaChain<GHA_CHUNK, AfcOn> GoldenGhaChain;  //same as GhaProductionChain in AudioEffectBTNRH.h
+
+static bool run_process_chunk(CHA_PTR cp, float *x, float *y, int n) {
+  for (int i=0; i + chunk <= n; i += chunk) process_chunk(cp, x + i, y + i, chunk);
+  return true;
+}
+static bool run_gha_chain(CHA_PTR cp, float *x, float *y, int n) {
+  if (!GoldenGhaChain::matches(cp)) return false;
+  GoldenGhaChain::process_block(cp, x, y, n);
+  return true;
+}
+static bool run_nfc(CHA_PTR cp, float *x, float *y, int n) {
+  int cs = nfc_sketch::chunk;
+  memcpy(y, x, n * sizeof(float));
+  for (int i=0; i + cs <= n; i += cs) cha_nfc_process(cp, y + i, y + i, cs);  //in place, as AudioEffectNFC does
+  return true;
+}
+
+//the first path of each chain is the reference, which makes the golden outputs.  Add faster paths after it.
+static const CandidatePath candidate_paths[] = {
+  {"process_chunk",   CHAIN_GHA, run_process_chunk, {0.0,  INFINITY, 0.0}},  //the reference must repeat itself exactly
+  {"GhaChain",        CHAIN_GHA, run_gha_chain,     {1e-6, 120.0,    0.1}},
+  {"cha_nfc_process", CHAIN_NFC, run_nfc,           {0.0,  INFINITY, 0.0}},
+};
+static const int n_paths = sizeof(candidate_paths) / sizeof(candidate_paths[0]);
+
+// ///////////////////////////////////////// running a case
+
+static void prepare_case(CHA_PTR cp, const GoldenCase &c, int chain) {
+  static I_O io;
+  static nfc_sketch::I_O nfc_io;
+  if (cp[_size] != NULL) { cha_cleanup(cp); memset(cp, 0, NPTR * sizeof(void *)); }
+  if (chain == CHAIN_NFC) {
+    nfc_sketch::configure(&nfc_io);
+    nfc_sketch::prepare(&nfc_io, cp);
+    return;
+  }
+  configure(&io);
+  afc_global.fbg = c.feedback ? 1 : 0;    //CHAPRO's simulated feedback path (configure() doesn't reset fbl)
+  afc_global.fbl = c.feedback ? 100 : 0;
+  prepare(&io, cp);
+}
+
+//final misalignment, in dB.  NAN if there is no simulated feedback path
+static double final_misalignment(CHA_PTR cp) {
+  float q = afc_qm_misalignment_cp(cp, NULL, 0);
+  return (q > 0) ? 10 * log10(q) : NAN;
+}
+
+static bool run_case(const CandidatePath &path, const GoldenCase &c, const std::vector<float> &input, std::vector<float> &output, double *misalign_dB) {
+  static void *cp[NPTR] = {0};
+  std::vector<float> x(input);  //the AFC writes back into its input
+  int n = (int)x.size();
+  output.assign(n, 0.0f);
+  prepare_case(cp, c, path.chain);
+  bool ok = path.process(cp, x.data(), output.data(), n);
+  *misalign_dB = final_misalignment(cp);
+  cha_cleanup(cp);
+  memset(cp, 0, sizeof(cp));
+  return ok;
+}
+
+static std::string case_file(const char *dir, const GoldenCase &c, const char *chain_name, const char *what) {
+  return std::string(dir) + "/" + c.name + "_" + chain_name + "_" + what + ".wav";
+}
+
+static bool write_wav(const std::string &fn, const std::vector<float> &x, double sr) {
+  WavWriter wav;
+  if (!wav.open(fn.c_str(), sr, 32)) return false;
+  wav.write(x.data(), (int)x.size());
+  return wav.close();
+}
+
+static bool read_wav(const std::string &fn, std::vector<float> &x) {
+  WavReader wav;
+  if (!wav.open(fn.c_str())) return false;
+  x.assign(wav.n_samples, 0.0f);
+  return wav.read(x.data(), (int)x.size()) == (int)x.size();
+}
+
+// ///////////////////////////////////////// making and checking the golden outputs
+
+static const char *chain_name(int chain) { return (chain == CHAIN_NFC) ? "nfc" : "gha"; }
+static bool case_uses_chain(const GoldenCase &c, int chain) { return (chain == CHAIN_GHA) || c.nfc; }
+
+static int make_golden(const char *dir) {
+  std::string manifest_fn = std::string(dir) + "/golden.txt";
+  FILE *manifest = fopen(manifest_fn.c_str(), "w");
+  if (manifest == NULL) { fprintf(stderr, "golden_check: can't create %s (does the directory exist?)\n", manifest_fn.c_str()); return 1; }
+  fprintf(manifest, "# golden outputs of the reference paths.  case chain samples final_misalignment_dB\n");
+  for (int p=0; p < n_paths; p++) {
+    const CandidatePath &path = candidate_paths[p];
+    if ((p > 0) && (candidate_paths[p - 1].chain == path.chain)) continue;  //only the reference of each chain
+    double sr = (path.chain == CHAIN_NFC) ? nfc_sketch::srate : srate;
+    for (int i=0; i < n_cases; i++) {
+      const GoldenCase &c = cases[i];
+      if (!case_uses_chain(c, path.chain)) continue;
+      std::vector<float> x, y;
+      double misalign_dB;
+      if (!make_input(c, sr, x)) return 1;
+      run_case(path, c, x, y, &misalign_dB);
+      if (!write_wav(case_file(dir, c, chain_name(path.chain), "in"), x, sr) ||
+          !write_wav(case_file(dir, c, chain_name(path.chain), "out"), y, sr)) return 1;
+      fprintf(manifest, "%s %s %d %.4f\n", c.name, chain_name(path.chain), (int)y.size(), misalign_dB);
+      printf("golden_check: %-14s %s (%s): %d samples", c.name, chain_name(path.chain), path.name, (int)y.size());
+      if (!isnan(misalign_dB)) printf(", final misalignment %.2f dB", misalign_dB);
+      printf("\n");
+    }
+  }
+  fclose(manifest);
+  printf("golden_check: golden outputs written to %s\n", dir);
+  return 0;
+}
+
+static bool golden_misalignment(const char *dir, const GoldenCase &c, int chain, double *misalign_dB) {
+  char name[64], chain_str[8];
+  int n;
+  double m;
+  std::string fn = std::string(dir) + "/golden.txt";
+  FILE *f = fopen(fn.c_str(), "r");
+  if (f == NULL) return false;
+  char line[256];
+  *misalign_dB = NAN;
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%63s %7s %d %lf", name, chain_str, &n, &m) != 4) continue;  //"nan" reads as NAN
+    if ((strcmp(name, c.name) == 0) && (strcmp(chain_str, chain_name(chain)) == 0)) *misalign_dB = m;
+  }
+  fclose(f);
+  return true;
+}
+
+static int check_golden(const char *dir, const char *only_path) {
+  int n_failed = 0, n_run = 0;
+  printf("%-16s %-14s %12s %10s %12s  %s\n", "path", "case", "max_err", "snr_dB", "misalign_dB", "result");
+  for (int p=0; p < n_paths; p++) {
+    const CandidatePath &path = candidate_paths[p];
+    if (only_path && strcmp(only_path, path.name)) continue;
+    for (int i=0; i < n_cases; i++) {
+      const GoldenCase &c = cases[i];
+      if (!case_uses_chain(c, path.chain)) continue;
+      std::vector<float> x, g, y;
+      double misalign_dB, golden_dB;
+      if (!read_wav(case_file(dir, c, chain_name(path.chain), "in"), x) ||
+          !read_wav(case_file(dir, c, chain_name(path.chain), "out"), g) ||
+          !golden_misalignment(dir, c, path.chain, &golden_dB)) {
+        fprintf(stderr, "golden_check: no golden output for %s in %s.  Make them with -g.\n", c.name, dir);
+        return 1;
+      }
+      if (!run_case(path, c, x, y, &misalign_dB)) {
+        printf("%-16s %-14s %12s %10s %12s  n/a (the path doesn't fit this context)\n", path.name, c.name, "-", "-", "-");
+        continue;
+      }
+
+      //compare
+      double max_err = 0, sig = 0, err = 0;
+      size_t n = (y.size() < g.size()) ? y.size() : g.size();
+      for (size_t k=0; k < n; k++) {
+        double d = (double)y[k] - g[k];
+        if (fabs(d) > max_err) max_err = fabs(d);
+        sig += (double)g[k] * g[k];
+        err += d * d;
+      }
+      double snr_dB = (err > 0) ? 10 * log10(sig / err) : INFINITY;
+      double dmis_dB = (isnan(misalign_dB) && isnan(golden_dB)) ? 0.0 : misalign_dB - golden_dB;  //NAN if only one has it
+      bool pass = (y.size() == g.size()) && (max_err <= path.tol.max_err) && (snr_dB >= path.tol.min_snr_dB) &&
+                  (fabs(dmis_dB) <= path.tol.max_misalign_dB + GOLDEN_MISALIGN_RES);
+      n_run++;
+      if (!pass) n_failed++;
+      printf("%-16s %-14s %12.3g %10.1f %12.3f  %s\n", path.name, c.name, max_err, snr_dB, dmis_dB, pass ? "ok" : "FAILED");
+    }
+  }
+  printf("golden_check: %d of %d %s\n", n_run - n_failed, n_run, (n_failed == 0) ? "passed" : "passed.  FAILED");
+  return (n_failed == 0) ? 0 : 1;
+}
+
+static void usage(void) {
+  printf("usage: golden_check [options] golden_dir\n");
+  printf("options\n");
+  printf("  -g           make the golden outputs (with the reference paths) instead of checking\n");
+  printf("  -s file.wav  speech recording to use instead of the synthetic speech (only with -g)\n");
+  printf("  -p path      check only this path:");
+  for (int p=0; p < n_paths; p++) printf(" %s", candidate_paths[p].name);
+  printf("\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  bool make = false;
+  const char *only_path = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "gs:p:h")) != -1) {
+    switch (opt) {
+      case 'g': make = true; break;
+      case 's': speech_fn = optarg; break;
+      case 'p': only_path = optarg; break;
+      default: usage();
+    }
+  }
+  if (argc - optind != 1) usage();
+  gha_verbose = 0;
+  return make ? make_golden(argv[optind]) : check_golden(argv[optind], only_path);
+}
@@ -0,0 +1,301 @@
+/*
+   kernel_bench
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Time each CHAPRO call that the sketches make, on its own, so that a change to one kernel can be
+            measured without the noise of the rest of the chain:
+
+               cha_afc_input, cha_agc_input, cha_iirfb_analyze, cha_agc_channel, cha_iirfb_synthesize,
+               cha_agc_output, cha_afc_output      as in process_chunk() (CHAPRO_WDRC/test_gha.h)
+               cha_nfc_process                     as in AudioEffectNFC.h (chapro_test_NFC/test_nfc.h)
+
+            The contexts are prepared exactly as the sketches do it: configure() and prepare() from test_gha.h,
+            and configure() and prepare() from test_nfc.h.  To give each kernel the input that it sees in the
+            chain, the whole chain is first run once over calibrated noise (65 dB SPL), and the input to every
+            stage is recorded.  Then each kernel is run alone, in a freshly prepared context, over the recorded
+            input to its stage.  (So cha_afc_input sees no AFC output, as cha_afc_output isn't run with it.  This
+            doesn't change how much work it does.)
+
+            Two variants:
+               warm   the kernel runs over all of the recorded chunks in a loop, -r times after a warm-up pass.
+                      This is the cost in a tight loop, with the kernel's code and state in the cache.
+               cold   before each call, the caches are flushed by walking through a large buffer (-e MB), and
+                      then one call is timed.  This is the cost when the rest of the firmware has pushed the
+                      kernel out of the cache between audio blocks.
+
+            Everything is reported per sample (ns and CPU cycles, see bench_util.h), with the statistics over the
+            repetitions (warm) or over the calls (cold).  The whole process_chunk() is timed as well, for
+            comparison with the sum of its kernels.
+
+            Build (from the top of the repo, with CHAPRO's sources built into libchapro.a, see README.md):
+
+               g++ -std=gnu++14 -O2 -Ihost/shim -ICHAPRO_WDRC -Ichapro_test_NFC -I$CHAPRO host/kernel_bench.cpp $CHAPRO/libchapro.a -lm -o kernel_bench
+               ./kernel_bench -o kernels.csv
+
+   MIT License.  use at your own risk.
+*/
+
+#include <Arduino.h>
+#include "bench_util.h"
+#include "test_gha.h"
+namespace nfc_sketch {     //test_nfc.h has its own srate, chunk, configure(), and prepare()
+#include "test_nfc.h"
+}
+
+// ///////////////////////////////////////// the kernels
+enum { S_IN = 0, S_AFC_IN, S_AGC_IN, S_ANALYZE, S_AGC_CHAN, S_SYNTH, S_AGC_OUT, N_STAGES };  //input to each kernel of process_chunk()
+
+typedef void (*KernelCall)(CHA_PTR cp, float *x, float *y, int cs);
+typedef struct {
+  const char *name;
+  bool is_nfc;
+  int stage;             //which recorded input it gets
+  bool in_place;         //y is x
+  bool z_in, z_out;      //reads or writes the channel signals (CHA_CB-sized) instead of cs samples
+  KernelCall call;
+} Kernel;
+
+static const Kernel kernels[] = {
+  {"cha_afc_input",        false, S_IN,       true,  false, false, [](CHA_PTR cp, float *x, float *y, int cs) { cha_afc_input(cp, x, x, cs); }},
+  {"cha_agc_input",        false, S_AFC_IN,   true,  false, false, [](CHA_PTR cp, float *x, float *y, int cs) { cha_agc_input(cp, x, x, cs); }},
+  {"cha_iirfb_analyze",    false, S_AGC_IN,   false, false, true,  [](CHA_PTR cp, float *x, float *y, int cs) { cha_iirfb_analyze(cp, x, y, cs); }},
+  {"cha_agc_channel",      false, S_ANALYZE,  true,  true,  true,  [](CHA_PTR cp, float *x, float *y, int cs) { cha_agc_channel(cp, x, x, cs); }},
+  {"cha_iirfb_synthesize", false, S_AGC_CHAN, false, true,  false, [](CHA_PTR cp, float *x, float *y, int cs) { cha_iirfb_synthesize(cp, x, y, cs); }},
+  {"cha_agc_output",       false, S_SYNTH,    true,  false, false, [](CHA_PTR cp, float *x, float *y, int cs) { cha_agc_output(cp, x, x, cs); }},
+  {"cha_afc_output",       false, S_AGC_OUT,  true,  false, false, [](CHA_PTR cp, float *x, float *y, int cs) { cha_afc_output(cp, x, cs); }},
+  {"process_chunk",        false, S_IN,       false, false, false, [](CHA_PTR cp, float *x, float *y, int cs) { process_chunk(cp, x, y, cs); }},
+  {"cha_nfc_process",      true,  S_IN,       true,  false, false, [](CHA_PTR cp, float *x, float *y, int cs) { cha_nfc_process(cp, x, x, cs); }},
+};
+static const int n_kernels = sizeof(kernels) / sizeof(kernels[0]);
+
+typedef struct {
+  const char *name, *variant;
+  int cs;
+  BenchStats ns_per_sample, cycles_per_sample;
+} KernelResult;
+
+static int warmup = 1, reps = 10, n_cold = 200, evict_MB = 32;
+static double seconds = 1.0, level_dB = 65;
+static CycleCounter cycles;
+
+// ///////////////////////////////////////// contexts, prepared as the sketches do it
+
+static void prepare_gha(CHA_PTR cp) {
+  static I_O io;
+  if (cp[_size] != NULL) { cha_cleanup(cp); memset(cp, 0, NPTR * sizeof(void *)); }
+  configure(&io);
+  prepare(&io, cp);
+}
+
+static void prepare_nfc(CHA_PTR cp) {
+  static nfc_sketch::I_O io;
+  if (cp[_size] != NULL) { cha_cleanup(cp); memset(cp, 0, NPTR * sizeof(void *)); }
+  nfc_sketch::configure(&io);
+  nfc_sketch::prepare(&io, cp);
+}
+
+// ///////////////////////////////////////// recording the input to each stage of process_chunk()
+
+typedef struct {
+  int cs, zlen, n_chunks;
+  std::vector<float> stage[N_STAGES];
+  int len(int s) { return ((s == S_ANALYZE) || (s == S_AGC_CHAN)) ? zlen : cs; }
+} StageRecord;
+
+static void record_stages(StageRecord &rec, const float *x_in) {
+  static void *cp[NPTR] = {0};
+  prepare_gha(cp);
+  int cs = rec.cs;
+  float *z = CHA_CB;
+  std::vector<float> x(cs), y(cs);
+  for (int s=0; s < N_STAGES; s++) rec.stage[s].resize((size_t)rec.n_chunks * rec.len(s));
+
+  //the same calls as process_chunk(), with a snapshot before each one
+  for (int k=0; k < rec.n_chunks; k++) {
+    memcpy(x.data(), x_in + k * cs, cs * sizeof(float));
+    memcpy(&rec.stage[S_IN][k * cs], x.data(), cs * sizeof(float));
+    cha_afc_input(cp, x.data(), x.data(), cs);
+    memcpy(&rec.stage[S_AFC_IN][k * cs], x.data(), cs * sizeof(float));
+    cha_agc_input(cp, x.data(), x.data(), cs);
+    memcpy(&rec.stage[S_AGC_IN][k * cs], x.data(), cs * sizeof(float));
+    cha_iirfb_analyze(cp, x.data(), z, cs);
+    memcpy(&rec.stage[S_ANALYZE][(size_t)k * rec.zlen], z, rec.zlen * sizeof(float));
+    cha_agc_channel(cp, z, z, cs);
+    memcpy(&rec.stage[S_AGC_CHAN][(size_t)k * rec.zlen], z, rec.zlen * sizeof(float));
+    cha_iirfb_synthesize(cp, z, y.data(), cs);
+    memcpy(&rec.stage[S_SYNTH][k * cs], y.data(), cs * sizeof(float));
+    cha_agc_output(cp, y.data(), y.data(), cs);
+    memcpy(&rec.stage[S_AGC_OUT][k * cs], y.data(), cs * sizeof(float));
+    cha_afc_output(cp, y.data(), cs);
+  }
+  cha_cleanup(cp);
+  memset(cp, 0, sizeof(cp));
+}
+
+// ///////////////////////////////////////// timing
+
+static volatile uint8_t evict_sink;
+static void evict_caches(std::vector<uint8_t> &buf) {
+  uint8_t sum = 0;
+  for (size_t i=0; i < buf.size(); i += 64) { buf[i]++; sum += buf[i]; }
+  evict_sink = sum;
+}
+
+//the cost of reading the clocks, to take out of the single-call (cold) timings
+static void timer_overhead(double *ns, double *cyc) {
+  std::vector<double> v_ns, v_cyc;
+  for (int i=0; i < 1000; i++) {
+    uint64_t c0 = cycles.read(), t0 = bench_now_ns();
+    uint64_t t1 = bench_now_ns(), c1 = cycles.read();
+    v_ns.push_back((double)(t1 - t0)); v_cyc.push_back((double)(c1 - c0));
+  }
+  *ns = bench_stats(v_ns).median;
+  *cyc = bench_stats(v_cyc).median;
+}
+
+static void run_kernel(const Kernel &kern, StageRecord &rec, int cs, int n_chunks, std::vector<KernelResult> &results) {
+  static void *cp[NPTR] = {0};
+  static std::vector<uint8_t> evict_buf((size_t)evict_MB << 20);
+  int in_len = kern.z_in ? rec.zlen : cs;
+  int out_len = kern.z_out ? rec.zlen : cs;
+  const std::vector<float> &input = rec.stage[kern.stage];
+  std::vector<float> x(input.begin(), input.begin() + (size_t)n_chunks * in_len), y((size_t)n_chunks * out_len);
+  std::vector<double> ns, cyc;
+  int n = n_chunks * cs;
+
+  //warm
+  if (kern.is_nfc) prepare_nfc(cp); else prepare_gha(cp);
+  for (int r=0; r < warmup + reps; r++) {
+    std::copy(input.begin(), input.begin() + x.size(), x.begin());  //in-place kernels overwrite their input
+    uint64_t c0 = cycles.read(), t0 = bench_now_ns();
+    for (int k=0; k < n_chunks; k++) {
+      float *xk = &x[(size_t)k * in_len];
+      kern.call(cp, xk, kern.in_place ? xk : &y[(size_t)k * out_len], cs);
+    }
+    uint64_t t1 = bench_now_ns(), c1 = cycles.read();
+    if (r < warmup) continue;
+    ns.push_back((double)(t1 - t0) / n);
+    cyc.push_back((double)(c1 - c0) / n);
+  }
+  results.push_back({kern.name, "warm", cs, bench_stats(ns), bench_stats(cyc)});
+
+  //cold
+  double ns_over, cyc_over;
+  timer_overhead(&ns_over, &cyc_over);
+  ns.clear(); cyc.clear();
+  if (kern.is_nfc) prepare_nfc(cp); else prepare_gha(cp);
+  std::copy(input.begin(), input.begin() + x.size(), x.begin());
+  for (int i=0; i < n_cold; i++) {
+    int k = i % n_chunks;
+    float *xk = &x[(size_t)k * in_len];
+    evict_caches(evict_buf);
+    uint64_t c0 = cycles.read(), t0 = bench_now_ns();
+    kern.call(cp, xk, kern.in_place ? xk : &y[(size_t)k * out_len], cs);
+    uint64_t t1 = bench_now_ns(), c1 = cycles.read();
+    ns.push_back(((double)(t1 - t0) - ns_over) / cs);
+    cyc.push_back(((double)(c1 - c0) - cyc_over) / cs);
+  }
+  results.push_back({kern.name, "cold", cs, bench_stats(ns), bench_stats(cyc)});
+  cha_cleanup(cp);
+  memset(cp, 0, sizeof(cp));
+}
+
+// ///////////////////////////////////////// output
+
+static void print_table(FILE *f, const std::vector<KernelResult> &results) {
+  fprintf(f, "%-22s %-5s %4s %12s %12s %12s %12s\n", "kernel", "cache", "cs", "ns/sample", "(min)", "cycles/smp", "(min)");
+  for (const KernelResult &r : results) {
+    fprintf(f, "%-22s %-5s %4d %12.2f %12.2f %12.1f %12.1f\n", r.name, r.variant, r.cs, r.ns_per_sample.median, r.ns_per_sample.min,
+            r.cycles_per_sample.median, r.cycles_per_sample.min);
+  }
+}
+
+static void print_csv(FILE *f, const std::vector<KernelResult> &results) {
+  fprintf(f, "kernel,cache,cs,n");
+  for (const char *m : {"ns_per_sample", "cycles_per_sample"}) {
+    for (const char *s : {"mean", "median", "min", "max", "std"}) fprintf(f, ",%s_%s", m, s);
+  }
+  fprintf(f, "\n");
+  for (const KernelResult &r : results) {
+    fprintf(f, "%s,%s,%d,%d", r.name, r.variant, r.cs, r.ns_per_sample.n);
+    for (const BenchStats *s : {&r.ns_per_sample, &r.cycles_per_sample}) {
+      fprintf(f, ",%.6g,%.6g,%.6g,%.6g,%.6g", s->mean, s->median, s->min, s->max, s->stddev);
+    }
+    fprintf(f, "\n");
+  }
+}
+
+static void usage(void) {
+  printf("usage: kernel_bench [options] [kernel ...]\n");
+  printf("options\n");
+  printf("  -t sec       seconds of audio for the warm runs (default %g)\n", seconds);
+  printf("  -w n         warm-up passes, not counted (default %d)\n", warmup);
+  printf("  -r n         counted warm passes (default %d)\n", reps);
+  printf("  -n n         cold calls per kernel (default %d)\n", n_cold);
+  printf("  -e MB        size of the buffer that flushes the caches for the cold calls (default %d)\n", evict_MB);
+  printf("  -l dB        input level, dB SPL (default %g)\n", level_dB);
+  printf("  -o file.csv  also write the results as CSV\n");
+  printf("kernels (default all):");
+  for (int i=0; i < n_kernels; i++) printf(" %s", kernels[i].name);
+  printf("\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  const char *csv_fn = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:w:r:n:e:l:o:h")) != -1) {
+    switch (opt) {
+      case 't': seconds = atof(optarg); break;
+      case 'w': warmup = atoi(optarg); break;
+      case 'r': reps = atoi(optarg); break;
+      case 'n': n_cold = atoi(optarg); break;
+      case 'e': evict_MB = atoi(optarg); break;
+      case 'l': level_dB = atof(optarg); break;
+      case 'o': csv_fn = optarg; break;
+      default: usage();
+    }
+  }
+  if ((seconds <= 0) || (reps < 1) || (warmup < 0) || (n_cold < 1) || (evict_MB < 1)) usage();
+  gha_verbose = 0;
+  cycles.begin();
+
+  //the recorded input to every stage of the GHA chain, at the sketch's chunk size
+  StageRecord rec;
+  { static void *cp[NPTR] = {0}; prepare_gha(cp); rec.cs = chunk; rec.zlen = ((int *)cp[_size])[_cc] / sizeof(float); cha_cleanup(cp); memset(cp, 0, sizeof(cp)); }
+  rec.n_chunks = (int)(seconds * srate) / rec.cs;
+  int nfc_cs = nfc_sketch::chunk;
+  int nfc_chunks = (int)(seconds * nfc_sketch::srate) / nfc_cs;
+  int n_in = (rec.n_chunks * rec.cs > nfc_chunks * nfc_cs) ? rec.n_chunks * rec.cs : nfc_chunks * nfc_cs;
+  std::vector<float> x_in(n_in);
+  bench_fill_noise(x_in.data(), n_in, level_dB, 12345);
+  record_stages(rec, x_in.data());
+
+  //NFC gets the plain input, in its own chunk size
+  StageRecord nfc_rec;
+  nfc_rec.cs = nfc_cs; nfc_rec.zlen = 0; nfc_rec.n_chunks = nfc_chunks;
+  nfc_rec.stage[S_IN].assign(x_in.begin(), x_in.begin() + (size_t)nfc_chunks * nfc_cs);
+
+  fprintf(stderr, "kernel_bench: GHA cs=%d, NFC cs=%d, %.2f s of audio, cycles from %s\n", rec.cs, nfc_cs, seconds, cycles.cycle_source);
+  std::vector<KernelResult> results;
+  for (int i=0; i < n_kernels; i++) {
+    const Kernel &kern = kernels[i];
+    bool wanted = (optind >= argc);
+    for (int a=optind; a < argc; a++) if (strcmp(argv[a], kern.name) == 0) wanted = true;
+    if (!wanted) continue;
+    if (kern.is_nfc) run_kernel(kern, nfc_rec, nfc_cs, nfc_chunks, results);
+    else run_kernel(kern, rec, rec.cs, rec.n_chunks, results);
+  }
+  if (results.empty()) usage();
+
+  print_table(stdout, results);
+  if (csv_fn) {
+    FILE *f = fopen(csv_fn, "w");
+    if (f == NULL) { fprintf(stderr, "kernel_bench: can't create %s\n", csv_fn); return 1; }
+    print_csv(f, results);
+    fclose(f);
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*
+   Arduino.h (host shim)
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Just enough of the Arduino core to compile the sketch headers (test_gha.h, AudioEffectBTNRH.h,
+            SerialManager.h, ...) on a desktop for testing.  Serial writes to stdout.  String keeps its text on
+            the heap with new[], like the real one, so that host tests can count its allocations.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_Arduino_h
+#define _host_Arduino_h
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define PROGMEM
+#define FLASHMEM
+#define DMAMEM
+#define F(s) (s)
+
+// ///////////////////////////////////////////////// time
+
+static inline unsigned long host_micros_since_start(void) {
+  static const auto t0 = std::chrono::steady_clock::now();
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+static inline unsigned long micros(void) { return (uint32_t)host_micros_since_start(); }
+static inline unsigned long millis(void) { return (uint32_t)(host_micros_since_start() / 1000UL); }
+static inline void delay(unsigned long msec) { std::this_thread::sleep_for(std::chrono::milliseconds(msec)); }
+static inline void delayMicroseconds(unsigned long usec) { std::this_thread::sleep_for(std::chrono::microseconds(usec)); }
+static inline void yield(void) {}
+
+// ///////////////////////////////////////////////// String
+
+class String {
+  public:
+    String(void) {}
+    String(const char *s) { copy(s, s ? strlen(s) : 0); }
+    String(const String &s) { copy(s.c_str(), s.len); }
+    String(char c) { char b[2] = {c, 0}; copy(b, 1); }
+    String(int v) { char b[16]; copy(b, snprintf(b, sizeof(b), "%d", v)); }
+    String(unsigned int v) { char b[16]; copy(b, snprintf(b, sizeof(b), "%u", v)); }
+    String(long v) { char b[24]; copy(b, snprintf(b, sizeof(b), "%ld", v)); }
+    String(unsigned long v) { char b[24]; copy(b, snprintf(b, sizeof(b), "%lu", v)); }
+    String(double v, int decimals = 2) { char b[48]; copy(b, snprintf(b, sizeof(b), "%.*f", decimals, v)); }
+    String(float v, int decimals = 2) { char b[48]; copy(b, snprintf(b, sizeof(b), "%.*f", decimals, (double)v)); }
+    ~String(void) { delete[] buf; }
+
+    String &operator=(const String &s) { if (this != &s) copy(s.c_str(), s.len); return *this; }
+    String &operator=(const char *s) { copy(s, s ? strlen(s) : 0); return *this; }
+    String &operator+=(const String &s) { append(s.c_str(), s.len); return *this; }
+    String &operator+=(const char *s) { append(s, strlen(s)); return *this; }
+    String &operator+=(char c) { append(&c, 1); return *this; }
+    friend String operator+(const String &a, const String &b) { String s(a); s += b; return s; }
+    friend String operator+(const String &a, const char *b) { String s(a); s += b; return s; }
+    friend String operator+(const char *a, const String &b) { String s(a); s += b; return s; }
+    bool operator==(const String &s) const { return strcmp(c_str(), s.c_str()) == 0; }
+    bool operator!=(const String &s) const { return !(*this == s); }
+    char operator[](unsigned int i) const { return (i < len) ? buf[i] : 0; }
+
+    bool reserve(unsigned int size) {
+      if (size <= capacity) return true;
+      char *new_buf = new char[size + 1];
+      if (buf) { memcpy(new_buf, buf, len + 1); delete[] buf; } else { new_buf[0] = 0; }
+      buf = new_buf; capacity = size;
+      return true;
+    }
+    unsigned int length(void) const { return len; }
+    const char *c_str(void) const { return buf ? buf : ""; }
+    int toInt(void) const { return atoi(c_str()); }
+    float toFloat(void) const { return (float)atof(c_str()); }
+
+  private:
+    char *buf = NULL;
+    unsigned int len = 0, capacity = 0;
+    void copy(const char *s, unsigned int n) { reserve(n); if (n) memcpy(buf, s, n); if (buf) buf[n] = 0; len = n; }
+    void append(const char *s, unsigned int n) { reserve(len + n); if (n) memcpy(buf + len, s, n); buf[len + n] = 0; len += n; }
+};
+
+// ///////////////////////////////////////////////// Print and Serial
+
+class Print {
+  public:
+    virtual ~Print(void) {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *b, size_t n) { for (size_t i = 0; i < n; i++) write(b[i]); return n; }
+    size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+    //all of these format on the stack, like the Teensy core, so printing never allocates
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v) { return printf_("%d", v); }
+    size_t print(unsigned int v) { return printf_("%u", v); }
+    size_t print(long v) { return printf_("%ld", v); }
+    size_t print(unsigned long v) { return printf_("%lu", v); }
+    size_t print(double v, int decimals = 2) { return printf_("%.*f", decimals, v); }
+
+    size_t println(void) { return write((const uint8_t *)"\r\n", 2); }
+    template <class T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+    size_t println(double v, int decimals) { size_t n = print(v, decimals); return n + println(); }
+    size_t println(const char *s) { size_t n = print(s); return n + println(); }
+
+    virtual void flush(void) {}
+
+  private:
+    size_t printf_(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+      char b[64];
+      va_list args; va_start(args, fmt);
+      int n = vsnprintf(b, sizeof(b), fmt, args);
+      va_end(args);
+      return write((const uint8_t *)b, (size_t)min(n, (int)sizeof(b) - 1));
+    }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available(void) { return 0; }
+    virtual int read(void) { return -1; }
+};
+
+//Serial: output goes to stdout, and there is never any input
+class HostSerial : public Stream {
+  public:
+    void begin(unsigned long) {}
+    operator bool(void) { return true; }
+    size_t write(uint8_t c) { if (c != '\r') fputc(c, stdout); return 1; }
+    using Print::write;
+};
+static HostSerial Serial, Serial1;
+
+#endif
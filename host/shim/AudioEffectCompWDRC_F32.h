@@ -0,0 +1,2 @@
+//AudioEffectCompWDRC_F32.h (host shim): GHA_Constants.h includes this, but nothing in it is used
+#include "BTNRH_WDRC_Types.h"
@@ -0,0 +1,83 @@
+/*
+   AudioStream_F32.h (host shim)
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Stand-ins for the Tympan audio framework and the BLE module, so that the sketch headers compile on a
+            desktop.  There is no audio interrupt on the host, so a test hands a block to an audio object by
+            setting its host_input_block and calling update() itself.  BLE messages go to stdout (if
+            BLE::host_echo is set) and are counted.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_AudioStream_F32_h
+#define _host_AudioStream_F32_h
+
+#include "Arduino.h"
+
+#define AUDIO_BLOCK_SAMPLES 128
+
+typedef struct {
+  float *data;
+  int length;
+  unsigned long id;
+} audio_block_f32_t;
+
+class AudioSettings_F32 {
+  public:
+    AudioSettings_F32(float fs_Hz, int block_size) : sample_rate_Hz(fs_Hz), audio_block_samples(block_size) {}
+    float sample_rate_Hz;
+    int audio_block_samples;
+};
+
+class AudioStream_F32 {
+  public:
+    AudioStream_F32(int n_inputs, audio_block_f32_t **input_queue) {}
+    virtual ~AudioStream_F32(void) {}
+    virtual void update(void) = 0;
+
+    audio_block_f32_t *host_input_block = NULL;  //the block that the next update() will process (in place)
+
+  protected:
+    audio_block_f32_t *receiveWritable_f32(void) { audio_block_f32_t *b = host_input_block; host_input_block = NULL; return b; }
+    audio_block_f32_t *receiveReadOnly_f32(void) { return receiveWritable_f32(); }
+    void transmit(audio_block_f32_t *block, int channel = 0) {}
+    void release(audio_block_f32_t *block) {}
+};
+
+//there is no audio interrupt on the host
+static inline void AudioNoInterrupts(void) {}
+static inline void AudioInterrupts(void) {}
+
+//set while inside code that stands in for the Tympan library, so that alloc_check can count its allocations apart
+static int host_library_depth = 0;
+
+class BLE {
+  public:
+    size_t sendMessage(const String &s) {
+      //the library's sendMessage() copies the message (to add its framing), so it allocates on every call,
+      //whatever the sketch does.  Model that copy here.
+      host_library_depth++;
+      String copy(s);
+      host_library_depth--;
+      n_messages++;
+      if (host_echo) { fputs("BLE: ", stdout); fputs(s.c_str(), stdout); fputc('\n', stdout); }
+      return s.length();
+    }
+    int available(void) { return 0; }
+    int recvBLE(String *s) { return 0; }
+    bool isConnected(void) { return false; }
+    void updateAdvertising(unsigned long, unsigned long) {}
+
+    bool host_echo = false;
+    unsigned long n_messages = 0;
+};
+
+class BLE_UI : public BLE {
+  public:
+    BLE_UI(void) {}
+    BLE_UI(void *serial) {}
+};
+
+#endif
@@ -0,0 +1,25 @@
+/*
+   BTNRH_WDRC_Types.h (host shim)
+
+   Created: OpenAudio, October 2026
+
+   Purpose: The one structure from the Tympan_Library's BTNRH_WDRC_Types.h that the sketch uses.  Keep it the same
+            as the library's, as it is part of the binary prescription upload (see PrescriptionUpload.h).
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_BTNRH_WDRC_Types_h
+#define _host_BTNRH_WDRC_Types_h
+
+namespace BTNRH_WDRC {
+  typedef struct {
+    int default_to_active;  //set to 1 to default to active
+    int afl;                //length of adaptive filter for feedback cancelation
+    float mu;               //mu, scale factor for how fast the adaptive filter adapts
+    float rho;              //rho, smoothing factor for estimating audio envelope
+    float eps;              //eps, when estimating audio level (power), this is the minimum allowed
+  } CHA_AFC;
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+   SdFat.h (host shim)
+
+   Created: OpenAudio, October 2026
+
+   Purpose: The part of SdFat that the sketch uses, backed by ordinary files in the current directory, so that
+            the presets, the AFC model, and the filterbank cache can be saved and loaded on a desktop.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_SdFat_h
+#define _host_SdFat_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>   //for O_RDONLY, O_RDWR, O_CREAT, O_TRUNC
+
+#define FIFO_SDIO 0
+
+class SdioConfig {
+  public:
+    SdioConfig(int opt) {}
+};
+
+class FsFile {
+  public:
+    FsFile(FILE *f = NULL) : fp(f) {}
+    operator bool(void) const { return fp != NULL; }
+    int read(void *buf, size_t n) { return fp ? (int)fread(buf, 1, n, fp) : -1; }
+    size_t write(const void *buf, size_t n) { return fp ? fwrite(buf, 1, n, fp) : 0; }
+    bool seekSet(uint64_t pos) { return fp && (fseek(fp, (long)pos, SEEK_SET) == 0); }
+    uint64_t curPosition(void) { return fp ? (uint64_t)ftell(fp) : 0; }
+    uint64_t size(void) {
+      if (!fp) return 0;
+      long cur = ftell(fp); fseek(fp, 0, SEEK_END); long n = ftell(fp); fseek(fp, cur, SEEK_SET);
+      return (uint64_t)n;
+    }
+    int available(void) { return (int)(size() - curPosition()); }
+    bool sync(void) { return fp && (fflush(fp) == 0); }
+    void close(void) { if (fp) fclose(fp); fp = NULL; }
+
+  private:
+    FILE *fp;
+};
+
+class SdFs {
+  public:
+    bool begin(SdioConfig config) { is_begun = true; return true; }
+    int fatType(void) { return is_begun ? 32 : 0; }  //0 until mounted
+    bool exists(const char *fname) { FILE *f = fopen(fname, "rb"); if (f) fclose(f); return f != NULL; }
+    bool remove(const char *fname) { return ::remove(fname) == 0; }
+    bool rename(const char *from, const char *to) { return ::rename(from, to) == 0; }
+    FsFile open(const char *fname, int oflag = O_RDONLY) {
+      if ((oflag & O_ACCMODE) == O_RDONLY) return FsFile(fopen(fname, "rb"));
+      if (oflag & O_TRUNC) return FsFile(fopen(fname, "w+b"));
+      FILE *f = fopen(fname, "r+b");
+      if ((f == NULL) && (oflag & O_CREAT)) f = fopen(fname, "w+b");
+      return FsFile(f);
+    }
+
+  private:
+    bool is_begun = false;
+};
+
+#endif
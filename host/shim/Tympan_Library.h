@@ -0,0 +1,112 @@
+/*
+   Tympan_Library.h (host shim)
+
+   Created: OpenAudio, October 2026
+
+   Purpose: The Tympan_Library classes that SerialManager.h, State.h, and AudioEffectBTNRH.h use, reduced to what a
+            desktop test needs.  The GUI classes (TympanRemoteFormatter, TR_Page, TR_Card) only count what is added
+            to them.  SerialManagerBase sends its button updates over BLE in the same format as the library.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_Tympan_Library_h
+#define _host_Tympan_Library_h
+
+#include "Arduino.h"
+#include "AudioStream_F32.h"
+#include "BTNRH_WDRC_Types.h"
+
+// ///////////////////////////////////////////////// GUI layout
+
+class TR_Card {
+  public:
+    int n_buttons = 0;
+    void addButton(const String &label, const String &command, const String &id, int width) { n_buttons++; }
+};
+
+class TR_Page {
+  public:
+    TR_Card *addCard(const String &name) { return &card; }
+  private:
+    TR_Card card;
+};
+
+class TympanRemoteFormatter {
+  public:
+    TR_Page *addPage(const String &name) { n_pages++; return &page; }
+    void addPredefinedPage(const String &name) { n_pages++; }
+    int get_nPages(void) { return n_pages; }
+    String asString(void) { return String("JSON={}"); }
+  private:
+    int n_pages = 0;
+    TR_Page page;
+};
+
+// ///////////////////////////////////////////////// serial and GUI state
+
+class SerialManagerBase {
+  public:
+    SerialManagerBase(BLE *_ble) : ble(_ble) {}
+    virtual ~SerialManagerBase(void) {}
+
+    void respondToByte(char c) { processCharacter(c); }
+    virtual bool processCharacter(char c) { return false; }
+    virtual bool processCharacterTriple(char mode_char, char chan_char, char data_char) { return false; }
+    virtual void printHelp(void) {}
+    virtual void setFullGUIState(bool activeButtonsOnly = false) {}
+    void add_UI_element(void *element) {}
+
+    void setButtonText(const String &btnId, const String &text) { if (ble) ble->sendMessage(String("TEXT=BTN:") + btnId + ":" + text); }
+    void setButtonState(const String &btnId, bool newState) { if (ble) ble->sendMessage(String("STATE=BTN:") + btnId + (newState ? ":1" : ":0")); }
+
+  protected:
+    BLE *ble;
+};
+
+class TympanStateBase_UI {
+  public:
+    TympanStateBase_UI(AudioSettings_F32 *settings, Print *serial, SerialManagerBase *sm) {}
+    TR_Card *addCard_cpuReporting(TR_Page *page_h) { return page_h->addCard("CPU Reporting"); }
+    void printCPUandMemory(unsigned long curTime_millis, unsigned long updatePeriod_millis) {}
+    bool flag_printCPUandMemory = false;
+};
+
+// ///////////////////////////////////////////////// hardware and audio classes
+
+class Tympan : public Print {
+  public:
+    size_t write(uint8_t c) { return Serial.write(c); }
+    using Print::write;
+};
+
+class EarpieceMixerState {};
+
+class EarpieceMixer_F32_UI {
+  public:
+    TR_Card *addCard_audioSource(TR_Page *page_h) { return page_h->addCard("Audio Source"); }
+    TR_Page *addPage_digitalEarpieces(TympanRemoteFormatter *gui) { return gui->addPage("Digital Earpieces"); }
+};
+
+class AudioSDWriter {
+  public:
+    enum STATE { UNPREPARED = 0, STOPPED, RECORDING };
+};
+
+class AudioSDWriter_F32_UI {
+  public:
+    int getState(void) { return AudioSDWriter::STOPPED; }
+    int getNumWriteChannels(void) { return 0; }
+    char getIDchar(void) { return 'w'; }
+    TR_Card *addCard_sdRecord(TR_Page *page_h) { return page_h->addCard("SD Recording"); }
+};
+
+class AudioEffectGain_F32 {
+  public:
+    float getGain_dB(void) { return gain_dB; }
+    float setGain_dB(float g) { return gain_dB = g; }
+  private:
+    float gain_dB = 0.0f;
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*
+   wav_io.h
+
+   Created: OpenAudio, October 2026
+
+   Purpose: Streaming WAV file reader and writer for the host programs.  Nothing is loaded into memory: samples
+            are read and written a block at a time, so a file of any length runs in constant memory.
+
+              * WavReader reads 16-, 24-, or 32-bit integer PCM or 32-bit float files.  Multi-channel files are
+                read as their first channel.  rewind() goes back to the first sample (eg, for a second pass).
+              * WavWriter writes mono 16-bit PCM (like the old write_wave() in tst_gha.c) or 32-bit float.  The
+                header is written with zero sizes and filled in by close().  Samples beyond +/-1.0 are clipped
+                (16-bit only) and counted.
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_wav_io_h
+#define _host_wav_io_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define WAV_FORMAT_PCM   1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+static inline uint32_t wav_get_u32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline uint16_t wav_get_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static inline void wav_put_u32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static inline void wav_put_u16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+
+// ///////////////////////////////////////////////// reader
+
+class WavReader {
+  public:
+    ~WavReader(void) { close(); }
+
+    bool open(const char *fname);      //returns false (with a message on stderr) if the file can't be read
+    void close(void) { if (fp) fclose(fp); fp = NULL; }
+    int read(float *x, int n);         //read up to n samples.  Returns the number read (0 at the end)
+    bool rewind(void);
+
+    double rate = 0;                   //sample rate (Hz)
+    int n_chan = 0;                    //channels in the file (only the first is read)
+    int bits = 0;
+    int format = 0;                    //WAV_FORMAT_PCM or WAV_FORMAT_FLOAT
+    uint64_t n_samples = 0;            //samples per channel
+
+  private:
+    FILE *fp = NULL;
+    long data_start = 0;
+    uint64_t n_read = 0;
+    int frame_bytes = 0;
+    static const int BUF_FRAMES = 1024;
+    uint8_t buf[BUF_FRAMES * 4 * 8];   //up to 8 channels of 32 bits per read
+};
+
+bool WavReader::open(const char *fname) {
+  uint8_t hdr[40];
+  bool have_fmt = false;
+
+  close();
+  fp = fopen(fname, "rb");
+  if (fp == NULL) { fprintf(stderr, "WavReader: can't open %s\n", fname); return false; }
+  if ((fread(hdr, 1, 12, fp) != 12) || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+    fprintf(stderr, "WavReader: %s is not a WAV file\n", fname); close(); return false;
+  }
+
+  //walk the chunks until we get to "data"
+  while (fread(hdr, 1, 8, fp) == 8) {
+    uint32_t size = wav_get_u32(hdr + 4);
+    if (!memcmp(hdr, "fmt ", 4)) {
+      uint32_t n = (size < sizeof(hdr)) ? size : sizeof(hdr);
+      if ((n < 16) || (fread(hdr, 1, n, fp) != n)) break;
+      format = wav_get_u16(hdr);
+      n_chan = wav_get_u16(hdr + 2);
+      rate = wav_get_u32(hdr + 4);
+      bits = wav_get_u16(hdr + 14);
+      if ((format == WAV_FORMAT_EXTENSIBLE) && (n >= 26)) format = wav_get_u16(hdr + 24);  //the sub-format
+      fseek(fp, (long)(size - n + (size & 1)), SEEK_CUR);
+      have_fmt = true;
+    } else if (!memcmp(hdr, "data", 4)) {
+      if (!have_fmt) break;
+      bool ok = ((format == WAV_FORMAT_PCM) && ((bits == 16) || (bits == 24) || (bits == 32))) ||
+                ((format == WAV_FORMAT_FLOAT) && (bits == 32));
+      if (!ok || (n_chan < 1) || (n_chan > 8)) {
+        fprintf(stderr, "WavReader: %s: unsupported format (format %d, %d bits, %d channels)\n", fname, format, bits, n_chan);
+        close(); return false;
+      }
+      frame_bytes = n_chan * bits / 8;
+      n_samples = size / frame_bytes;
+      if ((size == 0) || (size == 0xFFFFFFFF)) {  //size not filled in (eg, a recording that was cut off): use the rest of the file
+        long here = ftell(fp);
+        fseek(fp, 0, SEEK_END);
+        n_samples = (ftell(fp) - here) / frame_bytes;
+        fseek(fp, here, SEEK_SET);
+      }
+      data_start = ftell(fp);
+      n_read = 0;
+      return true;
+    } else {
+      fseek(fp, (long)(size + (size & 1)), SEEK_CUR);
+    }
+  }
+  fprintf(stderr, "WavReader: %s: no audio data found\n", fname);
+  close();
+  return false;
+}
+
+int WavReader::read(float *x, int n) {
+  int n_done = 0;
+  int bytes = bits / 8;
+  if (fp == NULL) return 0;
+  while (n_done < n) {
+    uint64_t n_left = n_samples - n_read;
+    int n_want = n - n_done;
+    if (n_want > BUF_FRAMES) n_want = BUF_FRAMES;
+    if ((uint64_t)n_want > n_left) n_want = (int)n_left;
+    if (n_want <= 0) break;
+    int n_got = (int)(fread(buf, frame_bytes, n_want, fp));
+    for (int i=0; i < n_got; i++) {
+      const uint8_t *p = buf + i * frame_bytes;  //first channel
+      float v;
+      if (format == WAV_FORMAT_FLOAT) { memcpy(&v, p, 4); }
+      else if (bytes == 2) { v = (int16_t)wav_get_u16(p) / 32768.0f; }
+      else if (bytes == 3) { v = ((int32_t)((p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8) / 8388608.0f; }
+      else { v = (float)((int32_t)wav_get_u32(p) / 2147483648.0); }
+      x[n_done + i] = v;
+    }
+    n_done += n_got;
+    n_read += n_got;
+    if (n_got < n_want) { n_samples = n_read; break; }  //the file is shorter than its header says
+  }
+  return n_done;
+}
+
+bool WavReader::rewind(void) {
+  if (fp == NULL) return false;
+  n_read = 0;
+  return fseek(fp, data_start, SEEK_SET) == 0;
+}
+
+// ///////////////////////////////////////////////// writer
+
+class WavWriter {
+  public:
+    ~WavWriter(void) { close(); }
+
+    bool open(const char *fname, double rate, int bits = 16);  //bits = 16 (PCM) or 32 (float)
+    bool write(const float *x, int n);
+    bool close(void);                  //fills in the header.  Returns false if there was a write error
+
+    uint64_t n_samples = 0;
+    unsigned long n_clipped = 0;
+
+  private:
+    FILE *fp = NULL;
+    int bits = 16;
+    bool failed = false;
+    static const int BUF_SAMPLES = 1024;
+    uint8_t buf[BUF_SAMPLES * 4];
+};
+
+bool WavWriter::open(const char *fname, double rate, int _bits) {
+  uint8_t hdr[44];
+  int format = (_bits == 32) ? WAV_FORMAT_FLOAT : WAV_FORMAT_PCM;
+
+  close();
+  bits = (_bits == 32) ? 32 : 16;
+  n_samples = 0; n_clipped = 0; failed = false;
+  fp = fopen(fname, "wb");
+  if (fp == NULL) { fprintf(stderr, "WavWriter: can't create %s\n", fname); return false; }
+
+  //the sizes are filled in by close()
+  memcpy(hdr, "RIFF", 4); wav_put_u32(hdr + 4, 0); memcpy(hdr + 8, "WAVE", 4);
+  memcpy(hdr + 12, "fmt ", 4); wav_put_u32(hdr + 16, 16);
+  wav_put_u16(hdr + 20, format);
+  wav_put_u16(hdr + 22, 1);                         //mono
+  wav_put_u32(hdr + 24, (uint32_t)(rate + 0.5));
+  wav_put_u32(hdr + 28, (uint32_t)(rate + 0.5) * (bits / 8));
+  wav_put_u16(hdr + 32, bits / 8);
+  wav_put_u16(hdr + 34, bits);
+  memcpy(hdr + 36, "data", 4); wav_put_u32(hdr + 40, 0);
+  if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) failed = true;
+  return !failed;
+}
+
+bool WavWriter::write(const float *x, int n) {
+  if (fp == NULL) return false;
+  while (n > 0) {
+    int m = (n > BUF_SAMPLES) ? BUF_SAMPLES : n;
+    if (bits == 32) {
+      memcpy(buf, x, m * sizeof(float));
+    } else {
+      for (int i=0; i < m; i++) {
+        float v = x[i] * 32768.0f;
+        if (v > 32767.0f) { v = 32767.0f; n_clipped++; }
+        else if (v < -32768.0f) { v = -32768.0f; n_clipped++; }
+        wav_put_u16(buf + 2*i, (uint16_t)(int16_t)lrintf(v));
+      }
+    }
+    if (fwrite(buf, bits / 8, m, fp) != (size_t)m) failed = true;
+    n_samples += m;
+    x += m; n -= m;
+  }
+  return !failed;
+}
+
+bool WavWriter::close(void) {
+  uint8_t b[4];
+  if (fp == NULL) return !failed;
+
+  //a WAV file can't say that it holds more than 4 GB.  Longer files get the largest size (most readers then read to the end)
+  uint64_t data_bytes = n_samples * (bits / 8);
+  if (data_bytes > 0xFFFFFFFFULL - 36) {
+    fprintf(stderr, "WavWriter: more than 4 GB of audio.  The WAV header can't hold the true size.\n");
+    data_bytes = 0xFFFFFFFFULL - 36;
+  }
+  wav_put_u32(b, (uint32_t)(data_bytes + 36)); fseek(fp, 4, SEEK_SET);  if (fwrite(b, 1, 4, fp) != 4) failed = true;
+  wav_put_u32(b, (uint32_t)data_bytes);        fseek(fp, 40, SEEK_SET); if (fwrite(b, 1, 4, fp) != 4) failed = true;
+  if (fclose(fp) != 0) failed = true;
+  fp = NULL;
+  return !failed;
+}
+
+#endif
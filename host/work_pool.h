@@ -0,0 +1,83 @@
+/*
+   work_pool.h
+
+   Created: OpenAudio, October 2026
+
+   Purpose: A small work-stealing thread pool for the host batch programs.  All of the jobs are added first and
+            dealt out to the workers' own queues.  Each worker takes jobs from the front of its own queue and,
+            when that is empty, steals from the back of another worker's queue, so that a worker that drew short
+            jobs helps with the others' long ones instead of sitting idle.  run() returns when every job is done.
+
+               WorkPool pool(n_threads);
+               for (int i=0; i < n_jobs; i++) pool.add(i);
+               pool.run([&](int job, int worker) { ... });
+
+   MIT License.  use at your own risk.
+*/
+
+#ifndef _host_work_pool_h
+#define _host_work_pool_h
+
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+
+class WorkPool {
+  public:
+    WorkPool(int _n_workers) : n_workers((_n_workers < 1) ? 1 : _n_workers) {
+      for (int w=0; w < n_workers; w++) queues.emplace_back(new Queue);
+    }
+
+    void add(int job) { queues[next_queue]->jobs.push_back(job); next_queue = (next_queue + 1) % n_workers; }
+    void run(std::function<void(int job, int worker)> fn);
+    int numWorkers(void) { return n_workers; }
+
+    //statistics
+    unsigned long n_stolen = 0;
+
+  private:
+    typedef struct { std::mutex lock; std::deque<int> jobs; } Queue;
+    int n_workers;
+    int next_queue = 0;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::mutex stats_lock;
+
+    bool take(int worker, int *job);
+};
+
+bool WorkPool::take(int worker, int *job) {
+  //our own queue first...
+  {
+    Queue &q = *queues[worker];
+    std::lock_guard<std::mutex> lock(q.lock);
+    if (!q.jobs.empty()) { *job = q.jobs.front(); q.jobs.pop_front(); return true; }
+  }
+  //...then steal from the others, starting with our neighbour
+  for (int i=1; i < n_workers; i++) {
+    Queue &q = *queues[(worker + i) % n_workers];
+    std::lock_guard<std::mutex> lock(q.lock);
+    if (!q.jobs.empty()) {
+      *job = q.jobs.back(); q.jobs.pop_back();
+      std::lock_guard<std::mutex> slock(stats_lock);
+      n_stolen++;
+      return true;
+    }
+  }
+  return false;  //no jobs are added while running, so there is nothing left to do
+}
+
+void WorkPool::run(std::function<void(int job, int worker)> fn) {
+  std::vector<std::thread> threads;
+  for (int w=0; w < n_workers; w++) {
+    threads.emplace_back([this, w, &fn]() {
+      int job;
+      while (take(w, &job)) fn(job, w);
+    });
+  }
+  for (std::thread &t : threads) t.join();
+}
+
+#endif